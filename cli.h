@@ -0,0 +1,118 @@
+#ifndef CLI_H
+#define CLI_H
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Fetch the value following option argv[i], advancing i
+inline const char* optionValue(int argc, char* argv[], int& i) {
+    if (i + 1 >= argc) {
+        std::cerr << "Missing value for " << argv[i] << std::endl;
+        return nullptr;
+    }
+    return argv[++i];
+}
+
+// Parse an integer option value and check that it lies in [minValue, maxValue]
+inline bool parseIntOption(const char* name, const char* value, long minValue, long maxValue, long& out) {
+    if (value == nullptr) {
+        return false;
+    }
+    try {
+        size_t used = 0;
+        long parsed = std::stol(value, &used);
+        if (used != std::string(value).size() || parsed < minValue || parsed > maxValue) {
+            std::cerr << "Invalid value for " << name << ": " << value
+                      << " (expected " << minValue << ".." << maxValue << ")" << std::endl;
+            return false;
+        }
+        out = parsed;
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Invalid value for " << name << ": " << value << std::endl;
+        return false;
+    }
+}
+
+// Parse a floating point option value and check that it lies in [minValue, maxValue]
+inline bool parseDoubleOption(const char* name, const char* value, double minValue, double maxValue, double& out) {
+    if (value == nullptr) {
+        return false;
+    }
+    try {
+        size_t used = 0;
+        double parsed = std::stod(value, &used);
+        if (used != std::string(value).size() || parsed < minValue || parsed > maxValue) {
+            std::cerr << "Invalid value for " << name << ": " << value
+                      << " (expected " << minValue << ".." << maxValue << ")" << std::endl;
+            return false;
+        }
+        out = parsed;
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Invalid value for " << name << ": " << value << std::endl;
+        return false;
+    }
+}
+
+// Parse a comma-separated list of integers, each in [minValue, maxValue]
+inline bool parseIntListOption(const char* name, const char* value, long minValue, long maxValue,
+                               std::vector<int>& out) {
+    if (value == nullptr) {
+        return false;
+    }
+    out.clear();
+    std::string list = value;
+    size_t pos = 0;
+    while (pos <= list.size()) {
+        size_t comma = list.find(',', pos);
+        if (comma == std::string::npos) {
+            comma = list.size();
+        }
+        long item = 0;
+        if (!parseIntOption(name, list.substr(pos, comma - pos).c_str(), minValue, maxValue, item)) {
+            return false;
+        }
+        out.push_back(static_cast<int>(item));
+        pos = comma + 1;
+    }
+    return true;
+}
+
+// Turn a small option file into command line arguments. Each non-empty line
+// is "key = value", "key value" or a bare "key" flag and becomes "--key value";
+// '#' starts a comment.
+inline bool loadOptionFile(const char* path, std::vector<std::string>& args) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Failed to open option file " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+        size_t equals = line.find('=');
+        if (equals != std::string::npos) {
+            line[equals] = ' ';
+        }
+        size_t keyStart = line.find_first_not_of(" \t\r");
+        if (keyStart == std::string::npos) {
+            continue;
+        }
+        size_t keyEnd = line.find_first_of(" \t\r", keyStart);
+        std::string key = line.substr(keyStart, keyEnd == std::string::npos ? std::string::npos : keyEnd - keyStart);
+        args.push_back("--" + key);
+        if (keyEnd != std::string::npos) {
+            size_t valueStart = line.find_first_not_of(" \t\r", keyEnd);
+            size_t valueEnd = line.find_last_not_of(" \t\r");
+            if (valueStart != std::string::npos) {
+                args.push_back(line.substr(valueStart, valueEnd - valueStart + 1));
+            }
+        }
+    }
+    return true;
+}
+
+#endif // CLI_H
@@ -1,15 +1,67 @@
 #include <iostream>
 #include <sys/socket.h>
+#include <sys/epoll.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <cstring>
+#include <climits>
 #include <random>
 #include <chrono>
 #include <string>
 #include <ctime>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <fstream>
+#include <iomanip>
+#include <queue>
+#include <algorithm>
+#include <sys/mman.h>
 #include <netinet/tcp.h>
 #include "config.h"
+#include "cli.h"
+#include "affinity.h"
+#include "histogram.h"
+#include "crc32c.h"
+#include "keystream.h"
+#include "protocol.h"
+#include "udp.h"
+#include "workload.h"
+#include "zerocopy.h"
+#include "cputime.h"
+#include "polling.h"
+#include "sampler.h"
+#include "perfcounters.h"
+#include "locality.h"
+#include "trace.h"
+#include "memstat.h"
+
+// Pipelining limits: outstanding requests per connection, and how many bytes
+// of requests or replies a connection buffers when the depth allows more
+constexpr int MAX_DEPTH = 4096;
+constexpr size_t PIPELINE_BUFFER_SIZE = 65536;
+constexpr int DRAIN_TIMEOUT_MS = 2000; // wait for outstanding replies between phases
+
+// UDP: a datagram without a reply after the loss timeout counts as lost;
+// windows are checked for expired datagrams this often
+constexpr int DEFAULT_LOSS_TIMEOUT_MS = 200;
+constexpr uint64_t LOSS_SWEEP_NS = 1000000;
+constexpr int UDP_SOCKET_BUFFER = 4 * 1024 * 1024;
+constexpr uint64_t SEQUENCE_MASK = (1ULL << 40) - 1; // per-connection part of a sequence number
+
+// --churn: pause after a failed connection, doubling per consecutive failure
+constexpr uint64_t CHURN_BACKOFF_MIN_NS = 1000000;
+constexpr uint64_t CHURN_BACKOFF_MAX_NS = 100000000;
+
+// --idle: most idle connections one client holds, and addresses --source-ips may span
+constexpr long MAX_IDLE_CONNECTIONS = 4000000;
+constexpr uint32_t MAX_SOURCE_ADDRESSES = 65536;
+
+// Linux 4.2, missing from older libc headers
+#ifndef IP_BIND_ADDRESS_NO_PORT
+#define IP_BIND_ADDRESS_NO_PORT 24
+#endif
 
 // Function to set socket to non-blocking mode
 bool setNonBlocking(int socket) {
@@ -28,6 +80,17 @@ bool setNonBlocking(int socket) {
     return true;
 }
 
+// Monotonic timestamp in nanoseconds for round-trip timing
+inline uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// A steady_clock deadline on the nowNs() scale
+inline uint64_t toNs(std::chrono::steady_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
 bool setTcpNoDelay(int socket) {
     int flag = 1;
     if (setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag)) < 0) {
@@ -37,137 +100,2089 @@ bool setTcpNoDelay(int socket) {
     return true;
 }
 
-int main(int argc, char* argv[]) {
-    // Parse command line argument for duration (default: 5 seconds)
+// Client command line options
+struct ClientOptions {
     int duration = 5;
-    if (argc > 1) {
-        try {
-            duration = std::stoi(argv[1]);
-            if (duration <= 0) {
-                std::cerr << "Duration must be a positive number" << std::endl;
-                return 1;
-            }
-        } catch (const std::exception& e) {
-            std::cerr << "Invalid duration: " << e.what() << std::endl;
-            return 1;
+    int connections = 1;
+    int threads = 1;
+    int interval = 1; // seconds between interval reports, 0 = only at exit
+    std::vector<int> cpus;
+    std::string histOut;
+    std::string resultOut;
+    std::string host = DEFAULT_SERVER_IP;
+    int port = DEFAULT_SERVER_PORT;
+    WorkloadProfile workload;
+    std::vector<int> depths = std::vector<int>(1, 1); // one run per pipelining depth
+    bool verify = false;
+    uint64_t verifySeed = 0;
+    bool udp = false;
+    std::vector<int> mmsgBatches = std::vector<int>(1, DEFAULT_MMSG_BATCH); // UDP: one run per batch size
+    bool gso = false;
+    bool gro = false;
+    int lossTimeoutMs = DEFAULT_LOSS_TIMEOUT_MS;
+    bool zerocopy = false;
+    int zerocopyBuffers = DEFAULT_ZEROCOPY_BUFFERS;
+    PollOptions poll;
+    std::vector<int> softirqCpus; // CPUs the softirq figures cover, empty = all
+    bool perfCounters = false;
+    bool locality = false;  // sample the softirq CPU of received replies
+    std::string traceFile;  // per-worker event trace, empty = off
+    long traceRecords = DEFAULT_TRACE_RECORDS;
+    int churn = 0;          // exchanges per short-lived connection, 0 = long-lived connections
+    double churnRate = 0;   // --churn: new connections per second over all threads, 0 = unpaced
+    int maxEvents = DEFAULT_MAX_EVENTS; // epoll events per wait
+    std::vector<int> idle;  // idle connections held open, one phase per count, empty = none
+    uint32_t sourceFirst = 0; // --source-ips: local addresses of the idle connections, host order,
+    uint32_t sourceLast = 0;  // 0 = chosen by the kernel
+};
+
+// A request on the wire whose reply has not arrived yet
+struct InFlight {
+    uint64_t startNs;   // when the request was due to go out; latency counts from here
+    uint64_t sequence;  // --verify and UDP: sequence number carried in the payload
+    uint32_t requestSize;
+    uint32_t replySize;
+    bool pending;       // UDP: neither answered nor given up as lost yet
+};
+
+// One pipelined connection driven by a worker's epoll loop. Requests are
+// queued back to back in the send buffer and replies parsed from the
+// receive buffer, so coalesced and split frames are handled alike.
+// In UDP mode it is a connected datagram socket whose in-flight ring is a
+// window indexed by sequence number, since replies may be lost or reordered.
+struct Connection {
+    int socket = -1;
+    uint64_t id = 0;           // global connection index, high bits of the sequence numbers
+    uint64_t nextSequence = 0;
+    unsigned char* sendBuffer = nullptr; // copyBuffer, or a zero-copy pool buffer, Worker::sendCapacity bytes
+    unsigned char* copyBuffer = nullptr; // worker arena
+    unsigned char* recvBuffer = nullptr; // worker arena, Worker::recvCapacity bytes
+    ZeroCopySocket zeroCopy;
+    size_t sendBytes = 0;  // requests queued
+    size_t sendOffset = 0; // of which already sent
+    size_t recvBytes = 0;  // start of the oldest unfinished reply
+    InFlight* inflight = nullptr; // ring of Worker::ringSize entries, oldest at inflightHead
+    int inflightHead = 0;
+    int outstanding = 0;
+    int credits = 0;          // closed loop: requests that may start now
+    bool timerArmed = false;  // open loop: waiting for nextSendNs
+    uint64_t nextSendNs = 0;  // open loop: scheduled send time of the next request
+    uint64_t oldestSequence = 0; // UDP: start of the window, the oldest unsettled datagram
+    uint64_t receivedFront = 0;  // UDP: one past the highest sequence number answered
+};
+
+// Message vectors and staging buffer for one sendmmsg or recvmmsg call
+struct MessageBatch {
+    std::vector<mmsghdr> msgs;
+    std::vector<iovec> iovs;
+    std::vector<unsigned char> controls;
+    std::vector<unsigned char> buffer;
+    std::vector<int> segments; // send: frames per message, more than one with GSO
+    size_t slotSize = 0;    // receive: bytes per message
+    size_t controlSize = 0; // receive: control bytes per message
+};
+
+// Connections waiting for a point in time, earliest first
+struct TimerQueue {
+    typedef std::pair<uint64_t, Connection*> Entry;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> entries;
+
+    void push(uint64_t readyNs, Connection* conn) {
+        entries.push(std::make_pair(readyNs, conn));
+    }
+
+    bool ready(uint64_t now) const {
+        return !entries.empty() && entries.top().first <= now;
+    }
+
+    Connection* pop() {
+        Connection* conn = entries.top().second;
+        entries.pop();
+        return conn;
+    }
+};
+
+// Draws request sizes and open-loop send gaps from the workload profile
+// and fills payloads from a keystream
+struct RequestGenerator {
+    const WorkloadProfile& profile;
+    std::minstd_rand gen;
+    Keystream keystream;
+    bool verify = false;
+    uint64_t sharedSeed = 0; // --verify seed, the same on the server
+    double meanGapNs = 0; // open loop: per-connection interval between sends
+    std::exponential_distribution<double> gaps;
+
+    RequestGenerator(const ClientOptions& options, unsigned int seed)
+        : profile(options.workload), gen(seed), keystream(seededKeystream(seed)),
+          verify(options.verify), sharedSeed(options.verifySeed) {
+        if (profile.rate > 0) {
+            meanGapNs = options.connections * 1e9 / profile.rate;
+            gaps = std::exponential_distribution<double>(1.0 / meanGapNs);
         }
     }
-    
-    // Create socket
-    int clientSocket = socket(AF_INET, SOCK_STREAM, 0);
+
+    // --verify: keystream seed of a request payload, so replies can be
+    // checked without keeping the requests around
+    uint64_t requestSeed(uint64_t sequence) const {
+        return verifySeed(~sharedSeed, sequence);
+    }
+
+    bool openLoop() const { return meanGapNs > 0; }
+
+    uint64_t nextGapNs() {
+        if (profile.arrivals == ArrivalProcess::Fixed) {
+            return static_cast<uint64_t>(meanGapNs);
+        }
+        return static_cast<uint64_t>(gaps(gen));
+    }
+};
+
+// Fixed-size fast path for the common frame sizes
+template <size_t N>
+struct FillFixed {
+    static void run(unsigned char* frame, Keystream* keystream) {
+        keystreamFill(*keystream, frame + FRAME_HEADER_SIZE, N - FRAME_HEADER_SIZE);
+    }
+};
+
+// Add to a worker counter that another thread samples while the worker
+// runs. Only the owning worker writes it; a relaxed atomic store of the new
+// value makes the concurrent reads race-free and still compiles to a plain
+// add and store.
+inline void countStat(long& counter, long amount = 1) {
+    __atomic_store_n(&counter, counter + amount, __ATOMIC_RELAXED);
+}
+
+// A worker thread with its own epoll instance and set of connections
+struct Worker {
+    int id = 0;
+    int cpu = -1; // -1 = not pinned
+    int epollFd = -1;
+    std::vector<Connection> connections;
+    unsigned char* arena = nullptr; // request/reply buffers of all connections
+    size_t arenaSize = 0;
+    size_t sendCapacity = 0;
+    size_t recvCapacity = 0;
+    std::vector<InFlight> inflight; // in-flight rings of all connections
+    ZeroCopyPool zeroCopy;          // --zerocopy: request buffers
+    Poller poller;                  // --poll: how the event loop waits
+    LocalitySampler locality;       // --locality: softirq CPU versus worker CPU
+    TraceRing trace;                // --trace: this worker's event ring
+    int maxEvents = DEFAULT_MAX_EVENTS; // epoll events per wait
+    int ringSize = 0;
+    int depth = 1;         // outstanding requests per connection in this phase
+    bool draining = false; // phase over: no new requests, replies are not counted
+    std::vector<unsigned char> verifyScratch; // expected reply payload
+    long verifiedReplies = 0;
+    long corruptReplies = 0;
+    long misorderedReplies = 0;
+    bool udp = false;
+    bool gso = false;
+    int mmsgBatch = 0;          // UDP: datagrams per sendmmsg/recvmmsg in this phase
+    MessageBatch sendBatch;
+    MessageBatch recvBatch;
+    uint64_t lossTimeoutNs = 0;
+    long lostDatagrams = 0;      // no reply within the loss timeout
+    long reorderedDatagrams = 0; // reply arrived after one for a later request
+    long lateDatagrams = 0;      // reply after being counted lost, or a duplicate
+    long mmsgCalls = 0;          // sendmmsg/recvmmsg calls that moved datagrams
+    TimerQueue timers;
+    long sendCount = 0;
+    long recvCount = 0;
+    long bytesSent = 0;
+    long bytesReceived = 0;
+    double seconds = 0;
+    bool failed = false;
+    Histogram latency;     // round trips since the last interval report
+    Histogram totalLatency;
+};
+
+// Collects interval histograms from the workers. Workers hand over their
+// interval data under the mutex once per interval; the main thread prints.
+struct IntervalReporter {
+    std::mutex mutex;
+    Histogram latency;
+    long messages = 0;
+
+    void submit(Histogram& workerLatency, long workerMessages) {
+        std::lock_guard<std::mutex> lock(mutex);
+        latency.merge(workerLatency);
+        messages += workerMessages;
+    }
+
+    void print(int seconds, double intervalSeconds) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::cout << "[" << seconds << "s] " << static_cast<long>(messages / intervalSeconds) << " msgs/s, latency ";
+        latency.printSummary(std::cout);
+        std::cout << std::endl;
+        latency.reset();
+        messages = 0;
+    }
+};
+
+void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [duration_in_seconds] [--duration S] [--connections C] [--threads T] [--cpus LIST]\n"
+              << "       [--interval S] [--hist-out FILE] [--result-out FILE] [--host IP] [--port N] [--size N]\n"
+              << "       [--size-dist SPEC]\n"
+              << "       [--reply-ratio R] [--think-us T] [--rate R] [--arrival poisson|fixed] [--depth LIST]\n"
+              << "       [--verify SEED] [--keystream KERNEL] [--profile FILE] [--udp] [--mmsg-batch LIST]\n"
+              << "       [--gso] [--gro] [--loss-timeout-ms N] [--zerocopy] [--zerocopy-buffers N]\n"
+              << "       [--poll MODE] [--busy-poll-us N] [--busy-poll-budget N] [--spin-us N] [--softirq-cpus LIST]\n"
+              << "       [--perf-counters] [--locality] [--trace FILE] [--trace-records N] [--churn N] [--churn-rate R]\n"
+              << "       [--max-events N] [--idle LIST] [--source-ips FIRST-LAST]\n"
+              << "  --duration S      run time in seconds (default: 5)\n"
+              << "  --connections C   total number of connections, spread over the threads (default: 1)\n"
+              << "  --threads T       number of worker threads, each with its own epoll loop (default: 1)\n"
+              << "  --cpus LIST       pin worker i to the i-th CPU of LIST, e.g. 0,2,4-7 (default: no pinning)\n"
+              << "  --interval S      print throughput and latency percentiles every S seconds, 0 = off (default: 1)\n"
+              << "  --hist-out FILE   write the final latency histogram as JSON to FILE\n"
+              << "  --result-out FILE write one CSV row of throughput, latency and CPU figures per phase to FILE\n"
+              << "  --host IP         server address (default: " << DEFAULT_SERVER_IP << ")\n"
+              << "  --port N          server port (default: " << DEFAULT_SERVER_PORT << ")\n"
+              << "  --size N          fixed request frame size in bytes, header included (default: " << DEFAULT_MESSAGE_SIZE << ")\n"
+              << "  --size-dist SPEC  request sizes: fixed:N, uniform:MIN:MAX or bimodal:SMALL:LARGE:FRACTION\n"
+              << "  --reply-ratio R   reply frame size as a multiple of the request size (default: 1)\n"
+              << "  --think-us T      pause T microseconds between a reply and the next request (default: 0)\n"
+              << "  --rate R          open loop: send R msgs/s in total on a schedule, independent of replies;\n"
+              << "                    latency counts from the scheduled send time (default: closed loop)\n"
+              << "  --arrival MODE    open-loop send times: poisson or fixed spacing (default: poisson)\n"
+              << "  --depth LIST      requests kept outstanding per connection; a list such as 1,4,16 runs\n"
+              << "                    one phase of the full duration per depth (default: 1)\n"
+              << "  --verify SEED     check every reply: sequence number, CRC32C and the server transform derived\n"
+              << "                    from SEED (start the server with the same --verify SEED); frames >= "
+              << MIN_VERIFIED_FRAME << " bytes\n"
+              << "  --keystream KERNEL payload fill kernel: auto, avx2, sse2 or scalar (default: auto)\n"
+              << "  --profile FILE    read options from FILE, one \"key = value\" per line\n"
+              << "  --udp             send each request as one datagram over a connected UDP socket per connection;\n"
+              << "                    --depth is the window of unanswered datagrams, closed loop only\n"
+              << "  --mmsg-batch LIST UDP: datagrams per sendmmsg/recvmmsg; a list such as 1,8,32 runs one phase\n"
+              << "                    per batch size and depth (default: " << DEFAULT_MMSG_BATCH << ")\n"
+              << "  --gso             UDP: send equal-size requests of a batch as UDP_SEGMENT super-packets\n"
+              << "  --gro             UDP: enable UDP_GRO and split received super-packets\n"
+              << "  --loss-timeout-ms N UDP: count a datagram as lost after N ms without a reply (default: "
+              << DEFAULT_LOSS_TIMEOUT_MS << ")\n"
+              << "  --zerocopy        send requests with MSG_ZEROCOPY from a pool of locked buffers, falling back\n"
+              << "                    to copying per connection when the kernel copies anyway (TCP only)\n"
+              << "  --zerocopy-buffers N zero-copy request buffers per worker (default: " << DEFAULT_ZEROCOPY_BUFFERS << ")\n"
+              << "  --poll MODE       how workers wait: spin (zero-timeout epoll_wait), block, busy-poll (block\n"
+              << "                    with SO_BUSY_POLL and epoll busy-poll params) or hybrid (spin, then block\n"
+              << "                    once idle for --spin-us) (default: spin)\n"
+              << "  --busy-poll-us N  busy-poll: microseconds the kernel polls per wait (default: " << DEFAULT_BUSY_POLL_US << ")\n"
+              << "  --busy-poll-budget N busy-poll: packets per device queue poll (default: " << DEFAULT_BUSY_POLL_BUDGET << ")\n"
+              << "  --spin-us N       hybrid: microseconds to keep spinning after the last event (default: "
+              << DEFAULT_SPIN_US << ")\n"
+              << "  --softirq-cpus LIST CPUs the softirq figures cover, printed every --interval and per phase,\n"
+              << "                    e.g. 0,2 (default: all)\n"
+              << "  --perf-counters   count cycles, instructions, cache misses, context switches, page faults and\n"
+              << "                    task clock with perf_event_open, per phase: setup, each run, shutdown\n"
+              << "  --locality        sample SO_INCOMING_CPU every " << LOCALITY_SAMPLE_INTERVAL
+              << " replies and report how many were processed\n"
+              << "                    on the CPU that ran their softirq\n"
+              << "  --trace FILE      TCP: record wakeups, recv/send and EAGAIN per worker in the memory-mapped\n"
+              << "                    FILE, read with trace_convert\n"
+              << "  --trace-records N --trace: latest events kept per worker (default: " << DEFAULT_TRACE_RECORDS << ")\n"
+              << "  --churn N         connection churn: every thread connects, makes N request/reply exchanges\n"
+              << "                    and closes, over and over, with blocking sockets; --connections, --depth\n"
+              << "                    and --poll do not apply\n"
+              << "  --churn-rate R    --churn: open R connections per second over all threads (default: as fast\n"
+              << "                    as possible)\n"
+              << "  --max-events N    events returned per epoll_wait (default: " << DEFAULT_MAX_EVENTS << ")\n"
+              << "  --idle LIST       TCP: also hold this many idle connections that never send; a list such as\n"
+              << "                    1000,10000,50000 runs one phase per count, opening more before each\n"
+              << "  --source-ips FIRST-LAST  --idle: spread the idle connections over the local addresses\n"
+              << "                    FIRST..LAST, e.g. 127.0.0.1-127.0.0.8, for more than one address's\n"
+              << "                    ephemeral ports (default: one address chosen by the kernel)\n";
+}
+
+bool parseOptions(int argc, char* argv[], ClientOptions& options);
+
+// Parse the IPv4 range FIRST-LAST of --source-ips into host order addresses
+bool parseAddressRange(const std::string& range, uint32_t& first, uint32_t& last) {
+    size_t dash = range.find('-');
+    struct in_addr address;
+    if (dash == std::string::npos || inet_pton(AF_INET, range.substr(0, dash).c_str(), &address) != 1) {
+        return false;
+    }
+    first = ntohl(address.s_addr);
+    if (inet_pton(AF_INET, range.substr(dash + 1).c_str(), &address) != 1) {
+        return false;
+    }
+    last = ntohl(address.s_addr);
+    return first <= last && last - first < MAX_SOURCE_ADDRESSES;
+}
+
+// Apply options loaded from a profile file. Profiles cannot include other
+// profiles, so a file naming itself cannot recurse without end.
+bool parseOptionList(const std::vector<std::string>& args, ClientOptions& options) {
+    std::vector<char*> argv;
+    argv.push_back(const_cast<char*>("profile"));
+    for (const std::string& arg : args) {
+        if (arg == "--profile") {
+            std::cerr << "A profile file cannot load another profile" << std::endl;
+            return false;
+        }
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    return parseOptions(static_cast<int>(argv.size()), argv.data(), options);
+}
+
+bool parseOptions(int argc, char* argv[], ClientOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        long value = 0;
+        if (arg == "--duration") {
+            if (!parseIntOption("--duration", optionValue(argc, argv, i), 1, 86400, value)) {
+                return false;
+            }
+            options.duration = static_cast<int>(value);
+        } else if (arg == "--connections") {
+            if (!parseIntOption("--connections", optionValue(argc, argv, i), 1, 10000000, value)) {
+                return false;
+            }
+            options.connections = static_cast<int>(value);
+        } else if (arg == "--threads") {
+            if (!parseIntOption("--threads", optionValue(argc, argv, i), 1, 1024, value)) {
+                return false;
+            }
+            options.threads = static_cast<int>(value);
+        } else if (arg == "--cpus") {
+            const char* list = optionValue(argc, argv, i);
+            if (list == nullptr || !parseCpuList(list, options.cpus)) {
+                std::cerr << "Invalid CPU list for --cpus" << std::endl;
+                return false;
+            }
+        } else if (arg == "--interval") {
+            if (!parseIntOption("--interval", optionValue(argc, argv, i), 0, 3600, value)) {
+                return false;
+            }
+            options.interval = static_cast<int>(value);
+        } else if (arg == "--hist-out") {
+            const char* path = optionValue(argc, argv, i);
+            if (path == nullptr) {
+                return false;
+            }
+            options.histOut = path;
+        } else if (arg == "--result-out") {
+            const char* path = optionValue(argc, argv, i);
+            if (path == nullptr) {
+                return false;
+            }
+            options.resultOut = path;
+        } else if (arg == "--host") {
+            const char* host = optionValue(argc, argv, i);
+            if (host == nullptr) {
+                return false;
+            }
+            options.host = host;
+        } else if (arg == "--port") {
+            if (!parseIntOption("--port", optionValue(argc, argv, i), 1, 65535, value)) {
+                return false;
+            }
+            options.port = static_cast<int>(value);
+        } else if (arg == "--size") {
+            const char* size = optionValue(argc, argv, i);
+            if (size == nullptr || !parseFrameSize(size, options.workload.size)) {
+                std::cerr << "Invalid value for --size (expected " << FRAME_HEADER_SIZE << ".." << MAX_FRAME_LIMIT << ")" << std::endl;
+                return false;
+            }
+            options.workload.distribution = SizeDistribution::Fixed;
+        } else if (arg == "--size-dist") {
+            const char* spec = optionValue(argc, argv, i);
+            if (spec == nullptr || !parseSizeDistribution(spec, options.workload)) {
+                std::cerr << "Invalid size distribution for --size-dist" << std::endl;
+                return false;
+            }
+        } else if (arg == "--reply-ratio") {
+            if (!parseDoubleOption("--reply-ratio", optionValue(argc, argv, i), 0.001, 1000, options.workload.replyRatio)) {
+                return false;
+            }
+        } else if (arg == "--think-us") {
+            if (!parseIntOption("--think-us", optionValue(argc, argv, i), 0, 10000000, value)) {
+                return false;
+            }
+            options.workload.thinkUs = static_cast<uint32_t>(value);
+        } else if (arg == "--rate") {
+            if (!parseDoubleOption("--rate", optionValue(argc, argv, i), 0.001, 1e9, options.workload.rate)) {
+                return false;
+            }
+        } else if (arg == "--arrival") {
+            const char* arrival = optionValue(argc, argv, i);
+            if (arrival == nullptr) {
+                return false;
+            }
+            if (std::string(arrival) == "poisson") {
+                options.workload.arrivals = ArrivalProcess::Poisson;
+            } else if (std::string(arrival) == "fixed") {
+                options.workload.arrivals = ArrivalProcess::Fixed;
+            } else {
+                std::cerr << "Unknown arrival process: " << arrival << std::endl;
+                return false;
+            }
+        } else if (arg == "--depth") {
+            if (!parseIntListOption("--depth", optionValue(argc, argv, i), 1, MAX_DEPTH, options.depths)) {
+                return false;
+            }
+        } else if (arg == "--verify") {
+            if (!parseIntOption("--verify", optionValue(argc, argv, i), 0, LONG_MAX, value)) {
+                return false;
+            }
+            options.verify = true;
+            options.verifySeed = static_cast<uint64_t>(value);
+        } else if (arg == "--keystream") {
+            const char* kernel = optionValue(argc, argv, i);
+            if (kernel == nullptr || !selectKeystreamKernel(kernel)) {
+                std::cerr << "Unknown or unsupported keystream kernel for --keystream" << std::endl;
+                return false;
+            }
+        } else if (arg == "--udp") {
+            options.udp = true;
+        } else if (arg == "--mmsg-batch") {
+            if (!parseIntListOption("--mmsg-batch", optionValue(argc, argv, i), 1, 1024, options.mmsgBatches)) {
+                return false;
+            }
+        } else if (arg == "--gso") {
+            options.gso = true;
+        } else if (arg == "--gro") {
+            options.gro = true;
+        } else if (arg == "--loss-timeout-ms") {
+            if (!parseIntOption("--loss-timeout-ms", optionValue(argc, argv, i), 1, DRAIN_TIMEOUT_MS / 2, value)) {
+                return false;
+            }
+            options.lossTimeoutMs = static_cast<int>(value);
+        } else if (arg == "--zerocopy") {
+            options.zerocopy = true;
+        } else if (arg == "--zerocopy-buffers") {
+            if (!parseIntOption("--zerocopy-buffers", optionValue(argc, argv, i), 1, 1000000, value)) {
+                return false;
+            }
+            options.zerocopyBuffers = static_cast<int>(value);
+        } else if (arg == "--poll") {
+            const char* mode = optionValue(argc, argv, i);
+            if (mode == nullptr || !parsePollMode(mode, options.poll.mode)) {
+                std::cerr << "Unknown polling mode for --poll" << std::endl;
+                return false;
+            }
+        } else if (arg == "--busy-poll-us") {
+            if (!parseIntOption("--busy-poll-us", optionValue(argc, argv, i), 0, 1000000, value)) {
+                return false;
+            }
+            options.poll.busyPollUs = static_cast<int>(value);
+        } else if (arg == "--busy-poll-budget") {
+            if (!parseIntOption("--busy-poll-budget", optionValue(argc, argv, i), 1, 65535, value)) {
+                return false;
+            }
+            options.poll.busyPollBudget = static_cast<int>(value);
+        } else if (arg == "--spin-us") {
+            if (!parseIntOption("--spin-us", optionValue(argc, argv, i), 0, 10000000, value)) {
+                return false;
+            }
+            options.poll.spinUs = static_cast<int>(value);
+        } else if (arg == "--perf-counters") {
+            options.perfCounters = true;
+        } else if (arg == "--locality") {
+            options.locality = true;
+        } else if (arg == "--trace") {
+            const char* path = optionValue(argc, argv, i);
+            if (path == nullptr) {
+                return false;
+            }
+            options.traceFile = path;
+        } else if (arg == "--trace-records") {
+            if (!parseIntOption("--trace-records", optionValue(argc, argv, i), static_cast<long>(MIN_TRACE_RECORDS),
+                                static_cast<long>(MAX_TRACE_RECORDS), options.traceRecords)) {
+                return false;
+            }
+        } else if (arg == "--churn") {
+            if (!parseIntOption("--churn", optionValue(argc, argv, i), 1, 1000000, value)) {
+                return false;
+            }
+            options.churn = static_cast<int>(value);
+        } else if (arg == "--churn-rate") {
+            if (!parseDoubleOption("--churn-rate", optionValue(argc, argv, i), 0.001, 1e9, options.churnRate)) {
+                return false;
+            }
+        } else if (arg == "--max-events") {
+            if (!parseIntOption("--max-events", optionValue(argc, argv, i), 1, 65536, value)) {
+                return false;
+            }
+            options.maxEvents = static_cast<int>(value);
+        } else if (arg == "--idle") {
+            if (!parseIntListOption("--idle", optionValue(argc, argv, i), 0, MAX_IDLE_CONNECTIONS, options.idle)) {
+                return false;
+            }
+            // Idle connections are only ever added
+            std::sort(options.idle.begin(), options.idle.end());
+            options.idle.erase(std::unique(options.idle.begin(), options.idle.end()), options.idle.end());
+        } else if (arg == "--source-ips") {
+            const char* range = optionValue(argc, argv, i);
+            if (range == nullptr || !parseAddressRange(range, options.sourceFirst, options.sourceLast)) {
+                std::cerr << "Invalid address range for --source-ips, expected FIRST-LAST" << std::endl;
+                return false;
+            }
+        } else if (arg == "--softirq-cpus") {
+            const char* list = optionValue(argc, argv, i);
+            if (list == nullptr || !parseCpuList(list, options.softirqCpus)) {
+                std::cerr << "Invalid CPU list for --softirq-cpus" << std::endl;
+                return false;
+            }
+        } else if (arg == "--profile") {
+            const char* path = optionValue(argc, argv, i);
+            std::vector<std::string> fileArgs;
+            if (path == nullptr || !loadOptionFile(path, fileArgs) || !parseOptionList(fileArgs, options)) {
+                return false;
+            }
+        } else if (arg == "--help" || arg == "-h") {
+            printUsage(argv[0]);
+            std::exit(0);
+        } else if (i == 1 && arg[0] != '-') {
+            // Legacy positional duration argument
+            if (!parseIntOption("duration", argv[i], 1, 86400, value)) {
+                return false;
+            }
+            options.duration = static_cast<int>(value);
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            printUsage(argv[0]);
+            return false;
+        }
+    }
+    if (options.churn == 0 && options.threads > options.connections) {
+        options.threads = options.connections;
+    }
+    return true;
+}
+
+// Open a connection to the server and switch it to non-blocking mode. In
+// UDP mode the socket is a connected datagram socket.
+int connectToServer(const ClientOptions& options) {
+    int clientSocket = socket(AF_INET, options.udp ? SOCK_DGRAM : SOCK_STREAM, 0);
     if (clientSocket == -1) {
-        std::cerr << "Failed to create socket" << std::endl;
-        return 1;
+        std::cerr << "Failed to create socket: " << strerror(errno) << std::endl;
+        return -1;
     }
     
     // Prepare server address
     struct sockaddr_in serverAddr;
+    memset(&serverAddr, 0, sizeof(serverAddr));
     serverAddr.sin_family = AF_INET;
-    serverAddr.sin_port = htons(SERVER_PORT);
+    serverAddr.sin_port = htons(options.port);
     
-    if (inet_pton(AF_INET, SERVER_IP, &serverAddr.sin_addr) <= 0) {
+    if (inet_pton(AF_INET, options.host.c_str(), &serverAddr.sin_addr) <= 0) {
         std::cerr << "Invalid address / Address not supported" << std::endl;
         close(clientSocket);
-        return 1;
+        return -1;
     }
     
-    // Connect to server
-    std::cout << "Connecting to server at " << SERVER_IP << ":" << SERVER_PORT << "..." << std::endl;
     if (connect(clientSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
         std::cerr << "Connection failed: " << strerror(errno) << std::endl;
         close(clientSocket);
-        return 1;
+        return -1;
     }
-    std::cout << "Connected to server" << std::endl;
     
     // Set socket to non-blocking mode
-    if (!setNonBlocking(clientSocket) || !setTcpNoDelay(clientSocket)) {
+    if (!setNonBlocking(clientSocket)) {
         close(clientSocket);
-        return 1;
+        return -1;
+    }
+    if (options.udp) {
+        growSocketBuffers(clientSocket, UDP_SOCKET_BUFFER);
+        if (options.gro && !enableGro(clientSocket)) {
+            std::cerr << "Failed to enable UDP_GRO: " << strerror(errno) << std::endl;
+            close(clientSocket);
+            return -1;
+        }
+    } else if (!setTcpNoDelay(clientSocket)) {
+        close(clientSocket);
+        return -1;
     }
     
-    // Setup faster non-cryptographically secure PRNG
-    unsigned int seed = static_cast<unsigned int>(time(nullptr));
-    std::minstd_rand fast_gen(seed);
-    std::uniform_int_distribution<> distrib(0, 255);
+    return clientSocket;
+}
+
+// --idle: open a blocking connection that never sends. With --source-ips the
+// index-th connection binds to an address of the range round-robin;
+// IP_BIND_ADDRESS_NO_PORT leaves the port to connect(), so every address
+// gets the whole ephemeral port range towards the server.
+int connectIdle(const ClientOptions& options, long index) {
+    int idleSocket = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (idleSocket == -1) {
+        std::cerr << "Failed to create idle socket: " << strerror(errno) << std::endl;
+        return -1;
+    }
+    if (options.sourceFirst != 0) {
+        int on = 1;
+        struct sockaddr_in local;
+        memset(&local, 0, sizeof(local));
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = htonl(options.sourceFirst + index % (options.sourceLast - options.sourceFirst + 1));
+        if (setsockopt(idleSocket, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &on, sizeof(on)) == -1
+            || bind(idleSocket, (struct sockaddr*)&local, sizeof(local)) == -1) {
+            std::cerr << "Failed to bind idle socket to " << inet_ntoa(local.sin_addr) << ": " << strerror(errno)
+                      << std::endl;
+            close(idleSocket);
+            return -1;
+        }
+    }
+    struct sockaddr_in serverAddr;
+    memset(&serverAddr, 0, sizeof(serverAddr));
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_port = htons(options.port);
+    inet_pton(AF_INET, options.host.c_str(), &serverAddr.sin_addr);
+    if (connect(idleSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) == -1) {
+        std::cerr << "Idle connection " << index << " failed: " << strerror(errno)
+                  << (errno == EADDRNOTAVAIL ? " (out of local ports, spread over more addresses with --source-ips)" : "")
+                  << std::endl;
+        close(idleSocket);
+        return -1;
+    }
+    return idleSocket;
+}
+
+// Write one request frame with a keystream payload. --verify frames carry
+// the sequence number and the payload CRC in their VerifyBlock.
+void buildRequest(RequestGenerator& generator, unsigned char* frame, uint32_t size, uint32_t replySize,
+                  uint64_t sequence) {
+    writeFrameHeader(frame, size, replySize);
+    if (generator.verify) {
+        Keystream keystream = seededKeystream(generator.requestSeed(sequence));
+        keystreamFill(keystream, frame + MIN_VERIFIED_FRAME, size - MIN_VERIFIED_FRAME);
+        writeVerifyBlock(frame, sequence, crc32c(frame + MIN_VERIFIED_FRAME, size - MIN_VERIFIED_FRAME));
+    } else if (!withFixedFrameSize<FillFixed>(size, frame, &generator.keystream)) {
+        keystreamFill(generator.keystream, frame + FRAME_HEADER_SIZE, size - FRAME_HEADER_SIZE);
+    }
+}
+
+// Queue new requests while the pipelining depth and the send buffer allow.
+// Closed loop spends credits (returned by replies, after the think time);
+// open loop follows the send schedule and arms a timer when ahead of it.
+void fillRequests(Worker& worker, Connection& conn, RequestGenerator& generator, uint64_t now) {
+    const WorkloadProfile& profile = generator.profile;
+    while (conn.outstanding < worker.depth && !worker.draining
+           && conn.sendBytes + profile.maxRequestSize() <= worker.sendCapacity) {
+        uint64_t startNs = now;
+        if (generator.openLoop()) {
+            if (conn.nextSendNs > now) {
+                if (!conn.timerArmed) {
+                    conn.timerArmed = true;
+                    worker.timers.push(conn.nextSendNs, &conn);
+                }
+                return;
+            }
+            // When behind the schedule the overdue request goes out right away
+            startNs = conn.nextSendNs;
+            conn.nextSendNs += generator.nextGapNs();
+        } else if (conn.credits == 0) {
+            return;
+        } else {
+            conn.credits--;
+        }
+        
+        // Draw the request size and build the frame
+        uint32_t size = profile.sampleRequestSize(generator.gen);
+        uint32_t replySize = profile.replySizeFor(size);
+        uint64_t sequence = generator.verify ? (conn.id << 40) | conn.nextSequence++ : 0;
+        buildRequest(generator, conn.sendBuffer + conn.sendBytes, size, replySize, sequence);
+        conn.sendBytes += size;
+        
+        InFlight& request = conn.inflight[(conn.inflightHead + conn.outstanding) % worker.ringSize];
+        request.startNs = startNs;
+        request.sequence = sequence;
+        request.requestSize = size;
+        request.replySize = replySize;
+        request.pending = true;
+        conn.outstanding++;
+        worker.sendCount++;
+        countStat(worker.bytesSent, size);
+    }
+}
+
+// --verify: rebuild the expected reply from the request's sequence number
+// and compare CRCs. Counts replies for the wrong request as misordered and
+// replies whose payload or CRC does not match as corrupt.
+void verifyReply(Worker& worker, const InFlight& request, const unsigned char* reply, RequestGenerator& generator) {
+    worker.verifiedReplies++;
+    VerifyBlock block = readVerifyBlock(reply);
+    if (block.sequence != request.sequence) {
+        worker.misorderedReplies++;
+        return;
+    }
+    size_t requestData = request.requestSize - MIN_VERIFIED_FRAME;
+    size_t replyData = request.replySize - MIN_VERIFIED_FRAME;
+    unsigned char* expected = worker.verifyScratch.data();
+    Keystream requestStream = seededKeystream(generator.requestSeed(request.sequence));
+    keystreamFill(requestStream, expected, requestData);
+    if (replyData > requestData) {
+        memset(expected + requestData, 0, replyData - requestData);
+    }
+    Keystream serverStream = seededKeystream(verifySeed(generator.sharedSeed, request.sequence));
+    keystreamXor(serverStream, expected, replyData);
+    if (crc32c(expected, replyData) != block.crc || crc32c(reply + MIN_VERIFIED_FRAME, replyData) != block.crc) {
+        worker.corruptReplies++;
+    }
+}
+
+// Consume every complete reply in the receive buffer. Returns false on a
+// protocol error.
+bool processReplies(Worker& worker, Connection& conn, RequestGenerator& generator) {
+    size_t offset = 0;
+    uint64_t now = 0;
+    while (conn.recvBytes - offset >= FRAME_HEADER_SIZE) {
+        if (conn.outstanding == 0) {
+            std::cerr << "Protocol error: reply without a request" << std::endl;
+            return false;
+        }
+        const InFlight& request = conn.inflight[conn.inflightHead];
+        FrameHeader header = readFrameHeader(conn.recvBuffer + offset);
+        if (header.length != request.replySize) {
+            std::cerr << "Protocol error: unexpected reply frame length" << std::endl;
+            return false;
+        }
+        if (conn.recvBytes - offset < header.length) {
+            break;
+        }
+        offset += header.length;
+        
+        // Replies that arrived together share one timestamp. The round trip
+        // counts from when the request was due, so a slow reply also charges
+        // the requests queued behind it (coordinated omission).
+        if (now == 0) {
+            now = nowNs();
+        }
+        if (generator.verify) {
+            verifyReply(worker, request, conn.recvBuffer + offset - header.length, generator);
+        }
+        worker.locality.message(conn.socket);
+        if (!worker.draining) {
+            countStat(worker.recvCount);
+            worker.bytesReceived += header.length;
+            worker.latency.record(now - request.startNs);
+        }
+        conn.inflightHead = (conn.inflightHead + 1) % worker.ringSize;
+        conn.outstanding--;
+        if (!generator.openLoop()) {
+            if (generator.profile.thinkUs > 0) {
+                worker.timers.push(now + generator.profile.thinkUs * 1000ULL, &conn);
+            } else {
+                conn.credits++;
+            }
+        }
+    }
     
-    // Buffer for sending/receiving data
-    unsigned char buffer[BUFFER_SIZE];
+    // Keep the partial reply at the start of the buffer
+    conn.recvBytes -= offset;
+    if (conn.recvBytes > 0 && offset > 0) {
+        memmove(conn.recvBuffer, conn.recvBuffer + offset, conn.recvBytes);
+    }
+    return true;
+}
+
+// UDP transport. Each connection keeps up to depth datagrams unsettled. The
+// sequence number indexes the in-flight ring, replies settle their entry in
+// any order, and entries older than the loss timeout are given up as lost.
+
+// Give up on expired datagrams and slide the window past settled entries
+void advanceWindow(Worker& worker, Connection& conn, uint64_t now) {
+    while (conn.oldestSequence < conn.nextSequence) {
+        InFlight& request = conn.inflight[conn.oldestSequence % worker.ringSize];
+        if (request.pending) {
+            if (now - request.startNs < worker.lossTimeoutNs) {
+                break;
+            }
+            request.pending = false;
+            worker.lostDatagrams++;
+        }
+        conn.oldestSequence++;
+    }
+    conn.outstanding = static_cast<int>(conn.nextSequence - conn.oldestSequence);
+}
+
+// Fill the window with up to mmsgBatch new datagrams and hand them over in
+// one sendmmsg call. With GSO, runs of equal-size requests share one
+// UDP_SEGMENT message. Datagrams the socket did not take are withdrawn.
+bool sendDatagrams(Worker& worker, Connection& conn, RequestGenerator& generator) {
+    uint64_t now = nowNs();
+    advanceWindow(worker, conn, now);
+    int count = std::min(worker.depth - conn.outstanding, worker.mmsgBatch);
+    if (count <= 0 || worker.draining) {
+        return true;
+    }
     
-    // Track start time
-    auto startTime = std::chrono::steady_clock::now();
-    auto endTime = startTime + std::chrono::seconds(duration);
+    const WorkloadProfile& profile = generator.profile;
+    MessageBatch& batch = worker.sendBatch;
+    size_t used = 0;
+    int messages = 0;
+    for (int i = 0; i < count; ++i) {
+        uint32_t size = profile.sampleRequestSize(generator.gen);
+        uint32_t replySize = profile.replySizeFor(size);
+        uint64_t sequence = (conn.id << 40) | conn.nextSequence;
+        unsigned char* frame = batch.buffer.data() + used;
+        buildRequest(generator, frame, size, replySize, sequence);
+        writeDatagramSequence(frame, sequence);
+        used += size;
+        
+        InFlight& request = conn.inflight[conn.nextSequence % worker.ringSize];
+        request.startNs = now;
+        request.sequence = sequence;
+        request.requestSize = size;
+        request.replySize = replySize;
+        request.pending = true;
+        conn.nextSequence++;
+        
+        if (worker.gso && messages > 0) {
+            iovec& last = batch.iovs[messages - 1];
+            int segments = batch.segments[messages - 1];
+            if (last.iov_len / segments == size && static_cast<size_t>(segments) < gsoSegmentsFor(size)) {
+                last.iov_len += size;
+                batch.segments[messages - 1]++;
+                continue;
+            }
+        }
+        batch.iovs[messages].iov_base = frame;
+        batch.iovs[messages].iov_len = size;
+        batch.segments[messages] = 1;
+        messages++;
+    }
+    for (int i = 0; i < messages; ++i) {
+        msghdr& hdr = batch.msgs[i].msg_hdr;
+        hdr.msg_iov = &batch.iovs[i];
+        hdr.msg_iovlen = 1;
+        if (batch.segments[i] > 1) {
+            setGsoSegment(hdr, batch.controls.data() + i * GSO_CONTROL_SIZE,
+                          static_cast<uint16_t>(batch.iovs[i].iov_len / batch.segments[i]));
+        } else {
+            hdr.msg_control = nullptr;
+            hdr.msg_controllen = 0;
+        }
+    }
+    
+    int sent = sendmmsg(conn.socket, batch.msgs.data(), messages, 0);
+    if (sent == -1) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS && errno != EINTR) {
+            std::cerr << "Send error: " << strerror(errno) << std::endl;
+            return false;
+        }
+        sent = 0;
+    } else {
+        worker.mmsgCalls++;
+    }
+    int sentFrames = 0;
+    for (int i = 0; i < sent; ++i) {
+        sentFrames += batch.segments[i];
+        countStat(worker.bytesSent, batch.iovs[i].iov_len);
+    }
+    worker.sendCount += sentFrames;
     
-    std::cout << "Starting high CPU usage simulation for " << duration << " seconds..." << std::endl;
+    // The unsent datagrams hold the newest sequence numbers
+    for (int i = sentFrames; i < count; ++i) {
+        conn.nextSequence--;
+        conn.inflight[conn.nextSequence % worker.ringSize].pending = false;
+    }
+    conn.outstanding = static_cast<int>(conn.nextSequence - conn.oldestSequence);
+    return true;
+}
+
+// Match one reply datagram to its window entry by sequence number. Returns
+// false on a protocol error.
+bool settleDatagram(Worker& worker, Connection& conn, RequestGenerator& generator, const unsigned char* reply,
+                    size_t size, uint64_t now) {
+    if (size < MIN_DATAGRAM_FRAME || readFrameHeader(reply).length != size) {
+        std::cerr << "Protocol error: malformed reply datagram" << std::endl;
+        return false;
+    }
+    uint64_t sequence = readDatagramSequence(reply);
+    uint64_t local = sequence & SEQUENCE_MASK;
+    InFlight& request = conn.inflight[local % worker.ringSize];
+    if ((sequence >> 40) != conn.id || local < conn.oldestSequence || local >= conn.nextSequence
+        || !request.pending) {
+        worker.lateDatagrams++;
+        return true;
+    }
+    if (size != request.replySize) {
+        std::cerr << "Protocol error: unexpected reply frame length" << std::endl;
+        return false;
+    }
+    request.pending = false;
+    if (local + 1 < conn.receivedFront) {
+        worker.reorderedDatagrams++;
+    } else {
+        conn.receivedFront = local + 1;
+    }
     
-    // Main loop
-    int sendCount = 0;
-    int recvCount = 0;
+    if (generator.verify) {
+        verifyReply(worker, request, reply, generator);
+    }
+    worker.locality.message(conn.socket);
+    if (!worker.draining) {
+        countStat(worker.recvCount);
+        worker.bytesReceived += size;
+        worker.latency.record(now - request.startNs);
+    }
+    return true;
+}
+
+// Read up to mmsgBatch replies with one recvmmsg call, splitting GRO
+// super-packets into their datagrams
+bool receiveDatagrams(Worker& worker, Connection& conn, RequestGenerator& generator) {
+    MessageBatch& batch = worker.recvBatch;
+    for (int i = 0; i < worker.mmsgBatch; ++i) {
+        msghdr& hdr = batch.msgs[i].msg_hdr;
+        hdr.msg_control = batch.controlSize > 0 ? batch.controls.data() + i * batch.controlSize : nullptr;
+        hdr.msg_controllen = batch.controlSize;
+        hdr.msg_flags = 0;
+    }
+    int received = recvmmsg(conn.socket, batch.msgs.data(), worker.mmsgBatch, 0, nullptr);
+    if (received == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return true;
+        }
+        std::cerr << "Receive error: " << strerror(errno) << std::endl;
+        return false;
+    }
+    worker.mmsgCalls++;
     
-    while (std::chrono::steady_clock::now() < endTime) {
-        // Fill buffer with random bytes using faster PRNG
-        for (size_t i = 0; i < BUFFER_SIZE; ++i) {
-            buffer[i] = static_cast<unsigned char>(distrib(fast_gen));
+    uint64_t now = nowNs();
+    for (int i = 0; i < received; ++i) {
+        msghdr& hdr = batch.msgs[i].msg_hdr;
+        size_t length = batch.msgs[i].msg_len;
+        if (length == 0 || (hdr.msg_flags & MSG_TRUNC)) {
+            std::cerr << "Protocol error: malformed reply datagram" << std::endl;
+            return false;
+        }
+        const unsigned char* data = batch.buffer.data() + i * batch.slotSize;
+        size_t segment = batch.controlSize > 0 ? groSegmentSize(hdr, length) : length;
+        for (size_t offset = 0; offset < length; offset += segment) {
+            if (!settleDatagram(worker, conn, generator, data + offset, std::min(segment, length - offset), now)) {
+                return false;
+            }
         }
+    }
+    advanceWindow(worker, conn, now);
+    return true;
+}
+
+// UDP counterpart of driveConnection: take in replies, then refill the window
+bool driveFlow(Worker& worker, Connection& conn, RequestGenerator& generator) {
+    return receiveDatagrams(worker, conn, generator) && sendDatagrams(worker, conn, generator);
+}
+
+// Advance one connection until the socket would block: queue requests,
+// send them, and read replies, which may free room for more requests.
+// Returns false when the connection failed or was closed by the server.
+bool driveConnection(Worker& worker, Connection& conn, RequestGenerator& generator) {
+    if (worker.udp) {
+        return driveFlow(worker, conn, generator);
+    }
+    while (true) {
+        fillRequests(worker, conn, generator, nowNs());
         
-        // Send data with busy polling
-        size_t totalSent = 0;
-        while (totalSent < BUFFER_SIZE) {
-            int sent = send(clientSocket, buffer + totalSent, BUFFER_SIZE - totalSent, 0);
-            
+        // On EAGAIN the rest goes out on the next EPOLLOUT edge
+        while (conn.sendOffset < conn.sendBytes) {
+            ssize_t sent = worker.zeroCopy.send(conn.zeroCopy, conn.socket, conn.sendBuffer + conn.sendOffset,
+                                                conn.sendBytes - conn.sendOffset, 0);
             if (sent > 0) {
-                totalSent += sent;
-            } else if (sent == -1) {
-                if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                    // Socket is not ready for writing, continue busy polling
-                    continue;
+                worker.trace.record(TraceEvent::Send, conn.socket, sent);
+                conn.sendOffset += sent;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                worker.trace.record(TraceEvent::Again, conn.socket, 1);
+                break;
+            } else {
+                std::cerr << "Send error: " << strerror(errno) << std::endl;
+                return false;
+            }
+        }
+        // Keep the unsent rest at the start of the buffer; zero-copy buffers
+        // already sent from are left alone until their completions arrive
+        if (conn.sendOffset > 0) {
+            conn.sendBuffer = worker.zeroCopy.advance(conn.zeroCopy, conn.sendBuffer, conn.sendOffset,
+                                                      conn.sendBytes, conn.copyBuffer);
+            conn.sendBytes -= conn.sendOffset;
+            conn.sendOffset = 0;
+        }
+        
+        ssize_t received = recv(conn.socket, conn.recvBuffer + conn.recvBytes, worker.recvCapacity - conn.recvBytes, 0);
+        if (received > 0) {
+            worker.trace.record(TraceEvent::Recv, conn.socket, received);
+            conn.recvBytes += received;
+            if (!processReplies(worker, conn, generator)) {
+                return false;
+            }
+        } else if (received == 0) {
+            std::cerr << "Connection closed by server" << std::endl;
+            return false;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            // Wait for the next EPOLLIN edge
+            worker.trace.record(TraceEvent::Again, conn.socket, 0);
+            return true;
+        } else {
+            std::cerr << "Receive error: " << strerror(errno) << std::endl;
+            return false;
+        }
+    }
+}
+
+// Carve every connection's send and receive buffers and in-flight ring from
+// per-worker storage. With a pipeline the buffers hold up to PIPELINE_BUFFER_SIZE
+// bytes of frames, and always at least one frame of the largest size.
+bool allocateBuffers(Worker& worker, const WorkloadProfile& workload, int maxDepth) {
+    size_t request = workload.maxRequestSize();
+    size_t reply = workload.maxReplySize();
+    worker.sendCapacity = std::max(request, std::min(maxDepth * request, PIPELINE_BUFFER_SIZE));
+    worker.recvCapacity = std::max(reply, std::min(maxDepth * reply, PIPELINE_BUFFER_SIZE));
+    size_t slot = (worker.sendCapacity + worker.recvCapacity + 63) / 64 * 64;
+    worker.arenaSize = slot * worker.connections.size();
+    void* arena = mmap(nullptr, worker.arenaSize, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (arena == MAP_FAILED) {
+        std::cerr << "Failed to allocate connection buffers: " << strerror(errno) << std::endl;
+        return false;
+    }
+    worker.arena = static_cast<unsigned char*>(arena);
+    worker.ringSize = maxDepth;
+    worker.inflight.resize(worker.connections.size() * maxDepth);
+    worker.verifyScratch.resize(std::max(request, reply));
+    for (size_t i = 0; i < worker.connections.size(); ++i) {
+        worker.connections[i].copyBuffer = worker.arena + i * slot;
+        worker.connections[i].sendBuffer = worker.connections[i].copyBuffer;
+        worker.connections[i].recvBuffer = worker.connections[i].copyBuffer + worker.sendCapacity;
+        worker.connections[i].inflight = &worker.inflight[i * maxDepth];
+    }
+    return true;
+}
+
+// Zero-copy completions raise EPOLLERR on the connection's socket
+void readZeroCopyCompletions(Worker& worker, Connection& conn, uint32_t events) {
+    if ((events & EPOLLERR) && worker.zeroCopy.enabled()) {
+        worker.zeroCopy.readCompletions(conn.zeroCopy, conn.socket);
+    }
+}
+
+// UDP: size the sendmmsg/recvmmsg vectors for the largest batch. Receive
+// slots hold the largest reply, or a whole GRO super-packet.
+void allocateMessageBatches(Worker& worker, const ClientOptions& options) {
+    size_t count = *std::max_element(options.mmsgBatches.begin(), options.mmsgBatches.end());
+    MessageBatch& send = worker.sendBatch;
+    send.msgs.assign(count, mmsghdr());
+    send.iovs.resize(count);
+    send.controls.assign(count * GSO_CONTROL_SIZE, 0);
+    send.segments.resize(count);
+    send.buffer.resize(count * options.workload.maxRequestSize());
+    
+    MessageBatch& recv = worker.recvBatch;
+    recv.slotSize = options.gro ? GRO_BUFFER_SIZE : options.workload.maxReplySize();
+    recv.controlSize = options.gro ? CMSG_SPACE(sizeof(int)) : 0;
+    recv.msgs.assign(count, mmsghdr());
+    recv.iovs.resize(count);
+    recv.controls.assign(count * recv.controlSize, 0);
+    recv.buffer.resize(count * recv.slotSize);
+    for (size_t i = 0; i < count; ++i) {
+        recv.iovs[i].iov_base = recv.buffer.data() + i * recv.slotSize;
+        recv.iovs[i].iov_len = recv.slotSize;
+        recv.msgs[i].msg_hdr.msg_iov = &recv.iovs[i];
+        recv.msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+}
+
+// Wait until every connection has its outstanding replies back, so the
+// next phase starts from idle connections. UDP windows also settle by
+// giving up on lost datagrams.
+bool drainConnections(Worker& worker, RequestGenerator& generator) {
+    std::vector<struct epoll_event> eventBuffer(worker.maxEvents);
+    struct epoll_event* events = eventBuffer.data();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(DRAIN_TIMEOUT_MS);
+    worker.draining = true;
+    while (std::chrono::steady_clock::now() < deadline) {
+        bool idle = true;
+        for (const Connection& conn : worker.connections) {
+            if (conn.outstanding > 0) {
+                idle = false;
+                break;
+            }
+        }
+        if (idle) {
+            return true;
+        }
+        int numEvents = worker.poller.wait(worker.epollFd, events, worker.maxEvents, LOSS_SWEEP_NS);
+        for (int i = 0; i < numEvents; ++i) {
+            Connection& conn = *static_cast<Connection*>(events[i].data.ptr);
+            readZeroCopyCompletions(worker, conn, events[i].events);
+            if (!driveConnection(worker, conn, generator)) {
+                return false;
+            }
+        }
+        if (worker.udp) {
+            uint64_t now = nowNs();
+            for (Connection& conn : worker.connections) {
+                advanceWindow(worker, conn, now);
+            }
+        }
+    }
+    std::cerr << "[worker " << worker.id << "] Timed out waiting for outstanding replies" << std::endl;
+    return false;
+}
+
+// Worker thread body: keep every connection busy at the given pipelining
+// depth (and UDP batch size) until the deadline, then drain
+void runWorker(Worker& worker, const ClientOptions& options, int depth, int mmsgBatch,
+               std::chrono::steady_clock::time_point endTime, IntervalReporter& reporter) {
+    if (worker.cpu >= 0 && !pinCurrentThread(worker.cpu)) {
+        std::cerr << "[worker " << worker.id << "] Failed to pin to CPU " << worker.cpu << std::endl;
+    }
+    worker.trace.bindThread();
+    
+    // Setup faster non-cryptographically secure PRNG
+    unsigned int seed = static_cast<unsigned int>(time(nullptr)) + worker.id * 7919 + depth;
+    RequestGenerator generator(options, seed);
+    int intervalSeconds = options.interval;
+    
+    worker.depth = depth;
+    worker.mmsgBatch = mmsgBatch;
+    worker.draining = false;
+    // recvCount and bytesSent are reset by the main thread before the
+    // workers and the softirq sampler start
+    worker.sendCount = 0;
+    worker.bytesReceived = 0;
+    worker.verifiedReplies = worker.corruptReplies = worker.misorderedReplies = 0;
+    worker.lostDatagrams = worker.reorderedDatagrams = worker.lateDatagrams = worker.mmsgCalls = 0;
+    worker.latency.reset();
+    worker.totalLatency.reset();
+    worker.poller.stats = PollStats();
+    worker.locality.stats = LocalityStats();
+    
+    // Start every connection. In open-loop mode each one waits for its first
+    // scheduled send, with a random phase so they do not fire in lockstep.
+    uint64_t startNs = nowNs();
+    for (Connection& conn : worker.connections) {
+        conn.credits = depth;
+        conn.timerArmed = false;
+        conn.nextSendNs = startNs;
+        conn.oldestSequence = conn.receivedFront = conn.nextSequence;
+        if (generator.openLoop()) {
+            conn.nextSendNs += static_cast<uint64_t>(
+                std::generate_canonical<double, 32>(generator.gen) * generator.meanGapNs);
+        }
+        if (!driveConnection(worker, conn, generator)) {
+            worker.failed = true;
+            return;
+        }
+    }
+    
+    std::vector<struct epoll_event> eventBuffer(worker.maxEvents);
+    struct epoll_event* events = eventBuffer.data();
+    auto startTime = std::chrono::steady_clock::now();
+    
+    auto nextReport = startTime + std::chrono::seconds(intervalSeconds);
+    long reportedMessages = 0;
+    uint64_t nextSweepNs = startNs + LOSS_SWEEP_NS;
+    
+    while (!worker.failed) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= endTime) {
+            break;
+        }
+        
+        // Hand the interval histogram over to the reporter
+        if (intervalSeconds > 0 && now >= nextReport) {
+            reporter.submit(worker.latency, worker.recvCount - reportedMessages);
+            reportedMessages = worker.recvCount;
+            worker.totalLatency.merge(worker.latency);
+            worker.latency.reset();
+            nextReport += std::chrono::seconds(intervalSeconds);
+        }
+        
+        // Sleep, if --poll allows it, no longer than the next thing to do
+        uint64_t waitStartNs = nowNs();
+        uint64_t wakeNs = toNs(endTime);
+        if (intervalSeconds > 0) {
+            wakeNs = std::min(wakeNs, toNs(nextReport));
+        }
+        if (!worker.timers.entries.empty()) {
+            wakeNs = std::min(wakeNs, worker.timers.entries.top().first);
+        }
+        if (worker.udp) {
+            wakeNs = std::min(wakeNs, nextSweepNs);
+        }
+        int numEvents = worker.poller.wait(worker.epollFd, events, worker.maxEvents,
+                                           wakeNs > waitStartNs ? wakeNs - waitStartNs : 0);
+        if (numEvents == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "epoll_wait failed: " << strerror(errno) << std::endl;
+            worker.failed = true;
+            break;
+        }
+        if (numEvents > 0) {
+            worker.trace.record(TraceEvent::Wakeup, -1, numEvents);
+        }
+        
+        for (int i = 0; i < numEvents; ++i) {
+            Connection& conn = *static_cast<Connection*>(events[i].data.ptr);
+            readZeroCopyCompletions(worker, conn, events[i].events);
+            if (!driveConnection(worker, conn, generator)) {
+                worker.failed = true;
+                break;
+            }
+        }
+        
+        // Connections whose think time is over get a credit back; open-loop
+        // connections whose scheduled send time has come start sending
+        if (!worker.timers.entries.empty()) {
+            uint64_t nowTick = nowNs();
+            while (worker.timers.ready(nowTick) && !worker.failed) {
+                Connection& conn = *worker.timers.pop();
+                if (generator.openLoop()) {
+                    conn.timerArmed = false;
                 } else {
-                    std::cerr << "Send error: " << strerror(errno) << std::endl;
-                    close(clientSocket);
-                    return 1;
+                    conn.credits++;
+                }
+                worker.failed = !driveConnection(worker, conn, generator);
+            }
+        }
+        
+        // UDP: give up on lost datagrams and refill windows that saw no event
+        if (worker.udp && !worker.failed) {
+            uint64_t nowTick = nowNs();
+            if (nowTick >= nextSweepNs) {
+                for (Connection& conn : worker.connections) {
+                    if (!sendDatagrams(worker, conn, generator)) {
+                        worker.failed = true;
+                        break;
+                    }
                 }
+                nextSweepNs = nowTick + LOSS_SWEEP_NS;
             }
         }
-        sendCount++;
+    }
+    
+    worker.seconds = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - startTime).count() / 1e6;
+    worker.totalLatency.merge(worker.latency);
+    worker.latency.reset();
+    
+    if (!worker.failed && !drainConnections(worker, generator)) {
+        worker.failed = true;
+    }
+    worker.timers = TimerQueue();
+}
+
+// --churn: a thread of short-lived connections. Each one connects, makes a
+// few blocking exchanges and closes, so the load is connection setup and
+// teardown (SYN, accept, FIN) rather than data transfer.
+struct ChurnWorker {
+    int id = 0;
+    int cpu = -1; // -1 = not pinned
+    long connections = 0; // completed: connected, all exchanges answered, closed
+    long failures = 0;    // connect or an exchange failed
+    int lastError = 0;
+    long recvCount = 0;
+    long bytesSent = 0;
+    Histogram connectLatency; // connect() call
+    Histogram lifetime;       // connect() through close()
+};
+
+// Bound every blocking call on a churn socket (connect included, which
+// honours SO_SNDTIMEO) by the run's deadline plus the drain allowance, so a
+// server that accepts and never answers cannot hold the run past --duration
+bool setChurnTimeouts(int socket, uint64_t endNs) {
+    uint64_t now = nowNs();
+    uint64_t timeoutNs = (endNs > now ? endNs - now : 0) + DRAIN_TIMEOUT_MS * 1000000ULL;
+    struct timeval timeout;
+    timeout.tv_sec = static_cast<time_t>(timeoutNs / 1000000000);
+    timeout.tv_usec = static_cast<suseconds_t>(timeoutNs % 1000000000 / 1000);
+    return setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) == 0
+        && setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == 0;
+}
+
+// One blocking round trip on a churn connection
+bool churnExchange(ChurnWorker& worker, int socket, RequestGenerator& generator, unsigned char* request,
+                   unsigned char* reply) {
+    uint32_t size = generator.profile.sampleRequestSize(generator.gen);
+    uint32_t replySize = generator.profile.replySizeFor(size);
+    buildRequest(generator, request, size, replySize, 0);
+    for (size_t offset = 0; offset < size;) {
+        ssize_t sent = send(socket, request + offset, size - offset, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            if (sent == -1 && errno == EAGAIN) errno = ETIMEDOUT;
+            return false;
+        }
+        offset += sent;
+    }
+    ssize_t received = recv(socket, reply, replySize, MSG_WAITALL);
+    if (received != static_cast<ssize_t>(replySize)) {
+        if (received == 0) {
+            errno = ECONNRESET; // closed by the server
+        } else if (received > 0 || errno == EAGAIN) {
+            errno = ETIMEDOUT; // partial or no reply before the timeout
+        }
+        return false;
+    }
+    countStat(worker.bytesSent, size);
+    countStat(worker.recvCount);
+    return true;
+}
+
+// Churn thread body: open connections on a fixed schedule (or back to back
+// without --churn-rate) until the deadline
+void runChurnWorker(ChurnWorker& worker, const ClientOptions& options, const sockaddr_in& serverAddr,
+                    std::chrono::steady_clock::time_point endTime) {
+    if (worker.cpu >= 0 && !pinCurrentThread(worker.cpu)) {
+        std::cerr << "[worker " << worker.id << "] Failed to pin to CPU " << worker.cpu << std::endl;
+    }
+    unsigned int seed = static_cast<unsigned int>(time(nullptr)) + worker.id * 7919;
+    RequestGenerator generator(options, seed);
+    std::vector<unsigned char> request(options.workload.maxRequestSize());
+    std::vector<unsigned char> reply(options.workload.maxReplySize());
+    uint64_t gapNs = options.churnRate > 0 ? static_cast<uint64_t>(options.threads * 1e9 / options.churnRate) : 0;
+    uint64_t endNs = toNs(endTime);
+    uint64_t nextStartNs = nowNs();
+    uint64_t backoffNs = 0;
+    
+    while (true) {
+        uint64_t startNs = nowNs();
+        if (gapNs > 0 && nextStartNs > startNs) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(std::min(nextStartNs, endNs) - startNs));
+            startNs = nowNs();
+        }
+        if (startNs >= endNs) {
+            break;
+        }
+        nextStartNs += gapNs;
         
-        // Receive data with busy polling
-        size_t totalReceived = 0;
-        while (totalReceived < BUFFER_SIZE) {
-            int received = recv(clientSocket, buffer + totalReceived, BUFFER_SIZE - totalReceived, 0);
+        errno = 0;
+        int socket = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool ok = socket != -1 && setChurnTimeouts(socket, endNs)
+               && connect(socket, (const struct sockaddr*)&serverAddr, sizeof(serverAddr)) == 0;
+        if (!ok && errno == EINPROGRESS) {
+            errno = ETIMEDOUT; // connect outlasted SO_SNDTIMEO
+        }
+        uint64_t connectedNs = nowNs();
+        if (ok) {
+            int flag = 1;
+            setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+        }
+        for (int i = 0; i < options.churn && ok; ++i) {
+            ok = churnExchange(worker, socket, generator, request.data(), reply.data());
+        }
+        int error = errno;
+        if (socket != -1) {
+            close(socket);
+        }
+        if (!ok) {
+            // A refused or unroutable connect fails at once; back off
+            // instead of spending the run on failing syscalls
+            countStat(worker.failures);
+            worker.lastError = error;
+            backoffNs = backoffNs == 0 ? CHURN_BACKOFF_MIN_NS : std::min(backoffNs * 2, CHURN_BACKOFF_MAX_NS);
+            uint64_t now = nowNs();
+            if (now < endNs) {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(std::min(backoffNs, endNs - now)));
+            }
+            continue;
+        }
+        backoffNs = 0;
+        uint64_t closedNs = nowNs();
+        worker.connectLatency.record(connectedNs - startNs);
+        worker.lifetime.record(closedNs - startNs);
+        countStat(worker.connections);
+    }
+}
+
+// --churn mode in place of the long-lived connections: run the churn
+// threads for the duration and report connections/s and CPU per connection
+bool runChurn(const ClientOptions& options) {
+    struct sockaddr_in serverAddr;
+    memset(&serverAddr, 0, sizeof(serverAddr));
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_port = htons(options.port);
+    if (inet_pton(AF_INET, options.host.c_str(), &serverAddr.sin_addr) <= 0) {
+        std::cerr << "Invalid address / Address not supported" << std::endl;
+        return false;
+    }
+    
+    PerfCounters perf;
+    PerfReading perfMark;
+    bool perfCounters = options.perfCounters;
+    if (perfCounters) {
+        std::string note;
+        if (!perf.open(note)) {
+            std::cerr << "Warning: perf counters unavailable: " << note << std::endl;
+            perfCounters = false;
+        } else if (!note.empty()) {
+            std::cerr << "Warning: perf counters: " << note << std::endl;
+        }
+        perfMark = perf.read();
+    }
+    
+    std::vector<ChurnWorker> workers(options.threads);
+    for (int i = 0; i < options.threads; ++i) {
+        workers[i].id = i;
+        if (!options.cpus.empty()) {
+            workers[i].cpu = options.cpus[i % options.cpus.size()];
+        }
+    }
+    std::cout << "Churning connections to " << options.host << ":" << options.port << " for " << options.duration
+              << " seconds with " << options.threads << " thread(s), " << options.churn
+              << " exchange(s) per connection, ";
+    if (options.churnRate > 0) {
+        std::cout << "target " << options.churnRate << " connections/s" << std::endl;
+    } else {
+        std::cout << "unpaced" << std::endl;
+    }
+    std::cout << "Workload: " << options.workload.describe() << std::endl;
+    
+    SoftirqSampler sampler;
+    bool sampling = sampler.start(options.interval, options.softirqCpus, [&workers](long& messages, long& bytes) {
+        for (ChurnWorker& worker : workers) {
+            messages += __atomic_load_n(&worker.recvCount, __ATOMIC_RELAXED);
+            bytes += __atomic_load_n(&worker.bytesSent, __ATOMIC_RELAXED);
+        }
+    });
+    if (!sampling) {
+        std::cerr << "Warning: cannot read /proc/stat, /proc/softirqs or /proc/self/stat, no softirq figures" << std::endl;
+    }
+    CpuTime cpuStart = processCpuTime();
+    if (perfCounters) {
+        perfMark = perf.read();
+    }
+    auto startTime = std::chrono::steady_clock::now();
+    auto endTime = startTime + std::chrono::seconds(options.duration);
+    std::vector<std::thread> threads;
+    for (ChurnWorker& worker : workers) {
+        threads.push_back(std::thread(runChurnWorker, std::ref(worker), std::cref(options), std::cref(serverAddr),
+                                      endTime));
+    }
+    if (options.interval > 0) {
+        long lastConnections = 0;
+        long lastFailures = 0;
+        for (int elapsed = options.interval; elapsed < options.duration; elapsed += options.interval) {
+            std::this_thread::sleep_until(startTime + std::chrono::seconds(elapsed));
+            long connections = 0;
+            long failures = 0;
+            for (ChurnWorker& worker : workers) {
+                connections += __atomic_load_n(&worker.connections, __ATOMIC_RELAXED);
+                failures += __atomic_load_n(&worker.failures, __ATOMIC_RELAXED);
+            }
+            std::cout << "[" << elapsed << "s] " << (connections - lastConnections) / options.interval
+                      << " connections/s, " << (failures - lastFailures) / options.interval << " failed/s" << std::endl;
+            lastConnections = connections;
+            lastFailures = failures;
+        }
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - startTime).count() / 1e6;
+    CpuTime cpu = processCpuTime() - cpuStart;
+    PerfReading perfDelta = perfCounters ? perf.read() - perfMark : PerfReading();
+    sampler.stop();
+    
+    long connections = 0;
+    long failures = 0;
+    long messages = 0;
+    long bytesSent = 0;
+    int lastError = 0;
+    Histogram connectLatency;
+    Histogram lifetime;
+    for (const ChurnWorker& worker : workers) {
+        connections += worker.connections;
+        failures += worker.failures;
+        messages += worker.recvCount;
+        bytesSent += worker.bytesSent;
+        lastError = worker.lastError != 0 ? worker.lastError : lastError;
+        connectLatency.merge(worker.connectLatency);
+        lifetime.merge(worker.lifetime);
+    }
+    std::cout << "Churn: " << connections << " connections in " << seconds << " s, "
+              << static_cast<long>(connections / seconds) << " connections/s, "
+              << static_cast<long>(messages / seconds) << " msgs/s, " << failures << " failed";
+    if (failures > 0) {
+        std::cout << " (last error: " << strerror(lastError) << ")";
+    }
+    std::cout << std::endl;
+    std::cout << "Connect latency: ";
+    connectLatency.printSummary(std::cout);
+    std::cout << std::endl << "Connection lifetime: ";
+    lifetime.printSummary(std::cout);
+    std::cout << std::endl;
+    std::cout << "CPU: " << cpu.user << " s user, " << cpu.system << " s sys, "
+              << cpu.softirq << " s softirq (all CPUs), "
+              << static_cast<long>(cpuNsPerKb(cpu, bytesSent)) << " ns per KB sent" << std::endl;
+    if (connections > 0) {
+        std::cout << "Per connection: " << cpu.total() * 1e6 / connections << " us process CPU, "
+                  << static_cast<long>(cpu.softirq * 1e9 / connections) << " ns softirq" << std::endl;
+    }
+    if (sampling) {
+        sampler.printSummary(std::cout);
+    }
+    if (perfCounters) {
+        std::vector<PerfPhase> phases(1);
+        phases[0].name = "churn";
+        phases[0].delta = perfDelta;
+        phases[0].messages = connections;
+        printPerfPhases(std::cout, perf, phases);
+    }
+    return connections > 0;
+}
+
+// Combined result of one phase
+struct PhaseResult {
+    int depth;
+    int mmsgBatch; // UDP only
+    long idle;     // --idle connections held open
+    long rssBytes; // client resident set at the end of the phase
+    SocketMemory sockets;
+    double rate;
+    double cpuUsPerMessage; // process user + system time
+    double softirqNsPerMessage; // machine-wide softirq time
+    double lossPercent;
+    Histogram latency;
+};
+
+int main(int argc, char* argv[]) {
+    ClientOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        return 1;
+    }
+    if (options.workload.rate > 0 && options.workload.thinkUs > 0) {
+        std::cerr << "--think-us applies to closed-loop mode only and cannot be combined with --rate" << std::endl;
+        return 1;
+    }
+    if (options.verify && (options.workload.size < MIN_VERIFIED_FRAME
+                           || options.workload.replySizeFor(options.workload.size) < MIN_VERIFIED_FRAME)) {
+        std::cerr << "--verify needs request and reply frames of at least " << MIN_VERIFIED_FRAME << " bytes" << std::endl;
+        return 1;
+    }
+    if (options.churn > 0) {
+        if (options.udp || options.zerocopy || options.verify || options.workload.rate > 0
+            || !options.traceFile.empty() || !options.idle.empty()) {
+            std::cerr << "--churn cannot be combined with --udp, --zerocopy, --verify, --rate, --trace or --idle"
+                      << std::endl;
+            return 1;
+        }
+        return runChurn(options) ? 0 : 1;
+    }
+    if (!options.idle.empty() && options.udp) {
+        std::cerr << "--idle applies to TCP only" << std::endl;
+        return 1;
+    }
+    if (options.sourceFirst != 0 && options.idle.empty()) {
+        std::cerr << "--source-ips applies to the --idle connections only" << std::endl;
+        return 1;
+    }
+    if (options.udp) {
+        if (options.workload.rate > 0 || options.workload.thinkUs > 0) {
+            std::cerr << "--udp runs closed loop only and cannot be combined with --rate or --think-us" << std::endl;
+            return 1;
+        }
+        if (options.workload.size < MIN_DATAGRAM_FRAME
+            || options.workload.replySizeFor(options.workload.size) < MIN_DATAGRAM_FRAME
+            || options.workload.maxRequestSize() > MAX_DATAGRAM_SIZE
+            || options.workload.maxReplySize() > MAX_DATAGRAM_SIZE) {
+            std::cerr << "--udp needs request and reply frames of " << MIN_DATAGRAM_FRAME << ".."
+                      << MAX_DATAGRAM_SIZE << " bytes" << std::endl;
+            return 1;
+        }
+        if (options.zerocopy) {
+            std::cerr << "--zerocopy applies to TCP only" << std::endl;
+            return 1;
+        }
+    } else {
+        // Batch sizes only apply to datagrams
+        options.mmsgBatches.assign(1, 0);
+    }
+    
+    // Counters inherit into threads created after they are opened
+    PerfCounters perf;
+    std::vector<PerfPhase> perfPhases;
+    PerfReading perfMark;
+    if (options.perfCounters) {
+        std::string note;
+        if (!perf.open(note)) {
+            std::cerr << "Warning: perf counters unavailable: " << note << std::endl;
+            options.perfCounters = false;
+        } else if (!note.empty()) {
+            std::cerr << "Warning: perf counters: " << note << std::endl;
+        }
+        perfMark = perf.read();
+    }
+    
+    // Distribute connections round-robin over the workers
+    std::vector<Worker> workers(options.threads);
+    for (int i = 0; i < options.threads; ++i) {
+        workers[i].id = i;
+        if (!options.cpus.empty()) {
+            workers[i].cpu = options.cpus[i % options.cpus.size()];
+        }
+        workers[i].connections.resize(options.connections / options.threads
+                                      + (i < options.connections % options.threads ? 1 : 0));
+        workers[i].udp = options.udp;
+        workers[i].gso = options.gso;
+        workers[i].lossTimeoutNs = options.lossTimeoutMs * 1000000ULL;
+        workers[i].poller.init(options.poll);
+        workers[i].locality.enabled = options.locality;
+        workers[i].maxEvents = options.maxEvents;
+        if (options.udp) {
+            allocateMessageBatches(workers[i], options);
+        }
+    }
+    
+    // One trace ring per worker, kept across phases
+    TraceFile trace;
+    if (!options.traceFile.empty()) {
+        if (options.udp) {
+            std::cerr << "--trace applies to TCP only, not tracing" << std::endl;
+        } else if (!trace.create(options.traceFile, "client", options.threads, options.traceRecords)) {
+            std::cerr << "Warning: cannot create trace file " << options.traceFile << ": " << strerror(errno)
+                      << std::endl;
+        } else {
+            for (Worker& worker : workers) {
+                worker.trace = trace.ring(worker.id, "worker " + std::to_string(worker.id));
+            }
+            std::cout << "Tracing to " << options.traceFile << std::endl;
+        }
+    }
+    
+    // Every connection, active or idle, takes a descriptor
+    if (!options.idle.empty()) {
+        long wanted = options.connections + options.idle.back() + options.threads + 64;
+        long limit = raiseFileLimit(wanted);
+        if (limit != -1 && limit < wanted) {
+            std::cerr << "Warning: open file limit is " << limit << ", below the " << wanted
+                      << " descriptors --idle needs (raise the hard limit with ulimit -Hn)" << std::endl;
+        }
+    }
+    
+    // Connect to server
+    std::cout << "Connecting to server at " << options.host << ":" << options.port
+              << " with " << options.connections << (options.udp ? " UDP socket(s)..." : " connection(s)...") << std::endl;
+    bool ok = true;
+    uint64_t nextConnectionId = 0;
+    for (Worker& worker : workers) {
+        worker.epollFd = epoll_create1(0);
+        int maxDepth = *std::max_element(options.depths.begin(), options.depths.end());
+        if (worker.epollFd == -1 || !allocateBuffers(worker, options.workload, maxDepth)) {
+            std::cerr << "Failed to create epoll instance: " << strerror(errno) << std::endl;
+            ok = false;
+            break;
+        }
+        if (options.zerocopy) {
+            bool locked = false;
+            if (!worker.zeroCopy.init(worker.sendCapacity, options.zerocopyBuffers, locked)) {
+                std::cerr << "Failed to allocate zero-copy buffers: " << strerror(errno) << std::endl;
+                ok = false;
+                break;
+            }
+            if (!locked && worker.id == 0) {
+                std::cerr << "Warning: could not lock zero-copy buffers (RLIMIT_MEMLOCK), continuing unlocked" << std::endl;
+            }
+        }
+        if (options.poll.mode == PollMode::BusyPoll && !enableEpollBusyPoll(worker.epollFd, options.poll)
+            && worker.id == 0) {
+            std::cerr << "Warning: epoll busy-poll params unavailable (" << strerror(errno)
+                      << "), needs Linux 6.9; relying on SO_BUSY_POLL" << std::endl;
+        }
+        for (Connection& conn : worker.connections) {
+            conn.id = nextConnectionId++;
+            conn.socket = connectToServer(options);
+            if (conn.socket == -1) {
+                ok = false;
+                break;
+            }
+            if (options.poll.mode == PollMode::BusyPoll && !enableSocketBusyPoll(conn.socket, options.poll)
+                && conn.id == 0) {
+                std::cerr << "Warning: SO_BUSY_POLL/SO_PREFER_BUSY_POLL failed (" << strerror(errno)
+                          << "), the budget and prefer options need CAP_NET_ADMIN" << std::endl;
+            }
+            if (worker.zeroCopy.enabled()) {
+                conn.zeroCopy.copying = !enableZeroCopy(conn.socket);
+                conn.sendBuffer = worker.zeroCopy.start(conn.zeroCopy, conn.copyBuffer);
+            }
             
-            if (received > 0) {
-                totalReceived += received;
-            } else if (received == 0) {
-                std::cerr << "Connection closed by server" << std::endl;
-                close(clientSocket);
-                return 1;
-            } else if (received == -1) {
-                if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                    // Socket is not ready for reading, continue busy polling
-                    continue;
-                } else {
-                    std::cerr << "Receive error: " << strerror(errno) << std::endl;
-                    close(clientSocket);
-                    return 1;
+            // Register once for both directions; edge-triggered notifications
+            // avoid re-arming on every direction change. A UDP socket only
+            // waits for replies, level-triggered, one recvmmsg per event.
+            struct epoll_event ev;
+            ev.events = options.udp ? EPOLLIN : EPOLLIN | EPOLLOUT | EPOLLET;
+            ev.data.ptr = &conn;
+            if (epoll_ctl(worker.epollFd, EPOLL_CTL_ADD, conn.socket, &ev) == -1) {
+                std::cerr << "Failed to add socket to epoll: " << strerror(errno) << std::endl;
+                ok = false;
+                break;
+            }
+        }
+        if (!ok) {
+            break;
+        }
+    }
+    if (!ok) {
+        for (Worker& worker : workers) {
+            for (Connection& conn : worker.connections) {
+                if (conn.socket != -1) close(conn.socket);
+            }
+            if (worker.epollFd != -1) close(worker.epollFd);
+            if (worker.arena != nullptr) munmap(worker.arena, worker.arenaSize);
+        }
+        return 1;
+    }
+    std::cout << "Connected to server" << std::endl;
+    std::cout << "Workload: " << options.workload.describe() << std::endl;
+    std::cout << "Payload fill: " << keystreamKernelName(activeKeystreamKernel()) << " keystream"
+              << (options.verify ? ", verifying replies" : "") << std::endl;
+    if (options.udp) {
+        std::cout << "Transport: UDP, sendmmsg/recvmmsg" << (options.gso ? ", GSO" : "") << (options.gro ? ", GRO" : "")
+                  << ", loss timeout " << options.lossTimeoutMs << " ms" << std::endl;
+    }
+    std::cout << "Polling: " << pollModeName(options.poll.mode);
+    if (options.poll.mode == PollMode::BusyPoll) {
+        std::cout << " (" << options.poll.busyPollUs << " us, budget " << options.poll.busyPollBudget << ")";
+    } else if (options.poll.mode == PollMode::Hybrid) {
+        std::cout << " (spin " << options.poll.spinUs << " us)";
+    }
+    std::cout << std::endl;
+    
+    if (options.perfCounters) {
+        PerfReading now = perf.read();
+        perfPhases.push_back(PerfPhase());
+        perfPhases.back().name = "setup";
+        perfPhases.back().delta = now - perfMark;
+        perfMark = now;
+    }
+    
+    // One phase per idle connection count, pipelining depth and UDP batch
+    // size, each over the same connections
+    std::vector<PhaseResult> results;
+    std::vector<int> idleSockets;
+    bool failed = false;
+    size_t idleSteps = std::max<size_t>(options.idle.size(), 1);
+    size_t perIdle = options.depths.size() * options.mmsgBatches.size();
+    size_t phases = idleSteps * perIdle;
+    for (size_t phase = 0; phase < phases && !failed; ++phase) {
+        size_t idleCount = options.idle.empty() ? 0 : options.idle[phase / perIdle];
+        int depth = options.depths[phase % perIdle / options.mmsgBatches.size()];
+        int mmsgBatch = options.mmsgBatches[phase % options.mmsgBatches.size()];
+        std::string label = "depth " + std::to_string(depth);
+        if (options.udp) {
+            label += ", batch " + std::to_string(mmsgBatch);
+        }
+        if (!options.idle.empty()) {
+            label = "idle " + std::to_string(idleCount) + ", " + label;
+        }
+        if (phases > 1) {
+            std::cout << "=== " << label << " ===" << std::endl;
+        }
+        
+        // Top up the idle connections; they stay open through later phases
+        if (idleSockets.size() < idleCount) {
+            std::cout << "Opening " << idleCount - idleSockets.size() << " idle connections..." << std::endl;
+            auto openStart = std::chrono::steady_clock::now();
+            while (idleSockets.size() < idleCount) {
+                int idleSocket = connectIdle(options, static_cast<long>(idleSockets.size()));
+                if (idleSocket == -1) {
+                    failed = true;
+                    break;
                 }
+                idleSockets.push_back(idleSocket);
+            }
+            if (failed) {
+                break;
             }
+            double openSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - openStart).count();
+            std::cout << "Idle connections: " << idleSockets.size() << " open, took " << openSeconds << " s"
+                      << std::endl;
         }
-        recvCount++;
         
-        // Optionally add a very small delay to prevent completely maxing out the CPU
-        // std::this_thread::sleep_for(std::chrono::microseconds(1));
+        // Track start time
+        auto startTime = std::chrono::steady_clock::now();
+        auto endTime = startTime + std::chrono::seconds(options.duration);
+        
+        std::cout << "Starting high CPU usage simulation for " << options.duration << " seconds with "
+                  << options.threads << " thread(s), " << label << "..." << std::endl;
+        
+        IntervalReporter reporter;
+        // The sampler reads recvCount and bytesSent while the workers count
+        // them with countStat; reset them here, before either starts
+        for (Worker& worker : workers) {
+            worker.recvCount = worker.bytesSent = 0;
+        }
+        SoftirqSampler sampler;
+        bool sampling = sampler.start(options.interval, options.softirqCpus, [&workers](long& messages, long& bytes) {
+            for (Worker& worker : workers) {
+                messages += __atomic_load_n(&worker.recvCount, __ATOMIC_RELAXED);
+                bytes += __atomic_load_n(&worker.bytesSent, __ATOMIC_RELAXED);
+            }
+        });
+        if (!sampling && phase == 0) {
+            std::cerr << "Warning: cannot read /proc/stat, /proc/softirqs or /proc/self/stat, no softirq figures" << std::endl;
+        }
+        CpuTime cpuStart = processCpuTime();
+        if (options.perfCounters) {
+            perfMark = perf.read();
+        }
+        std::vector<std::thread> threads;
+        for (Worker& worker : workers) {
+            threads.push_back(std::thread(runWorker, std::ref(worker), std::cref(options), depth, mmsgBatch,
+                                          endTime, std::ref(reporter)));
+        }
+        
+        // Print interval lines slightly after each boundary so every worker has submitted
+        if (options.interval > 0) {
+            auto slack = std::chrono::milliseconds(50);
+            for (int elapsed = options.interval; elapsed < options.duration; elapsed += options.interval) {
+                std::this_thread::sleep_until(startTime + std::chrono::seconds(elapsed) + slack);
+                reporter.print(elapsed, options.interval);
+            }
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        
+        // Calculate and display statistics
+        auto actualDuration = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - startTime).count() / 1000.0;
+        
+        std::cout << "Simulation completed in " << actualDuration << " seconds" << std::endl;
+        CpuTime cpu = processCpuTime() - cpuStart;
+        PerfReading perfDelta = options.perfCounters ? perf.read() - perfMark : PerfReading();
+        sampler.stop();
+        
+        long totalRecv = 0;
+        long totalBytesSent = 0;
+        long totalBytesReceived = 0;
+        double totalRate = 0;
+        Histogram latency;
+        for (const Worker& worker : workers) {
+            double rate = worker.seconds > 0 ? worker.recvCount / worker.seconds : 0;
+            std::cout << "Thread " << worker.id << " (cpu "
+                      << (worker.cpu >= 0 ? std::to_string(worker.cpu) : std::string("any")) << ", "
+                      << worker.connections.size() << " connections): "
+                      << worker.recvCount << " messages, " << static_cast<long>(rate) << " msgs/s" << std::endl;
+            totalRecv += worker.recvCount;
+            totalBytesSent += worker.bytesSent;
+            totalBytesReceived += worker.bytesReceived;
+            totalRate += rate;
+            failed = failed || worker.failed;
+            latency.merge(worker.totalLatency);
+        }
+        std::cout << "Combined: " << totalRecv << " messages (" << (totalBytesSent / 1024) << " KB sent, "
+                  << (totalBytesReceived / 1024) << " KB received), "
+                  << static_cast<long>(totalRate) << " msgs/s" << std::endl;
+        if (options.workload.rate > 0) {
+            std::cout << "Open loop: target " << options.workload.rate << " msgs/s, achieved "
+                      << static_cast<long>(totalRate * 100 / options.workload.rate) << "% of target" << std::endl;
+        }
+        std::cout << "Latency (" << latency.count() << " round trips): ";
+        latency.printSummary(std::cout);
+        std::cout << std::endl;
+        std::cout << "CPU: " << cpu.user << " s user, " << cpu.system << " s sys, "
+                  << cpu.softirq << " s softirq (all CPUs), "
+                  << static_cast<long>(cpuNsPerKb(cpu, totalBytesSent)) << " ns per KB sent" << std::endl;
+        PollStats poll;
+        for (const Worker& worker : workers) {
+            poll += worker.poller.stats;
+        }
+        printPollStats(std::cout, poll);
+        if (options.locality) {
+            LocalityStats locality;
+            for (const Worker& worker : workers) {
+                locality += worker.locality.stats;
+            }
+            printLocality(std::cout, locality);
+        }
+        if (sampling) {
+            sampler.printSummary(std::cout);
+        }
+        if (options.verify) {
+            long verified = 0;
+            long corrupt = 0;
+            long misordered = 0;
+            for (const Worker& worker : workers) {
+                verified += worker.verifiedReplies;
+                corrupt += worker.corruptReplies;
+                misordered += worker.misorderedReplies;
+            }
+            std::cout << "Verified " << verified << " replies: " << corrupt << " corrupt, "
+                      << misordered << " out of order" << std::endl;
+            failed = failed || corrupt > 0 || misordered > 0;
+        }
+        
+        PhaseResult result;
+        result.depth = depth;
+        result.mmsgBatch = mmsgBatch;
+        result.idle = static_cast<long>(idleSockets.size());
+        result.rssBytes = processRssBytes();
+        result.sockets = readSocketMemory();
+        if (!options.idle.empty()) {
+            std::cout << "Memory with " << options.connections << " active + " << result.idle
+                      << " idle connections: client RSS " << result.rssBytes / (1024 * 1024) << " MB";
+            if (result.sockets.valid) {
+                std::cout << ", TCP buffers " << result.sockets.tcpMemBytes / 1024 << " KB in "
+                          << result.sockets.tcpInUse << " sockets (machine-wide)";
+            }
+            std::cout << std::endl;
+        }
+        result.rate = totalRate;
+        result.cpuUsPerMessage = totalRecv > 0 ? cpu.total() * 1e6 / totalRecv : 0;
+        result.softirqNsPerMessage = totalRecv > 0 ? cpu.softirq * 1e9 / totalRecv : 0;
+        result.lossPercent = 0;
+        result.latency = latency;
+        if (options.udp) {
+            long sent = 0;
+            long lost = 0;
+            long reordered = 0;
+            long late = 0;
+            long calls = 0;
+            for (const Worker& worker : workers) {
+                sent += worker.sendCount;
+                lost += worker.lostDatagrams;
+                reordered += worker.reorderedDatagrams;
+                late += worker.lateDatagrams;
+                calls += worker.mmsgCalls;
+            }
+            result.lossPercent = sent > 0 ? 100.0 * lost / sent : 0;
+            std::cout << "UDP: " << sent << " datagrams sent, " << lost << " lost (" << result.lossPercent << "%), "
+                      << reordered << " reordered, " << late << " late; "
+                      << (totalRecv > 0 ? static_cast<double>(calls) / totalRecv : 0)
+                      << " sendmmsg/recvmmsg calls per round trip" << std::endl;
+        }
+        results.push_back(result);
+        if (options.perfCounters) {
+            perfPhases.push_back(PerfPhase());
+            perfPhases.back().name = phases > 1 ? label : "steady";
+            perfPhases.back().delta = perfDelta;
+            perfPhases.back().messages = totalRecv;
+            perfMark = perf.read();
+        }
+    }
+    
+    // The idle connections only matter while phases run; closing them first
+    // frees descriptors for the output files
+    for (int idleSocket : idleSockets) {
+        close(idleSocket);
     }
     
-    // Calculate and display statistics
-    auto actualDuration = std::chrono::duration_cast<std::chrono::milliseconds>(
-        std::chrono::steady_clock::now() - startTime).count() / 1000.0;
+    if (results.size() > 1) {
+        std::cout << (options.udp ? "UDP sweep:" : (options.idle.empty() ? "Depth sweep:" : "Idle sweep:")) << std::endl;
+        if (!options.idle.empty()) {
+            std::cout << std::setw(10) << "idle";
+        }
+        std::cout << std::setw(8) << "depth";
+        if (options.udp) {
+            std::cout << std::setw(8) << "batch";
+        }
+        std::cout << std::setw(12) << "msgs/s";
+        if (options.udp) {
+            std::cout << std::setw(10) << "loss %";
+        }
+        std::cout << std::setw(12) << "p50 us" << std::setw(12) << "p99 us" << std::setw(12) << "p99.9 us"
+                  << std::setw(14) << "cpu us/msg";
+        if (!options.idle.empty()) {
+            std::cout << std::setw(10) << "RSS MB" << std::setw(12) << "TCP mem KB";
+        }
+        std::cout << std::endl;
+        std::cout << std::fixed << std::setprecision(1);
+        for (const PhaseResult& result : results) {
+            if (!options.idle.empty()) {
+                std::cout << std::setw(10) << result.idle;
+            }
+            std::cout << std::setw(8) << result.depth;
+            if (options.udp) {
+                std::cout << std::setw(8) << result.mmsgBatch;
+            }
+            std::cout << std::setw(12) << static_cast<long>(result.rate);
+            if (options.udp) {
+                std::cout << std::setw(10) << std::setprecision(2) << result.lossPercent << std::setprecision(1);
+            }
+            std::cout << std::setw(12) << result.latency.percentile(50) / 1000.0
+                      << std::setw(12) << result.latency.percentile(99) / 1000.0
+                      << std::setw(12) << result.latency.percentile(99.9) / 1000.0
+                      << std::setw(14) << std::setprecision(2) << result.cpuUsPerMessage << std::setprecision(1);
+            if (!options.idle.empty()) {
+                std::cout << std::setw(10) << result.rssBytes / (1024 * 1024) << std::setw(12)
+                          << result.sockets.tcpMemBytes / 1024;
+            }
+            std::cout << std::endl;
+        }
+    }
     
-    std::cout << "Simulation completed in " << actualDuration << " seconds" << std::endl;
-    std::cout << "Sent " << sendCount << " packets (" << (sendCount * BUFFER_SIZE / 1024) << " KB)" << std::endl;
-    std::cout << "Received " << recvCount << " packets (" << (recvCount * BUFFER_SIZE / 1024) << " KB)" << std::endl;
+    if (options.zerocopy) {
+        ZeroCopyStats zeroCopy;
+        for (const Worker& worker : workers) {
+            zeroCopy += worker.zeroCopy.stats;
+        }
+        printZeroCopyStats(std::cout, zeroCopy);
+    }
+    if (trace.mapped()) {
+        uint64_t recorded, overwritten;
+        trace.counts(recorded, overwritten);
+        trace.close();
+        std::cout << "Trace: " << recorded << " events, " << overwritten << " overwritten, in "
+                  << options.traceFile << std::endl;
+    }
     
-    // Close socket
-    close(clientSocket);
+    // A single run writes the histogram itself; a sweep writes one per phase
+    if (!options.histOut.empty()) {
+        std::ofstream histFile(options.histOut);
+        if (!histFile) {
+            std::cerr << "Failed to open " << options.histOut << std::endl;
+            failed = true;
+        } else if (phases == 1 && !results.empty()) {
+            results[0].latency.writeJson(histFile);
+            histFile << std::endl;
+        } else {
+            histFile << "{\"depths\":[";
+            for (size_t i = 0; i < results.size(); ++i) {
+                histFile << (i > 0 ? "," : "") << "{\"depth\":" << results[i].depth;
+                if (!options.idle.empty()) {
+                    histFile << ",\"idle\":" << results[i].idle;
+                }
+                if (options.udp) {
+                    histFile << ",\"batch\":" << results[i].mmsgBatch << ",\"loss_percent\":" << results[i].lossPercent;
+                }
+                histFile << ",\"latency\":";
+                results[i].latency.writeJson(histFile);
+                histFile << "}";
+            }
+            histFile << "]}" << std::endl;
+        }
+    }
+    
+    // Machine-readable results for scripts and the benchmark driver
+    if (!options.resultOut.empty()) {
+        std::ofstream resultFile(options.resultOut);
+        if (!resultFile) {
+            std::cerr << "Failed to open " << options.resultOut << std::endl;
+            failed = true;
+        } else {
+            // New columns go last; softirq_bench reads the leading ones by position
+            resultFile << "depth,batch,msgs_per_s,p50_us,p99_us,p999_us,cpu_us_per_msg,softirq_ns_per_msg,loss_percent,"
+                       << "idle_connections,rss_kb,tcp_mem_kb" << std::endl;
+            for (const PhaseResult& result : results) {
+                resultFile << result.depth << "," << result.mmsgBatch << "," << result.rate << ","
+                           << result.latency.percentile(50) / 1000.0 << "," << result.latency.percentile(99) / 1000.0
+                           << "," << result.latency.percentile(99.9) / 1000.0 << "," << result.cpuUsPerMessage
+                           << "," << result.softirqNsPerMessage << "," << result.lossPercent << "," << result.idle
+                           << "," << result.rssBytes / 1024 << "," << result.sockets.tcpMemBytes / 1024 << std::endl;
+            }
+        }
+    }
+    
+    // Close sockets
+    for (Worker& worker : workers) {
+        for (Connection& conn : worker.connections) {
+            close(conn.socket);
+        }
+        close(worker.epollFd);
+        munmap(worker.arena, worker.arenaSize);
+    }
+    
+    if (options.perfCounters && !perfPhases.empty()) {
+        perfPhases.push_back(PerfPhase());
+        perfPhases.back().name = "shutdown";
+        perfPhases.back().delta = perf.read() - perfMark;
+        printPerfPhases(std::cout, perf, perfPhases);
+    }
     
-    return 0;
+    return failed ? 1 : 0;
 }
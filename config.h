@@ -1,9 +1,38 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
-// Common network configuration
-constexpr const char* SERVER_IP = "127.0.0.1";
-constexpr int SERVER_PORT = 10001;
-constexpr size_t BUFFER_SIZE = 16;
+#include <cstddef>
+
+// Common network configuration defaults; overridable with --host/--port
+constexpr const char* DEFAULT_SERVER_IP = "127.0.0.1";
+constexpr int DEFAULT_SERVER_PORT = 10001;
+
+// Default workload: 16-byte frames (header included) in both directions
+constexpr size_t DEFAULT_MESSAGE_SIZE = 16;
+
+// Largest frame the server accepts unless overridden with --max-frame
+constexpr size_t DEFAULT_MAX_FRAME_SIZE = 65536;
+
+// Datagrams moved per recvmmsg/sendmmsg call in UDP mode
+constexpr int DEFAULT_MMSG_BATCH = 32;
+
+// MSG_ZEROCOPY send buffers per server reactor or client worker
+constexpr int DEFAULT_ZEROCOPY_BUFFERS = 256;
+
+// --poll busy-poll: kernel busy-poll time per wait and packets per device poll
+constexpr int DEFAULT_BUSY_POLL_US = 50;
+constexpr int DEFAULT_BUSY_POLL_BUDGET = 8;
+
+// --poll hybrid: keep spinning this long after the last event, then block
+constexpr int DEFAULT_SPIN_US = 50;
+
+// --stats-shm: connections tracked individually, by fd, in the stats segment
+constexpr int DEFAULT_STATS_CONNECTION_SLOTS = 4096;
+
+// epoll events returned per wait, by server reactors and client workers
+constexpr int DEFAULT_MAX_EVENTS = 64;
+
+// --trace: events kept per thread ring (24 bytes each) before the oldest are overwritten
+constexpr long DEFAULT_TRACE_RECORDS = 1L << 20;
 
 #endif // CONFIG_H
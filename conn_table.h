@@ -0,0 +1,132 @@
+#ifndef CONN_TABLE_H
+#define CONN_TABLE_H
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+// Flat connection table indexed by fd. Every slot holds the connection state
+// followed by its I/O buffers, and all slots are carved from one arena that is
+// reserved up front (MAP_NORESERVE, so untouched slots cost no memory). Lookup
+// is a multiply and an add; opening and closing connections never touches the
+// allocator. Conn must be default-constructible and trivially destructible.
+template <typename Conn>
+class ConnectionTable {
+public:
+    static constexpr size_t MAX_SLOTS_LIMIT = 4 * 1024 * 1024;
+
+    ConnectionTable() = default;
+    ConnectionTable(const ConnectionTable&) = delete;
+    ConnectionTable& operator=(const ConnectionTable&) = delete;
+
+    ~ConnectionTable() {
+        if (arena_ != nullptr) {
+            munmap(arena_, slotSize_ * maxSlots_);
+        }
+    }
+
+    // Reserve one slot per possible fd (the RLIMIT_NOFILE soft limit) with
+    // bufferBytes of inline buffer space each
+    bool init(size_t bufferBytes) {
+        struct rlimit limit;
+        size_t maxSlots = 65536;
+        if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+            maxSlots = static_cast<size_t>(limit.rlim_cur);
+        }
+        if (maxSlots > MAX_SLOTS_LIMIT) {
+            maxSlots = MAX_SLOTS_LIMIT;
+        }
+
+        bufferBytes_ = bufferBytes;
+        headerSize_ = roundUp(sizeof(Slot), 16);
+        slotSize_ = roundUp(headerSize_ + bufferBytes, 16);
+        void* arena = mmap(nullptr, slotSize_ * maxSlots, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (arena == MAP_FAILED) {
+            return false;
+        }
+        arena_ = static_cast<unsigned char*>(arena);
+        maxSlots_ = maxSlots;
+        return true;
+    }
+
+    // Connection state for fd, or nullptr if fd is not an open connection
+    Conn* find(int fd) {
+        if (fd < 0 || static_cast<size_t>(fd) >= maxSlots_) {
+            return nullptr;
+        }
+        Slot* slot = slotAt(fd);
+        return slot->inUse ? &slot->conn : nullptr;
+    }
+
+    // Construct fresh connection state for fd; nullptr if fd is out of range
+    Conn* open(int fd) {
+        if (fd < 0 || static_cast<size_t>(fd) >= maxSlots_) {
+            return nullptr;
+        }
+        Slot* slot = slotAt(fd);
+        new (&slot->conn) Conn();
+        slot->inUse = true;
+        if (fd >= highWater_) {
+            highWater_ = fd + 1;
+        }
+        count_++;
+        return &slot->conn;
+    }
+
+    void release(int fd) {
+        Conn* conn = find(fd);
+        if (conn != nullptr) {
+            slotAt(fd)->inUse = false;
+            count_--;
+        }
+    }
+
+    // Inline buffer space that belongs to fd's slot
+    unsigned char* buffer(int fd) {
+        return arena_ + static_cast<size_t>(fd) * slotSize_ + headerSize_;
+    }
+
+    // Call fn(fd, conn) for every open connection
+    template <typename Fn>
+    void forEach(Fn fn) {
+        for (int fd = 0; fd < highWater_; ++fd) {
+            Slot* slot = slotAt(fd);
+            if (slot->inUse) {
+                fn(fd, slot->conn);
+            }
+        }
+    }
+
+    size_t size() const { return count_; }
+    size_t capacity() const { return maxSlots_; }
+    size_t bytesPerConnection() const { return slotSize_; }
+    size_t stateBytes() const { return headerSize_; }
+    size_t bufferBytes() const { return bufferBytes_; }
+
+private:
+    struct Slot {
+        bool inUse;
+        Conn conn;
+    };
+
+    static size_t roundUp(size_t value, size_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    Slot* slotAt(int fd) {
+        return reinterpret_cast<Slot*>(arena_ + static_cast<size_t>(fd) * slotSize_);
+    }
+
+    unsigned char* arena_ = nullptr;
+    size_t maxSlots_ = 0;
+    size_t slotSize_ = 0;
+    size_t headerSize_ = 0;
+    size_t bufferBytes_ = 0;
+    size_t count_ = 0;
+    int highWater_ = 0;
+};
+
+#endif // CONN_TABLE_H
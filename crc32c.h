@@ -0,0 +1,73 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CRC32C_X86 1
+#endif
+
+// CRC32C (Castagnoli), as used by iSCSI and ext4. Uses the SSE4.2 crc32
+// instruction when the CPU has it and a table-driven loop otherwise.
+
+struct Crc32cTable {
+    uint32_t entries[256];
+
+    Crc32cTable() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc >> 1) ^ (0x82f63b78u & (0u - (crc & 1)));
+            }
+            entries[i] = crc;
+        }
+    }
+};
+
+inline const uint32_t* crc32cTable() {
+    static const Crc32cTable table;
+    return table.entries;
+}
+
+inline uint32_t crc32cScalar(uint32_t crc, const unsigned char* data, size_t size) {
+    const uint32_t* table = crc32cTable();
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef CRC32C_X86
+__attribute__((target("sse4.2")))
+inline uint32_t crc32cHardware(uint32_t crc, const unsigned char* data, size_t size) {
+    size_t offset = 0;
+#ifdef __x86_64__
+    uint64_t crc64 = crc;
+    for (; offset + 8 <= size; offset += 8) {
+        uint64_t word;
+        memcpy(&word, data + offset, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = static_cast<uint32_t>(crc64);
+#endif
+    for (; offset < size; ++offset) {
+        crc = _mm_crc32_u8(crc, data[offset]);
+    }
+    return crc;
+}
+#endif
+
+inline uint32_t crc32c(const unsigned char* data, size_t size) {
+#ifdef CRC32C_X86
+    static const bool hardware = __builtin_cpu_supports("sse4.2");
+    if (hardware) {
+        return ~crc32cHardware(~0u, data, size);
+    }
+#endif
+    return ~crc32cScalar(~0u, data, size);
+}
+
+#endif // CRC32C_H
@@ -0,0 +1,144 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+
+// Fixed-memory log-linear latency histogram (HdrHistogram style).
+// Every power-of-two range is split into SUB_BUCKETS linear buckets, which
+// keeps the relative error below 1/SUB_BUCKETS (~1.6%) at any magnitude.
+// Recording is a couple of shifts and an increment with no allocation;
+// merging is an element-wise add, so per-thread histograms combine cheaply.
+class Histogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 6;
+    static constexpr uint64_t SUB_BUCKETS = 1ULL << SUB_BUCKET_BITS;
+    static constexpr int MAX_EXPONENT = 40; // values up to 2^41 ns (~36 min)
+    static constexpr size_t NUM_BUCKETS = SUB_BUCKETS + (MAX_EXPONENT - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    Histogram() { reset(); }
+
+    void reset() {
+        memset(counts_, 0, sizeof(counts_));
+        count_ = 0;
+        sum_ = 0;
+        min_ = UINT64_MAX;
+        max_ = 0;
+    }
+
+    void record(uint64_t value) {
+        counts_[bucketIndex(value)]++;
+        count_++;
+        sum_ += value;
+        if (value < min_) min_ = value;
+        if (value > max_) max_ = value;
+    }
+
+    void merge(const Histogram& other) {
+        for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        count_ += other.count_;
+        sum_ += other.sum_;
+        if (other.min_ < min_) min_ = other.min_;
+        if (other.max_ > max_) max_ = other.max_;
+    }
+
+    uint64_t count() const { return count_; }
+    uint64_t min() const { return count_ ? min_ : 0; }
+    uint64_t max() const { return max_; }
+    double mean() const { return count_ ? static_cast<double>(sum_) / count_ : 0; }
+
+    // Value at the given percentile (0..100), reported as the upper edge of
+    // the bucket holding it, capped by the largest recorded value
+    uint64_t percentile(double p) const {
+        if (count_ == 0) {
+            return 0;
+        }
+        uint64_t target = static_cast<uint64_t>(p / 100.0 * count_ + 0.5);
+        if (target < 1) target = 1;
+        if (target > count_) target = count_;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+            seen += counts_[i];
+            if (seen >= target) {
+                uint64_t high = bucketHigh(i);
+                return high < max_ ? high : max_;
+            }
+        }
+        return max_;
+    }
+
+    // One-line summary in microseconds
+    void printSummary(std::ostream& out) const {
+        std::ios::fmtflags flags = out.flags();
+        std::streamsize precision = out.precision();
+        out << std::fixed << std::setprecision(1);
+        out << "p50=" << percentile(50) / 1000.0 << "us"
+            << " p90=" << percentile(90) / 1000.0 << "us"
+            << " p99=" << percentile(99) / 1000.0 << "us"
+            << " p99.9=" << percentile(99.9) / 1000.0 << "us"
+            << " max=" << max_ / 1000.0 << "us";
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+    // Machine-readable dump: summary percentiles plus every non-empty bucket
+    // as [low_ns, high_ns, count]
+    void writeJson(std::ostream& out) const {
+        out << "{\"unit\":\"ns\",\"count\":" << count_
+            << ",\"min\":" << min() << ",\"mean\":" << static_cast<uint64_t>(mean()) << ",\"max\":" << max_
+            << ",\"p50\":" << percentile(50) << ",\"p90\":" << percentile(90)
+            << ",\"p99\":" << percentile(99) << ",\"p99.9\":" << percentile(99.9)
+            << ",\"buckets\":[";
+        bool first = true;
+        for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+            if (counts_[i] == 0) {
+                continue;
+            }
+            out << (first ? "" : ",") << "[" << bucketLow(i) << "," << bucketHigh(i) << "," << counts_[i] << "]";
+            first = false;
+        }
+        out << "]}";
+    }
+
+private:
+    static size_t bucketIndex(uint64_t value) {
+        if (value < SUB_BUCKETS) {
+            return static_cast<size_t>(value);
+        }
+        int exponent = 63 - __builtin_clzll(value);
+        if (exponent > MAX_EXPONENT) {
+            return NUM_BUCKETS - 1;
+        }
+        int shift = exponent - SUB_BUCKET_BITS;
+        return static_cast<size_t>(SUB_BUCKETS + shift * SUB_BUCKETS + ((value >> shift) - SUB_BUCKETS));
+    }
+
+    static uint64_t bucketLow(size_t index) {
+        if (index < SUB_BUCKETS) {
+            return index;
+        }
+        size_t shift = (index - SUB_BUCKETS) / SUB_BUCKETS;
+        uint64_t top = (index - SUB_BUCKETS) % SUB_BUCKETS + SUB_BUCKETS;
+        return top << shift;
+    }
+
+    static uint64_t bucketHigh(size_t index) {
+        if (index < SUB_BUCKETS) {
+            return index;
+        }
+        size_t shift = (index - SUB_BUCKETS) / SUB_BUCKETS;
+        return bucketLow(index) + (1ULL << shift) - 1;
+    }
+
+    uint64_t counts_[NUM_BUCKETS];
+    uint64_t count_;
+    uint64_t sum_;
+    uint64_t min_;
+    uint64_t max_;
+};
+
+#endif // HISTOGRAM_H
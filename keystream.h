@@ -0,0 +1,260 @@
+#ifndef KEYSTREAM_H
+#define KEYSTREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KEYSTREAM_X86 1
+#endif
+
+// Pseudo-random keystream used to fill request payloads and to transform
+// them on the server. Four xorshift128+ lanes produce one 32-byte block per
+// step (lane 0 first, little-endian words). The SSE2 and AVX2 kernels step
+// the lanes in parallel and yield exactly the bytes of the scalar kernel, so
+// the two ends may run different kernels. Every call consumes whole blocks;
+// the unused part of a final partial block is discarded. The state is
+// loaded unaligned: C++11 allocations only guarantee 16-byte alignment, and
+// a Keystream lives inside heap objects such as the reactors.
+struct Keystream {
+    static constexpr size_t LANES = 4;
+    static constexpr size_t BLOCK_SIZE = LANES * sizeof(uint64_t);
+    uint64_t s0[LANES];
+    uint64_t s1[LANES];
+};
+
+enum class KeystreamKernel {
+    Scalar,
+    Sse2,
+    Avx2
+};
+
+inline uint64_t splitmix64(uint64_t& state) {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+inline Keystream seededKeystream(uint64_t seed) {
+    Keystream ks;
+    for (size_t lane = 0; lane < Keystream::LANES; ++lane) {
+        ks.s0[lane] = splitmix64(seed);
+        ks.s1[lane] = splitmix64(seed) | 1; // never an all-zero state
+    }
+    return ks;
+}
+
+// One xorshift128+ step of every lane into out
+inline void keystreamBlockScalar(Keystream& ks, uint64_t* out) {
+    for (size_t lane = 0; lane < Keystream::LANES; ++lane) {
+        uint64_t x = ks.s0[lane];
+        uint64_t y = ks.s1[lane];
+        ks.s0[lane] = y;
+        x ^= x << 23;
+        ks.s1[lane] = x ^ y ^ (x >> 17) ^ (y >> 26);
+        out[lane] = ks.s1[lane] + y;
+    }
+}
+
+// XOR (or with Xor = false, store) size keystream bytes into data
+template <bool Xor>
+inline void keystreamScalar(Keystream& ks, unsigned char* data, size_t size) {
+    uint64_t block[Keystream::LANES];
+    size_t offset = 0;
+    for (; offset + Keystream::BLOCK_SIZE <= size; offset += Keystream::BLOCK_SIZE) {
+        keystreamBlockScalar(ks, block);
+        for (size_t lane = 0; lane < Keystream::LANES; ++lane) {
+            uint64_t word = block[lane];
+            if (Xor) {
+                uint64_t current;
+                memcpy(&current, data + offset + lane * 8, 8);
+                word ^= current;
+            }
+            memcpy(data + offset + lane * 8, &word, 8);
+        }
+    }
+    if (offset < size) {
+        keystreamBlockScalar(ks, block);
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(block);
+        for (size_t i = 0; offset + i < size; ++i) {
+            data[offset + i] = Xor ? data[offset + i] ^ bytes[i] : bytes[i];
+        }
+    }
+}
+
+#ifdef KEYSTREAM_X86
+
+// Lanes 0-1 and 2-3 live in one SSE register each
+template <bool Xor>
+__attribute__((target("sse2")))
+inline void keystreamSse2(Keystream& ks, unsigned char* data, size_t size) {
+    __m128i s0a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ks.s0));
+    __m128i s0b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ks.s0 + 2));
+    __m128i s1a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ks.s1));
+    __m128i s1b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ks.s1 + 2));
+    size_t offset = 0;
+    while (offset < size) {
+        __m128i xa = s0a, ya = s1a;
+        __m128i xb = s0b, yb = s1b;
+        s0a = ya;
+        s0b = yb;
+        xa = _mm_xor_si128(xa, _mm_slli_epi64(xa, 23));
+        xb = _mm_xor_si128(xb, _mm_slli_epi64(xb, 23));
+        s1a = _mm_xor_si128(_mm_xor_si128(xa, ya), _mm_xor_si128(_mm_srli_epi64(xa, 17), _mm_srli_epi64(ya, 26)));
+        s1b = _mm_xor_si128(_mm_xor_si128(xb, yb), _mm_xor_si128(_mm_srli_epi64(xb, 17), _mm_srli_epi64(yb, 26)));
+        __m128i outA = _mm_add_epi64(s1a, ya);
+        __m128i outB = _mm_add_epi64(s1b, yb);
+
+        if (offset + Keystream::BLOCK_SIZE <= size) {
+            __m128i* dst = reinterpret_cast<__m128i*>(data + offset);
+            if (Xor) {
+                outA = _mm_xor_si128(outA, _mm_loadu_si128(dst));
+                outB = _mm_xor_si128(outB, _mm_loadu_si128(dst + 1));
+            }
+            _mm_storeu_si128(dst, outA);
+            _mm_storeu_si128(dst + 1, outB);
+        } else {
+            alignas(16) unsigned char bytes[Keystream::BLOCK_SIZE];
+            _mm_store_si128(reinterpret_cast<__m128i*>(bytes), outA);
+            _mm_store_si128(reinterpret_cast<__m128i*>(bytes + 16), outB);
+            for (size_t i = 0; offset + i < size; ++i) {
+                data[offset + i] = Xor ? data[offset + i] ^ bytes[i] : bytes[i];
+            }
+        }
+        offset += Keystream::BLOCK_SIZE;
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(ks.s0), s0a);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(ks.s0 + 2), s0b);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(ks.s1), s1a);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(ks.s1 + 2), s1b);
+}
+
+// All four lanes in one AVX register
+template <bool Xor>
+__attribute__((target("avx2")))
+inline void keystreamAvx2(Keystream& ks, unsigned char* data, size_t size) {
+    __m256i s0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ks.s0));
+    __m256i s1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ks.s1));
+    size_t offset = 0;
+    while (offset < size) {
+        __m256i x = s0, y = s1;
+        s0 = y;
+        x = _mm256_xor_si256(x, _mm256_slli_epi64(x, 23));
+        s1 = _mm256_xor_si256(_mm256_xor_si256(x, y), _mm256_xor_si256(_mm256_srli_epi64(x, 17), _mm256_srli_epi64(y, 26)));
+        __m256i out = _mm256_add_epi64(s1, y);
+
+        if (offset + Keystream::BLOCK_SIZE <= size) {
+            __m256i* dst = reinterpret_cast<__m256i*>(data + offset);
+            if (Xor) {
+                out = _mm256_xor_si256(out, _mm256_loadu_si256(dst));
+            }
+            _mm256_storeu_si256(dst, out);
+        } else {
+            alignas(32) unsigned char bytes[Keystream::BLOCK_SIZE];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(bytes), out);
+            for (size_t i = 0; offset + i < size; ++i) {
+                data[offset + i] = Xor ? data[offset + i] ^ bytes[i] : bytes[i];
+            }
+        }
+        offset += Keystream::BLOCK_SIZE;
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(ks.s0), s0);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(ks.s1), s1);
+}
+
+#endif // KEYSTREAM_X86
+
+inline bool keystreamKernelSupported(KeystreamKernel kernel) {
+#ifdef KEYSTREAM_X86
+    switch (kernel) {
+    case KeystreamKernel::Avx2:
+        return __builtin_cpu_supports("avx2");
+    case KeystreamKernel::Sse2:
+        return __builtin_cpu_supports("sse2");
+    default:
+        return true;
+    }
+#else
+    return kernel == KeystreamKernel::Scalar;
+#endif
+}
+
+// Kernel used by keystreamXor/keystreamFill: the widest one the CPU
+// supports unless overridden with selectKeystreamKernel before any worker
+// thread starts
+inline KeystreamKernel& activeKeystreamKernel() {
+    static KeystreamKernel kernel = keystreamKernelSupported(KeystreamKernel::Avx2) ? KeystreamKernel::Avx2
+                                  : keystreamKernelSupported(KeystreamKernel::Sse2) ? KeystreamKernel::Sse2
+                                  : KeystreamKernel::Scalar;
+    return kernel;
+}
+
+inline const char* keystreamKernelName(KeystreamKernel kernel) {
+    switch (kernel) {
+    case KeystreamKernel::Avx2:
+        return "avx2";
+    case KeystreamKernel::Sse2:
+        return "sse2";
+    default:
+        return "scalar";
+    }
+}
+
+// Pick a kernel by name: auto, scalar, sse2 or avx2
+inline bool selectKeystreamKernel(const std::string& name) {
+    KeystreamKernel kernel;
+    if (name == "auto") {
+        return true;
+    } else if (name == "scalar") {
+        kernel = KeystreamKernel::Scalar;
+    } else if (name == "sse2") {
+        kernel = KeystreamKernel::Sse2;
+    } else if (name == "avx2") {
+        kernel = KeystreamKernel::Avx2;
+    } else {
+        return false;
+    }
+    if (!keystreamKernelSupported(kernel)) {
+        return false;
+    }
+    activeKeystreamKernel() = kernel;
+    return true;
+}
+
+inline void keystreamXor(Keystream& ks, unsigned char* data, size_t size) {
+#ifdef KEYSTREAM_X86
+    switch (activeKeystreamKernel()) {
+    case KeystreamKernel::Avx2:
+        keystreamAvx2<true>(ks, data, size);
+        return;
+    case KeystreamKernel::Sse2:
+        keystreamSse2<true>(ks, data, size);
+        return;
+    default:
+        break;
+    }
+#endif
+    keystreamScalar<true>(ks, data, size);
+}
+
+inline void keystreamFill(Keystream& ks, unsigned char* data, size_t size) {
+#ifdef KEYSTREAM_X86
+    switch (activeKeystreamKernel()) {
+    case KeystreamKernel::Avx2:
+        keystreamAvx2<false>(ks, data, size);
+        return;
+    case KeystreamKernel::Sse2:
+        keystreamSse2<false>(ks, data, size);
+        return;
+    default:
+        break;
+    }
+#endif
+    keystreamScalar<false>(ks, data, size);
+}
+
+#endif // KEYSTREAM_H
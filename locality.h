@@ -0,0 +1,79 @@
+#ifndef LOCALITY_H
+#define LOCALITY_H
+
+#include <sys/socket.h>
+#include <sched.h>
+#include <cstring>
+#include <ostream>
+
+// SO_INCOMING_CPU (Linux 3.19), missing from older libc headers
+#ifndef SO_INCOMING_CPU
+#define SO_INCOMING_CPU 49
+#endif
+
+// Messages between two locality samples; a sample costs a getsockopt
+constexpr int LOCALITY_SAMPLE_INTERVAL = 64;
+
+// The CPU that ran the socket's most recent NET_RX softirq, -1 if unknown
+inline int incomingCpu(int socket) {
+    int cpu = -1;
+    socklen_t length = sizeof(cpu);
+    if (getsockopt(socket, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &length) == -1) {
+        return -1;
+    }
+    return cpu;
+}
+
+// On a listener of a SO_REUSEPORT group: prefer this listener for
+// connections whose packets are processed on cpu
+inline bool setIncomingCpu(int socket, int cpu) {
+    return setsockopt(socket, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) == 0;
+}
+
+struct LocalityStats {
+    long samples = 0; // messages whose softirq CPU was known
+    long local = 0;   // of which processed on that same CPU
+    long unknown = 0; // SO_INCOMING_CPU unavailable
+
+    LocalityStats& operator+=(const LocalityStats& other) {
+        samples += other.samples;
+        local += other.local;
+        unknown += other.unknown;
+        return *this;
+    }
+};
+
+// Compares, for every LOCALITY_SAMPLE_INTERVAL-th message of an event loop,
+// the CPU the loop runs on with the CPU that ran the socket's softirq
+struct LocalitySampler {
+    bool enabled = false;
+    int countdown = 0;
+    LocalityStats stats;
+
+    void message(int socket) {
+        if (!enabled || --countdown > 0) {
+            return;
+        }
+        countdown = LOCALITY_SAMPLE_INTERVAL;
+        int cpu = incomingCpu(socket);
+        if (cpu < 0) {
+            stats.unknown++;
+            return;
+        }
+        stats.samples++;
+        if (cpu == sched_getcpu()) {
+            stats.local++;
+        }
+    }
+};
+
+inline void printLocality(std::ostream& out, const LocalityStats& stats) {
+    out << "Locality: " << (stats.samples > 0 ? 100.0 * stats.local / stats.samples : 0.0)
+        << "% of " << stats.samples << " sampled messages processed on the CPU that ran their softirq";
+    if (stats.unknown > 0) {
+        out << " (" << stats.unknown << " samples without SO_INCOMING_CPU)";
+    }
+    out << std::endl;
+}
+
+#endif // LOCALITY_H
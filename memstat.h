@@ -0,0 +1,75 @@
+#ifndef MEMSTAT_H
+#define MEMSTAT_H
+
+#include <sys/resource.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+
+// Memory figures for connection scaling runs: the process's resident set,
+// and the kernel's socket memory from /proc/net/sockstat, which counts the
+// sockets of both ends of a loopback run together
+
+// Resident set size in bytes, from /proc/self/statm; 0 if unavailable
+inline long processRssBytes() {
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (file == nullptr) {
+        return 0;
+    }
+    unsigned long size = 0, resident = 0;
+    int fields = fscanf(file, "%lu %lu", &size, &resident);
+    fclose(file);
+    return fields == 2 ? static_cast<long>(resident) * sysconf(_SC_PAGESIZE) : 0;
+}
+
+// Machine-wide socket counts and TCP buffer memory
+struct SocketMemory {
+    long sockets = 0;     // all sockets in use
+    long tcpInUse = 0;    // TCP sockets, listeners included
+    long tcpTimeWait = 0;
+    long tcpMemBytes = 0; // pages charged to TCP buffers, in bytes
+    bool valid = false;
+};
+
+inline SocketMemory readSocketMemory() {
+    SocketMemory memory;
+    FILE* file = fopen("/proc/net/sockstat", "r");
+    if (file == nullptr) {
+        return memory;
+    }
+    char line[256];
+    bool sockets = false, tcp = false;
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        long orphan = 0, alloc = 0, pages = 0;
+        if (strncmp(line, "sockets:", 8) == 0) {
+            sockets = sscanf(line, "sockets: used %ld", &memory.sockets) == 1;
+        } else if (strncmp(line, "TCP:", 4) == 0) {
+            tcp = sscanf(line, "TCP: inuse %ld orphan %ld tw %ld alloc %ld mem %ld", &memory.tcpInUse,
+                         &orphan, &memory.tcpTimeWait, &alloc, &pages) == 5;
+            memory.tcpMemBytes = pages * sysconf(_SC_PAGESIZE);
+        }
+    }
+    fclose(file);
+    memory.valid = sockets && tcp;
+    return memory;
+}
+
+// Raise the open file soft limit to at least wanted descriptors, as far as
+// the hard limit allows; returns the soft limit in effect, -1 if unlimited
+inline long raiseFileLimit(long wanted) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0) {
+        return -1;
+    }
+    if (limit.rlim_cur != RLIM_INFINITY && static_cast<rlim_t>(wanted) > limit.rlim_cur) {
+        rlim_t previous = limit.rlim_cur;
+        limit.rlim_cur = limit.rlim_max == RLIM_INFINITY || static_cast<rlim_t>(wanted) < limit.rlim_max
+                       ? static_cast<rlim_t>(wanted) : limit.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &limit) != 0) {
+            limit.rlim_cur = previous;
+        }
+    }
+    return limit.rlim_cur == RLIM_INFINITY ? -1 : static_cast<long>(limit.rlim_cur);
+}
+
+#endif // MEMSTAT_H
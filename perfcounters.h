@@ -0,0 +1,236 @@
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Process-wide hardware and software counters from perf_event_open, the
+// in-process counterpart of `perf stat`. Counters are opened with inherit
+// set, so they must be opened before the worker threads are started.
+
+enum PerfCounterId {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_CACHE_MISSES,
+    PERF_CONTEXT_SWITCHES,
+    PERF_PAGE_FAULTS,
+    PERF_TASK_CLOCK,
+    PERF_COUNTER_COUNT
+};
+
+struct PerfCounterSpec {
+    const char* name;
+    uint32_t type;
+    uint64_t config;
+};
+
+inline const PerfCounterSpec& perfCounterSpec(int id) {
+    static const PerfCounterSpec specs[PERF_COUNTER_COUNT] = {
+        {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {"cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {"context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+        {"page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+        {"task-clock-ms", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+    };
+    return specs[id];
+}
+
+// Counter values at one point in time, scaled for multiplexing
+struct PerfReading {
+    double values[PERF_COUNTER_COUNT] = {0};
+
+    PerfReading operator-(const PerfReading& other) const {
+        PerfReading diff;
+        for (int i = 0; i < PERF_COUNTER_COUNT; ++i) {
+            diff.values[i] = values[i] - other.values[i];
+        }
+        return diff;
+    }
+};
+
+class PerfCounters {
+public:
+    PerfCounters() {
+        for (int i = 0; i < PERF_COUNTER_COUNT; ++i) {
+            fds_[i] = -1;
+        }
+    }
+
+    ~PerfCounters() { close(); }
+
+    // Open and start every counter the kernel allows. The hardware counters
+    // form one group and the software counters another, so each group is
+    // scheduled together. Returns false if none could be opened; note says
+    // which counters are missing and why.
+    bool open(std::string& note) {
+        std::ostringstream missing;
+        userOnly_ = false;
+        int hardwareErrno = 0;
+        for (int i = 0; i < PERF_COUNTER_COUNT; ++i) {
+            bool hardware = perfCounterSpec(i).type == PERF_TYPE_HARDWARE;
+            int leaderId = hardware ? PERF_CYCLES : PERF_CONTEXT_SWITCHES;
+            if (i != leaderId && fds_[leaderId] == -1) {
+                continue; // no group to join
+            }
+            fds_[i] = openCounter(perfCounterSpec(i), i == leaderId ? -1 : fds_[leaderId]);
+            if (fds_[i] == -1 && !userOnly_ && (errno == EACCES || errno == EPERM)) {
+                // perf_event_paranoid >= 2 still allows counting user space
+                userOnly_ = true;
+                for (int j = 0; j < i; ++j) {
+                    if (fds_[j] != -1) {
+                        ::close(fds_[j]);
+                        fds_[j] = -1;
+                    }
+                }
+                i = -1;
+                continue;
+            }
+            if (fds_[i] == -1 && hardware) {
+                hardwareErrno = errno;
+            }
+        }
+        if (fds_[PERF_CYCLES] == -1) {
+            missing << "hardware counters unavailable (" << strerror(hardwareErrno);
+            int paranoid = perfEventParanoid();
+            if (paranoid != INT32_MIN) {
+                missing << ", perf_event_paranoid=" << paranoid;
+            }
+            missing << ")";
+        }
+        if (userOnly_) {
+            missing << (missing.tellp() > 0 ? "; " : "") << "counting user space only";
+        }
+        note = missing.str();
+        bool any = false;
+        for (int i = 0; i < PERF_COUNTER_COUNT; ++i) {
+            any = any || fds_[i] != -1;
+        }
+        for (int leader : {PERF_CYCLES, PERF_CONTEXT_SWITCHES}) {
+            if (fds_[leader] != -1) {
+                ioctl(fds_[leader], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+            }
+        }
+        return any;
+    }
+
+    void close() {
+        for (int i = 0; i < PERF_COUNTER_COUNT; ++i) {
+            if (fds_[i] != -1) {
+                ::close(fds_[i]);
+                fds_[i] = -1;
+            }
+        }
+    }
+
+    bool available(int id) const { return fds_[id] != -1; }
+
+    // Current totals of this process and its threads
+    PerfReading read() const {
+        PerfReading reading;
+        for (int i = 0; i < PERF_COUNTER_COUNT; ++i) {
+            uint64_t data[3]; // value, time enabled, time running
+            if (fds_[i] == -1 || ::read(fds_[i], data, sizeof(data)) != sizeof(data)) {
+                continue;
+            }
+            double value = static_cast<double>(data[0]);
+            if (data[2] > 0 && data[2] < data[1]) {
+                value = value * data[1] / data[2];
+            }
+            reading.values[i] = i == PERF_TASK_CLOCK ? value / 1e6 : value;
+        }
+        return reading;
+    }
+
+private:
+    int openCounter(const PerfCounterSpec& spec, int groupFd) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = spec.type;
+        attr.config = spec.config;
+        attr.disabled = groupFd == -1; // leaders start the group
+        attr.inherit = 1;
+        attr.exclude_kernel = userOnly_;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, PERF_FLAG_FD_CLOEXEC));
+    }
+
+    static int perfEventParanoid() {
+        int value = INT32_MIN;
+        FILE* file = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
+        if (file != nullptr) {
+            if (fscanf(file, "%d", &value) != 1) {
+                value = INT32_MIN;
+            }
+            fclose(file);
+        }
+        return value;
+    }
+
+    int fds_[PERF_COUNTER_COUNT];
+    bool userOnly_ = false;
+};
+
+// Counter deltas of one stretch of the run, e.g. setup or a steady phase
+struct PerfPhase {
+    std::string name;
+    PerfReading delta;
+    long messages = 0;
+};
+
+// One column per phase: every available counter, then IPC and cycles per
+// message where the hardware counters exist
+inline void printPerfPhases(std::ostream& out, const PerfCounters& counters, const std::vector<PerfPhase>& phases) {
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(0);
+    text << "Perf counters:" << std::endl << std::setw(18) << "";
+    for (const PerfPhase& phase : phases) {
+        text << std::setw(20) << phase.name;
+    }
+    text << std::endl;
+    for (int i = 0; i < PERF_COUNTER_COUNT; ++i) {
+        if (!counters.available(i)) {
+            continue;
+        }
+        text << std::setw(18) << perfCounterSpec(i).name;
+        for (const PerfPhase& phase : phases) {
+            text << std::setw(20) << phase.delta.values[i];
+        }
+        text << std::endl;
+    }
+    if (counters.available(PERF_CYCLES) && counters.available(PERF_INSTRUCTIONS)) {
+        text << std::setw(18) << "IPC" << std::setprecision(2);
+        for (const PerfPhase& phase : phases) {
+            double cycles = phase.delta.values[PERF_CYCLES];
+            text << std::setw(20) << (cycles > 0 ? phase.delta.values[PERF_INSTRUCTIONS] / cycles : 0.0);
+        }
+        text << std::endl << std::setprecision(0);
+    }
+    if (counters.available(PERF_CYCLES)) {
+        text << std::setw(18) << "cycles/msg";
+        for (const PerfPhase& phase : phases) {
+            if (phase.messages > 0) {
+                text << std::setw(20) << phase.delta.values[PERF_CYCLES] / phase.messages;
+            } else {
+                text << std::setw(20) << "-";
+            }
+        }
+        text << std::endl;
+    }
+    out << text.str() << std::flush;
+}
+
+#endif // PERFCOUNTERS_H
@@ -0,0 +1,225 @@
+#ifndef POLLING_H
+#define POLLING_H
+
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include "config.h"
+
+// Busy-poll socket options, missing from older libc headers
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+#ifndef SO_BUSY_POLL_BUDGET
+#define SO_BUSY_POLL_BUDGET 70
+#endif
+
+// Per-epoll busy-poll parameters (Linux 6.9, <linux/eventpoll.h>)
+struct EpollBusyPollParams {
+    uint32_t busyPollUsecs;
+    uint16_t busyPollBudget;
+    uint8_t preferBusyPoll;
+    uint8_t pad;
+};
+#ifndef EPIOCSPARAMS
+#define EPIOCSPARAMS _IOW(0x8A, 0x01, EpollBusyPollParams)
+#endif
+
+// How an event loop waits for work:
+//  Spin     zero-timeout epoll_wait/recv in a loop, one core per loop at 100%
+//  Block    sleep in epoll_wait/poll until an event arrives
+//  BusyPoll block, but let the kernel poll the device queue first
+//           (SO_BUSY_POLL/SO_PREFER_BUSY_POLL and epoll busy-poll params)
+//  Hybrid   spin while events keep coming, block after spinUs without one
+enum class PollMode {
+    Spin,
+    Block,
+    BusyPoll,
+    Hybrid
+};
+
+struct PollOptions {
+    PollMode mode = PollMode::Spin;
+    int busyPollUs = DEFAULT_BUSY_POLL_US;         // BusyPoll: kernel poll time per wait
+    int busyPollBudget = DEFAULT_BUSY_POLL_BUDGET; // BusyPoll: packets per device poll
+    int spinUs = DEFAULT_SPIN_US;                  // Hybrid: idle spin before blocking
+};
+
+inline bool parsePollMode(const char* name, PollMode& mode) {
+    if (strcmp(name, "spin") == 0) {
+        mode = PollMode::Spin;
+    } else if (strcmp(name, "block") == 0) {
+        mode = PollMode::Block;
+    } else if (strcmp(name, "busy-poll") == 0) {
+        mode = PollMode::BusyPoll;
+    } else if (strcmp(name, "hybrid") == 0) {
+        mode = PollMode::Hybrid;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+inline const char* pollModeName(PollMode mode) {
+    switch (mode) {
+    case PollMode::Spin: return "spin";
+    case PollMode::Block: return "block";
+    case PollMode::BusyPoll: return "busy-poll";
+    case PollMode::Hybrid: return "hybrid";
+    }
+    return "unknown";
+}
+
+// BusyPoll: make blocking waits on this socket poll its device queue.
+// SO_PREFER_BUSY_POLL and SO_BUSY_POLL_BUDGET need CAP_NET_ADMIN.
+inline bool enableSocketBusyPoll(int socket, const PollOptions& options) {
+    int usecs = options.busyPollUs;
+    int prefer = 1;
+    int budget = options.busyPollBudget;
+    return setsockopt(socket, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs)) == 0
+        && setsockopt(socket, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer)) == 0
+        && setsockopt(socket, SOL_SOCKET, SO_BUSY_POLL_BUDGET, &budget, sizeof(budget)) == 0;
+}
+
+// BusyPoll: the same for an epoll instance, so epoll_wait polls the queues
+// of its sockets before sleeping. Fails with ENOTTY before Linux 6.9.
+inline bool enableEpollBusyPoll(int epollFd, const PollOptions& options) {
+    EpollBusyPollParams params;
+    memset(&params, 0, sizeof(params));
+    params.busyPollUsecs = static_cast<uint32_t>(options.busyPollUs);
+    params.busyPollBudget = static_cast<uint16_t>(options.busyPollBudget);
+    params.preferBusyPoll = 1;
+    return ioctl(epollFd, EPIOCSPARAMS, &params) == 0;
+}
+
+struct PollStats {
+    long spinningWaits = 0; // zero-timeout waits
+    long blockingWaits = 0; // waits allowed to sleep
+    long emptyWaits = 0;    // waits that returned nothing
+
+    PollStats& operator+=(const PollStats& other) {
+        spinningWaits += other.spinningWaits;
+        blockingWaits += other.blockingWaits;
+        emptyWaits += other.emptyWaits;
+        return *this;
+    }
+};
+
+// Waits for an event loop according to its PollMode. Callers pass the
+// longest they may sleep (their next timer, report or shutdown check).
+class Poller {
+public:
+    void init(const PollOptions& options) {
+        mode_ = options.mode;
+        spinNs_ = static_cast<uint64_t>(options.spinUs) * 1000;
+        lastEventNs_ = monotonicNs();
+    }
+
+    PollMode mode() const { return mode_; }
+
+    // Whether the next wait may sleep
+    bool shouldBlock() const {
+        switch (mode_) {
+        case PollMode::Spin: return false;
+        case PollMode::Hybrid: return monotonicNs() - lastEventNs_ >= spinNs_;
+        default: return true;
+        }
+    }
+
+    // epoll_wait that sleeps for at most timeoutNs when blocking is allowed
+    int wait(int epollFd, epoll_event* events, int maxEvents, uint64_t timeoutNs) {
+        int count;
+        if (timeoutNs > 0 && shouldBlock()) {
+            stats.blockingWaits++;
+            count = epollWaitNs(epollFd, events, maxEvents, timeoutNs);
+        } else {
+            stats.spinningWaits++;
+            count = epoll_wait(epollFd, events, maxEvents, 0);
+        }
+        return finish(count);
+    }
+
+    // The same for a single socket, for loops that read without epoll.
+    // Call it before every non-blocking read and report the read's outcome
+    // with readDone: when spinning, that read is the poll.
+    int waitReadable(int socket, uint64_t timeoutNs) {
+        if (timeoutNs == 0 || !shouldBlock()) {
+            stats.spinningWaits++;
+            return 1;
+        }
+        stats.blockingWaits++;
+        pollfd pfd;
+        pfd.fd = socket;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        return finish(poll(&pfd, 1, static_cast<int>((timeoutNs + 999999) / 1000000)));
+    }
+
+    void readDone(bool gotData) {
+        if (gotData) {
+            lastEventNs_ = monotonicNs();
+        } else {
+            stats.emptyWaits++;
+        }
+    }
+
+    PollStats stats;
+
+private:
+    static uint64_t monotonicNs() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+    }
+
+    int finish(int count) {
+        if (count > 0) {
+            lastEventNs_ = monotonicNs();
+        } else if (count == 0) {
+            stats.emptyWaits++;
+        }
+        return count;
+    }
+
+    // epoll_pwait2 takes a nanosecond timeout; older kernels get whole
+    // milliseconds, rounded up so a timer is never woken early
+    int epollWaitNs(int epollFd, epoll_event* events, int maxEvents, uint64_t timeoutNs) {
+#ifdef SYS_epoll_pwait2
+        if (pwait2_) {
+            timespec ts;
+            ts.tv_sec = static_cast<time_t>(timeoutNs / 1000000000ULL);
+            ts.tv_nsec = static_cast<long>(timeoutNs % 1000000000ULL);
+            long count = syscall(SYS_epoll_pwait2, epollFd, events, maxEvents, &ts, nullptr, 0);
+            if (count != -1 || errno != ENOSYS) {
+                return static_cast<int>(count);
+            }
+            pwait2_ = false;
+        }
+#endif
+        return epoll_wait(epollFd, events, maxEvents, static_cast<int>((timeoutNs + 999999) / 1000000));
+    }
+
+    PollMode mode_ = PollMode::Spin;
+    uint64_t spinNs_ = 0;
+    uint64_t lastEventNs_ = 0;
+    bool pwait2_ = true;
+};
+
+inline void printPollStats(std::ostream& out, const PollStats& stats) {
+    long waits = stats.spinningWaits + stats.blockingWaits;
+    out << "Waits: " << stats.spinningWaits << " spinning, " << stats.blockingWaits << " blocking, "
+        << (waits > 0 ? 100.0 * stats.emptyWaits / waits : 0.0) << "% empty" << std::endl;
+}
+
+#endif // POLLING_H
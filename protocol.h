@@ -0,0 +1,119 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Every message on the wire is a length-prefixed frame. `length` is the size
+// of the whole frame including this header; `replyLength` is the size of the
+// frame the server must send back. Fields use host byte order since both ends
+// run on the same machine.
+struct FrameHeader {
+    uint32_t length;
+    uint32_t replyLength;
+};
+
+constexpr size_t FRAME_HEADER_SIZE = sizeof(FrameHeader);
+constexpr size_t MAX_FRAME_LIMIT = 16 * 1024 * 1024;
+
+inline FrameHeader readFrameHeader(const unsigned char* data) {
+    FrameHeader header;
+    memcpy(&header, data, sizeof(header));
+    return header;
+}
+
+inline void writeFrameHeader(unsigned char* data, uint32_t length, uint32_t replyLength) {
+    FrameHeader header = {length, replyLength};
+    memcpy(data, &header, sizeof(header));
+}
+
+// In --verify mode every payload starts with this block. The request CRC
+// covers the client-generated bytes after the block; the server transforms
+// those with a keystream seeded from the shared seed and the sequence number
+// (verifySeed) and puts the CRC of the result into the reply block, so the
+// client can check both the transport and the transform.
+struct VerifyBlock {
+    uint64_t sequence;
+    uint32_t crc;
+    uint32_t reserved;
+};
+
+constexpr size_t VERIFY_BLOCK_SIZE = sizeof(VerifyBlock);
+constexpr size_t MIN_VERIFIED_FRAME = FRAME_HEADER_SIZE + VERIFY_BLOCK_SIZE;
+
+inline VerifyBlock readVerifyBlock(const unsigned char* frame) {
+    VerifyBlock block;
+    memcpy(&block, frame + FRAME_HEADER_SIZE, sizeof(block));
+    return block;
+}
+
+inline void writeVerifyBlock(unsigned char* frame, uint64_t sequence, uint32_t crc) {
+    VerifyBlock block = {sequence, crc, 0};
+    memcpy(frame + FRAME_HEADER_SIZE, &block, sizeof(block));
+}
+
+// Keystream seed of the server transform for one verified frame
+inline uint64_t verifySeed(uint64_t sharedSeed, uint64_t sequence) {
+    return sharedSeed ^ (sequence * 0x9e3779b97f4a7c15ULL);
+}
+
+// Over UDP every datagram is exactly one frame, and the first payload bytes
+// carry a sequence number the server echoes untouched, so the client can
+// count lost and reordered datagrams. It is the same field as
+// VerifyBlock::sequence.
+constexpr size_t MIN_DATAGRAM_FRAME = FRAME_HEADER_SIZE + sizeof(uint64_t);
+
+inline uint64_t readDatagramSequence(const unsigned char* frame) {
+    uint64_t sequence;
+    memcpy(&sequence, frame + FRAME_HEADER_SIZE, sizeof(sequence));
+    return sequence;
+}
+
+inline void writeDatagramSequence(unsigned char* frame, uint64_t sequence) {
+    memcpy(frame + FRAME_HEADER_SIZE, &sequence, sizeof(sequence));
+}
+
+// Result of looking for a frame at the start of a receive buffer
+enum class FrameStatus {
+    Incomplete,
+    Complete,
+    Invalid
+};
+
+inline FrameStatus parseFrame(const unsigned char* data, size_t available, size_t maxFrame, FrameHeader& header) {
+    if (available < FRAME_HEADER_SIZE) {
+        return FrameStatus::Incomplete;
+    }
+    header = readFrameHeader(data);
+    if (header.length < FRAME_HEADER_SIZE || header.length > maxFrame
+        || header.replyLength < FRAME_HEADER_SIZE || header.replyLength > maxFrame) {
+        return FrameStatus::Invalid;
+    }
+    return available >= header.length ? FrameStatus::Complete : FrameStatus::Incomplete;
+}
+
+// Run Op<N>::run(args...) when size is one of the common frame sizes, so
+// the default workloads get loops with compile-time trip counts. Returns
+// false for other sizes; the caller then takes its generic path.
+template <template <size_t> class Op, typename... Args>
+inline bool withFixedFrameSize(size_t size, Args... args) {
+    switch (size) {
+    case 16:
+        Op<16>::run(args...);
+        return true;
+    case 64:
+        Op<64>::run(args...);
+        return true;
+    case 1500:
+        Op<1500>::run(args...);
+        return true;
+    case 65536:
+        Op<65536>::run(args...);
+        return true;
+    default:
+        return false;
+    }
+}
+
+#endif // PROTOCOL_H
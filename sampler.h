@@ -0,0 +1,338 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// In-process replacement for watching `mpstat -P ALL 1` next to a run:
+// samples /proc/stat (per-CPU jiffies), /proc/softirqs (per-CPU NET_RX and
+// NET_TX counts) and /proc/self/stat (process user/system jiffies) and
+// relates them to the messages and bytes the process sent.
+
+// Cumulative counters of one CPU
+struct CpuCounters {
+    unsigned long long user = 0;    // user + nice
+    unsigned long long system = 0;
+    unsigned long long softirq = 0;
+    unsigned long long total = 0;   // all states, idle included
+    unsigned long long netRx = 0;   // NET_RX softirqs raised
+    unsigned long long netTx = 0;
+    bool online = false;
+};
+
+struct SystemSnapshot {
+    std::vector<CpuCounters> cpus; // indexed by CPU number
+    unsigned long long processUser = 0;
+    unsigned long long processSystem = 0;
+    uint64_t timeNs = 0;
+    long messages = 0;
+    long bytes = 0;
+};
+
+// Counters of the benchmark itself: messages and bytes sent so far
+typedef std::function<void(long& messages, long& bytes)> ProgressCounter;
+
+inline CpuCounters& cpuSlot(SystemSnapshot& snapshot, int cpu) {
+    if (static_cast<size_t>(cpu) >= snapshot.cpus.size()) {
+        snapshot.cpus.resize(cpu + 1);
+    }
+    return snapshot.cpus[cpu];
+}
+
+// "cpuN user nice system idle iowait irq softirq steal ..." lines
+inline bool readProcStat(SystemSnapshot& snapshot) {
+    FILE* file = fopen("/proc/stat", "r");
+    if (file == nullptr) {
+        return false;
+    }
+    char line[512];
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        // Skip the aggregate "cpu " line and everything that is not a CPU
+        if (strncmp(line, "cpu", 3) != 0 || line[3] < '0' || line[3] > '9') {
+            continue;
+        }
+        int cpu = -1;
+        unsigned long long fields[10] = {0};
+        int count = sscanf(line, "cpu%d %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu", &cpu,
+                           &fields[0], &fields[1], &fields[2], &fields[3], &fields[4],
+                           &fields[5], &fields[6], &fields[7], &fields[8], &fields[9]);
+        if (count < 8 || cpu < 0) {
+            continue;
+        }
+        CpuCounters& counters = cpuSlot(snapshot, cpu);
+        counters.online = true;
+        counters.user = fields[0] + fields[1];
+        counters.system = fields[2];
+        counters.softirq = fields[6];
+        // guest time is already part of user time
+        counters.total = 0;
+        for (int i = 0; i < std::min(count - 1, 8); ++i) {
+            counters.total += fields[i];
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+// A header of "CPUn" columns, then one row per softirq type
+inline bool readProcSoftirqs(SystemSnapshot& snapshot) {
+    FILE* file = fopen("/proc/softirqs", "r");
+    if (file == nullptr) {
+        return false;
+    }
+    std::vector<int> columns;
+    char buffer[4096];
+    bool header = true;
+    while (fgets(buffer, sizeof(buffer), file) != nullptr) {
+        std::istringstream in(buffer);
+        std::string token;
+        if (header) {
+            while (in >> token) {
+                columns.push_back(atoi(token.c_str() + 3)); // "CPU12"
+            }
+            header = false;
+            continue;
+        }
+        in >> token;
+        bool rx = token == "NET_RX:";
+        if (!rx && token != "NET_TX:") {
+            continue;
+        }
+        unsigned long long value = 0;
+        for (size_t i = 0; i < columns.size() && in >> value; ++i) {
+            CpuCounters& counters = cpuSlot(snapshot, columns[i]);
+            (rx ? counters.netRx : counters.netTx) = value;
+        }
+    }
+    fclose(file);
+    return !columns.empty();
+}
+
+// utime and stime are fields 14 and 15; the command name before them is
+// parenthesized and may contain spaces
+inline bool readProcSelfStat(SystemSnapshot& snapshot) {
+    FILE* file = fopen("/proc/self/stat", "r");
+    if (file == nullptr) {
+        return false;
+    }
+    char buffer[1024];
+    size_t length = fread(buffer, 1, sizeof(buffer) - 1, file);
+    fclose(file);
+    buffer[length] = '\0';
+    const char* fields = strrchr(buffer, ')');
+    return fields != nullptr
+        && sscanf(fields + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+                  &snapshot.processUser, &snapshot.processSystem) == 2;
+}
+
+inline bool readSystemSnapshot(SystemSnapshot& snapshot) {
+    snapshot.timeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    bool ok = readProcStat(snapshot);
+    ok = readProcSoftirqs(snapshot) && ok;
+    return readProcSelfStat(snapshot) && ok;
+}
+
+// Difference between two snapshots over a set of CPUs
+struct SoftirqDelta {
+    double seconds = 0;
+    long messages = 0;
+    long bytes = 0;
+    unsigned long long user = 0;
+    unsigned long long system = 0;
+    unsigned long long softirq = 0;
+    unsigned long long total = 0;
+    unsigned long long netRx = 0;
+    unsigned long long netTx = 0;
+    unsigned long long processUser = 0;
+    unsigned long long processSystem = 0;
+
+    double percent(unsigned long long jiffies) const {
+        return total > 0 ? 100.0 * jiffies / total : 0;
+    }
+};
+
+inline SoftirqDelta softirqDelta(const SystemSnapshot& from, const SystemSnapshot& to, const std::vector<int>& cpus) {
+    SoftirqDelta delta;
+    delta.seconds = (to.timeNs - from.timeNs) / 1e9;
+    delta.messages = to.messages - from.messages;
+    delta.bytes = to.bytes - from.bytes;
+    delta.processUser = to.processUser - from.processUser;
+    delta.processSystem = to.processSystem - from.processSystem;
+    size_t count = std::min(from.cpus.size(), to.cpus.size());
+    for (size_t cpu = 0; cpu < count; ++cpu) {
+        if (!cpus.empty() && std::find(cpus.begin(), cpus.end(), static_cast<int>(cpu)) == cpus.end()) {
+            continue;
+        }
+        const CpuCounters& a = from.cpus[cpu];
+        const CpuCounters& b = to.cpus[cpu];
+        delta.user += b.user - a.user;
+        delta.system += b.system - a.system;
+        delta.softirq += b.softirq - a.softirq;
+        delta.total += b.total - a.total;
+        delta.netRx += b.netRx - a.netRx;
+        delta.netTx += b.netTx - a.netTx;
+    }
+    return delta;
+}
+
+// Samples the counters on its own thread every intervalSeconds and prints
+// one line per interval; start and stop bracket the summary
+class SoftirqSampler {
+public:
+    ~SoftirqSampler() { stop(); }
+
+    // cpus restricts the figures to those CPUs (empty = all). Returns false
+    // if /proc could not be read, in which case nothing is reported.
+    bool start(int intervalSeconds, const std::vector<int>& cpus, ProgressCounter progress) {
+        cpus_ = cpus;
+        progress_ = progress;
+        ticks_ = sysconf(_SC_CLK_TCK);
+        first_ = SystemSnapshot();
+        if (ticks_ <= 0 || !takeSnapshot(first_)) {
+            return false;
+        }
+        last_ = first_;
+        running_ = true;
+        stopping_ = false;
+        if (intervalSeconds > 0) {
+            interval_ = intervalSeconds;
+            thread_ = std::thread(&SoftirqSampler::run, this);
+        }
+        return true;
+    }
+
+    void stop() {
+        if (!running_) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+        takeSnapshot(last_);
+        running_ = false;
+    }
+
+    // Per-CPU table and normalized totals between start and stop
+    void printSummary(std::ostream& out) const {
+        SoftirqDelta all = softirqDelta(first_, last_, cpus_);
+        std::ostringstream text;
+        text << std::fixed << std::setprecision(1);
+        text << "Softirq summary (" << all.seconds << " s, " << all.messages << " messages, "
+             << all.bytes / 1024 << " KB sent):" << std::endl;
+        text << std::setw(6) << "cpu" << std::setw(8) << "usr %" << std::setw(8) << "sys %"
+             << std::setw(8) << "soft %" << std::setw(12) << "NET_RX/s" << std::setw(12) << "NET_TX/s" << std::endl;
+        size_t count = std::min(first_.cpus.size(), last_.cpus.size());
+        for (size_t cpu = 0; cpu < count; ++cpu) {
+            if (!last_.cpus[cpu].online
+                || (!cpus_.empty() && std::find(cpus_.begin(), cpus_.end(), static_cast<int>(cpu)) == cpus_.end())) {
+                continue;
+            }
+            printRow(text, std::to_string(cpu), softirqDelta(first_, last_, std::vector<int>(1, static_cast<int>(cpu))));
+        }
+        printRow(text, "all", all);
+        double jiffyNs = 1e9 / ticks_;
+        double kb = all.bytes / 1024.0;
+        text << std::setprecision(2)
+             << "Per message: " << perUnit(all.netRx, all.messages) << " NET_RX, "
+             << perUnit(all.netTx, all.messages) << " NET_TX, "
+             << std::setprecision(0) << perUnit(all.softirq * jiffyNs, all.messages) << " ns softirq, "
+             << perUnit((all.processUser + all.processSystem) * jiffyNs, all.messages) << " ns process CPU"
+             << std::endl;
+        text << std::setprecision(2)
+             << "Per KB sent: " << perUnit(all.netRx, kb) << " NET_RX, " << perUnit(all.netTx, kb) << " NET_TX, "
+             << std::setprecision(0) << perUnit(all.softirq * jiffyNs, kb) << " ns softirq" << std::endl;
+        text << std::setprecision(1) << "Process: " << processPercent(all.processUser, all) << "% usr, "
+             << processPercent(all.processSystem, all) << "% sys of one CPU" << std::endl;
+        out << text.str() << std::flush;
+    }
+
+private:
+    static double perUnit(double value, double units) {
+        return units > 0 ? value / units : 0;
+    }
+
+    double processPercent(unsigned long long jiffies, const SoftirqDelta& delta) const {
+        return delta.seconds > 0 ? 100.0 * jiffies / ticks_ / delta.seconds : 0;
+    }
+
+    static void printRow(std::ostream& out, const std::string& label, const SoftirqDelta& delta) {
+        out << std::setw(6) << label << std::setw(8) << delta.percent(delta.user)
+            << std::setw(8) << delta.percent(delta.system) << std::setw(8) << delta.percent(delta.softirq)
+            << std::setw(12) << static_cast<long>(perUnit(delta.netRx, delta.seconds))
+            << std::setw(12) << static_cast<long>(perUnit(delta.netTx, delta.seconds)) << std::endl;
+    }
+
+    bool takeSnapshot(SystemSnapshot& snapshot) {
+        if (progress_) {
+            progress_(snapshot.messages, snapshot.bytes);
+        }
+        return readSystemSnapshot(snapshot);
+    }
+
+    void run() {
+        auto next = std::chrono::steady_clock::now();
+        int elapsed = 0;
+        SystemSnapshot previous = first_;
+        while (true) {
+            next += std::chrono::seconds(interval_);
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                if (wake_.wait_until(lock, next, [this] { return stopping_; })) {
+                    return;
+                }
+            }
+            elapsed += interval_;
+            SystemSnapshot current;
+            if (!takeSnapshot(current)) {
+                continue;
+            }
+            SoftirqDelta delta = softirqDelta(previous, current, cpus_);
+            double jiffyNs = 1e9 / ticks_;
+            // One write per line, so lines from other threads do not interleave
+            std::ostringstream line;
+            line << std::fixed << std::setprecision(1) << "[softirq " << elapsed << "s] usr "
+                 << delta.percent(delta.user) << "% sys " << delta.percent(delta.system) << "% soft "
+                 << delta.percent(delta.softirq) << "%, NET_RX " << static_cast<long>(perUnit(delta.netRx, delta.seconds))
+                 << "/s NET_TX " << static_cast<long>(perUnit(delta.netTx, delta.seconds)) << "/s"
+                 << std::setprecision(2) << ", per message " << perUnit(delta.netRx, delta.messages) << " NET_RX "
+                 << perUnit(delta.netTx, delta.messages) << " NET_TX " << std::setprecision(0)
+                 << perUnit(delta.softirq * jiffyNs, delta.messages) << " ns softirq" << std::endl;
+            std::cout << line.str() << std::flush;
+            previous = current;
+        }
+    }
+
+    std::vector<int> cpus_;
+    ProgressCounter progress_;
+    long ticks_ = 100;
+    int interval_ = 0;
+    SystemSnapshot first_;
+    SystemSnapshot last_;
+    bool running_ = false;
+    bool stopping_ = false;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+};
+
+#endif // SAMPLER_H
@@ -5,26 +5,37 @@
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <csignal>
 #include <vector>
-#include <map>
 #include <cstdlib>
+#include <climits>
 #include <ctime>
+#include <random>
+#include <thread>
+#include <algorithm>
+#include <chrono>
 #include <netinet/tcp.h>
-#include "config.h"
+#include "server.h"
+#include "cli.h"
+#include "affinity.h"
+#include "crc32c.h"
+#include "udp.h"
+#include "cputime.h"
+#include "sampler.h"
+#include "perfcounters.h"
+#include "memstat.h"
 
-// Constants for epoll
-constexpr int MAX_EVENTS = 64;
-constexpr int EPOLL_TIMEOUT_MS = 0; // Zero timeout for busy polling
+// How often the main thread copies reactor counters into the stats segment
+constexpr int PUBLISH_PERIOD_MS = 100;
 
-// Global flag for termination
-volatile sig_atomic_t g_running = 1;
+std::atomic<bool> g_running(true);
 
 // Signal handler for SIGINT
 void signalHandler(int signal) {
     if (signal == SIGINT) {
         std::cout << "\nReceived SIGINT. Shutting down server..." << std::endl;
-        g_running = 0;
+        g_running = false;
     }
 }
 
@@ -54,36 +65,269 @@ bool setTcpNoDelay(int socket) {
     return true;
 }
 
-// Structure to maintain client data
-struct ClientData {
-    std::vector<unsigned char> buffer;
-    size_t bytesReceived;
-    size_t bytesSent;
-    bool receivingData;
-    
-    ClientData() : buffer(BUFFER_SIZE), bytesReceived(0), bytesSent(0), receivingData(true) {}
-};
+void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [--threads N] [--cpus LIST] [--engine epoll|uring] [--sqpoll] [--batch]\n"
+              << "       [--host IP] [--port N] [--max-frame N] [--verify SEED] [--keystream KERNEL]\n"
+              << "       [--udp] [--mmsg-batch N] [--gso] [--gro] [--zerocopy] [--zerocopy-buffers N]\n"
+              << "       [--poll MODE] [--busy-poll-us N] [--busy-poll-budget N] [--spin-us N]\n"
+              << "       [--interval S] [--softirq-cpus LIST] [--perf-counters] [--stats-shm NAME]\n"
+              << "       [--steer off|listener|handoff] [--locality] [--trace FILE] [--trace-records N]\n"
+              << "       [--relay HOST:PORT] [--relay-mode splice|copy] [--max-events N] [--max-connections N]\n"
+              << "  --threads N            number of reactor threads, each with its own SO_REUSEPORT listener (default: 1)\n"
+              << "  --cpus LIST            pin reactor i to the i-th CPU of LIST, e.g. 0,2,4-7 (default: no pinning)\n"
+              << "  --engine epoll|uring   event loop implementation; uring falls back to epoll if unsupported (default: epoll)\n"
+              << "  --sqpoll               use a kernel SQ polling thread with the uring engine\n"
+              << "  --batch                epoll engine: answer every complete message right away and arm\n"
+              << "                         EPOLLOUT only on EAGAIN instead of toggling it per message\n"
+              << "  --host IP              address to listen on (default: " << DEFAULT_SERVER_IP << ")\n"
+              << "  --port N               port to listen on (default: " << DEFAULT_SERVER_PORT << ")\n"
+              << "  --max-frame N          largest request or reply frame accepted, in bytes (default: "
+              << DEFAULT_MAX_FRAME_SIZE << ")\n"
+              << "  --verify SEED          check request CRCs and transform payloads with a keystream derived from\n"
+              << "                         SEED, so a client started with the same --verify SEED can check every reply\n"
+              << "  --keystream KERNEL     payload transform kernel: auto, avx2, sse2 or scalar (default: auto)\n"
+              << "  --udp                  answer UDP datagrams (one frame each) instead of TCP connections;\n"
+              << "                         --engine and --batch do not apply\n"
+              << "  --mmsg-batch N         UDP: datagrams per recvmmsg/sendmmsg call (default: " << DEFAULT_MMSG_BATCH << ")\n"
+              << "  --gso                  UDP: send equal-size replies to a peer as one UDP_SEGMENT super-packet\n"
+              << "  --gro                  UDP: enable UDP_GRO and split received super-packets\n"
+              << "  --zerocopy             epoll engine: send replies with MSG_ZEROCOPY from a pool of locked buffers,\n"
+              << "                         falling back to copying per connection when the kernel copies anyway\n"
+              << "  --zerocopy-buffers N   zero-copy reply buffers per reactor (default: " << DEFAULT_ZEROCOPY_BUFFERS << ")\n"
+              << "  --poll MODE            how epoll and UDP reactors wait: spin (zero-timeout polling), block,\n"
+              << "                         busy-poll (block with SO_BUSY_POLL and epoll busy-poll params) or\n"
+              << "                         hybrid (spin, then block once idle for --spin-us) (default: spin)\n"
+              << "  --busy-poll-us N       busy-poll: microseconds the kernel polls per wait (default: "
+              << DEFAULT_BUSY_POLL_US << ")\n"
+              << "  --busy-poll-budget N   busy-poll: packets per device queue poll (default: " << DEFAULT_BUSY_POLL_BUDGET << ")\n"
+              << "  --spin-us N            hybrid: microseconds to keep spinning after the last event (default: "
+              << DEFAULT_SPIN_US << ")\n"
+              << "  --interval S           print msgs/s, bytes/s, active connections, accepts/s and softirq figures\n"
+              << "                         every S seconds, 0 = only at exit (default: 0)\n"
+              << "  --softirq-cpus LIST    CPUs the softirq figures cover, e.g. 0,2 (default: all)\n"
+              << "  --perf-counters        count cycles, instructions, cache misses, context switches, page faults\n"
+              << "                         and task clock with perf_event_open for setup, serving and shutdown\n"
+              << "  --stats-shm NAME       publish live per-reactor and per-connection counters in the POSIX shared\n"
+              << "                         memory segment NAME (e.g. /softirq-server), read with server_stats\n"
+              << "  --steer MODE           TCP, needs --cpus: place connections on the reactor pinned to the CPU that\n"
+              << "                         runs their softirq. listener sets SO_INCOMING_CPU on each listener, handoff\n"
+              << "                         also passes mis-accepted sockets to the right epoll reactor (default: off)\n"
+              << "  --locality             sample SO_INCOMING_CPU every " << LOCALITY_SAMPLE_INTERVAL
+              << " messages and report how many were\n"
+              << "                         processed on the CPU that ran their softirq\n"
+              << "  --trace FILE           epoll engine: record wakeups, recv/send, EAGAIN, accepts, closes and state\n"
+              << "                         changes per reactor in the memory-mapped FILE, read with trace_convert\n"
+              << "  --trace-records N      --trace: latest events kept per reactor (default: " << DEFAULT_TRACE_RECORDS
+              << ")\n"
+              << "  --relay HOST:PORT      epoll engine: instead of answering, forward every connection to the server\n"
+              << "                         at HOST:PORT (e.g. a second server on another port) and relay both ways\n"
+              << "  --relay-mode MODE      splice: move bytes socket to pipe to socket with splice(); copy: recv and\n"
+              << "                         send through the connection buffer (default: splice)\n"
+              << "  --max-events N         epoll engine: events returned per epoll_wait (default: " << DEFAULT_MAX_EVENTS
+              << ")\n"
+              << "  --max-connections N    raise the open file limit (up to the hard limit) to hold N connections;\n"
+              << "                         the connection tables are sized by it (default: keep the current limit)\n";
+}
 
-int main() {
-    // Initialize random number generator
-    std::srand(static_cast<unsigned int>(std::time(nullptr)));
-    
-    // Set up signal handling for SIGINT
-    struct sigaction sa;
-    sa.sa_handler = signalHandler;
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = 0;
-    
-    if (sigaction(SIGINT, &sa, nullptr) == -1) {
-        std::cerr << "Failed to set up signal handler: " << strerror(errno) << std::endl;
-        return 1;
+bool parseOptions(int argc, char* argv[], ServerOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        long value = 0;
+        if (arg == "--threads") {
+            if (!parseIntOption("--threads", optionValue(argc, argv, i), 1, 1024, value)) {
+                return false;
+            }
+            options.threads = static_cast<int>(value);
+        } else if (arg == "--cpus") {
+            const char* list = optionValue(argc, argv, i);
+            if (list == nullptr || !parseCpuList(list, options.cpus)) {
+                std::cerr << "Invalid CPU list for --cpus" << std::endl;
+                return false;
+            }
+        } else if (arg == "--engine") {
+            const char* engine = optionValue(argc, argv, i);
+            if (engine == nullptr) {
+                return false;
+            }
+            if (std::string(engine) == "epoll") {
+                options.engine = Engine::Epoll;
+            } else if (std::string(engine) == "uring") {
+                options.engine = Engine::Uring;
+            } else {
+                std::cerr << "Unknown engine: " << engine << std::endl;
+                return false;
+            }
+        } else if (arg == "--sqpoll") {
+            options.sqpoll = true;
+        } else if (arg == "--batch") {
+            options.batch = true;
+        } else if (arg == "--host") {
+            const char* host = optionValue(argc, argv, i);
+            if (host == nullptr) {
+                return false;
+            }
+            options.host = host;
+        } else if (arg == "--port") {
+            if (!parseIntOption("--port", optionValue(argc, argv, i), 1, 65535, value)) {
+                return false;
+            }
+            options.port = static_cast<int>(value);
+        } else if (arg == "--max-frame") {
+            if (!parseIntOption("--max-frame", optionValue(argc, argv, i), FRAME_HEADER_SIZE, MAX_FRAME_LIMIT, value)) {
+                return false;
+            }
+            options.maxFrame = static_cast<size_t>(value);
+        } else if (arg == "--verify") {
+            if (!parseIntOption("--verify", optionValue(argc, argv, i), 0, LONG_MAX, value)) {
+                return false;
+            }
+            options.verify = true;
+            options.verifySeed = static_cast<uint64_t>(value);
+        } else if (arg == "--keystream") {
+            const char* kernel = optionValue(argc, argv, i);
+            if (kernel == nullptr || !selectKeystreamKernel(kernel)) {
+                std::cerr << "Unknown or unsupported keystream kernel for --keystream" << std::endl;
+                return false;
+            }
+        } else if (arg == "--udp") {
+            options.transport = Transport::Udp;
+        } else if (arg == "--mmsg-batch") {
+            if (!parseIntOption("--mmsg-batch", optionValue(argc, argv, i), 1, 1024, value)) {
+                return false;
+            }
+            options.mmsgBatch = static_cast<int>(value);
+        } else if (arg == "--gso") {
+            options.gso = true;
+        } else if (arg == "--gro") {
+            options.gro = true;
+        } else if (arg == "--zerocopy") {
+            options.zerocopy = true;
+        } else if (arg == "--zerocopy-buffers") {
+            if (!parseIntOption("--zerocopy-buffers", optionValue(argc, argv, i), 1, 1000000, value)) {
+                return false;
+            }
+            options.zerocopyBuffers = static_cast<int>(value);
+        } else if (arg == "--poll") {
+            const char* mode = optionValue(argc, argv, i);
+            if (mode == nullptr || !parsePollMode(mode, options.poll.mode)) {
+                std::cerr << "Unknown polling mode for --poll" << std::endl;
+                return false;
+            }
+        } else if (arg == "--busy-poll-us") {
+            if (!parseIntOption("--busy-poll-us", optionValue(argc, argv, i), 0, 1000000, value)) {
+                return false;
+            }
+            options.poll.busyPollUs = static_cast<int>(value);
+        } else if (arg == "--busy-poll-budget") {
+            if (!parseIntOption("--busy-poll-budget", optionValue(argc, argv, i), 1, 65535, value)) {
+                return false;
+            }
+            options.poll.busyPollBudget = static_cast<int>(value);
+        } else if (arg == "--spin-us") {
+            if (!parseIntOption("--spin-us", optionValue(argc, argv, i), 0, 10000000, value)) {
+                return false;
+            }
+            options.poll.spinUs = static_cast<int>(value);
+        } else if (arg == "--interval") {
+            if (!parseIntOption("--interval", optionValue(argc, argv, i), 0, 3600, value)) {
+                return false;
+            }
+            options.interval = static_cast<int>(value);
+        } else if (arg == "--stats-shm") {
+            const char* name = optionValue(argc, argv, i);
+            if (name == nullptr) {
+                return false;
+            }
+            options.statsShm = name;
+        } else if (arg == "--steer") {
+            const char* mode = optionValue(argc, argv, i);
+            if (mode == nullptr) {
+                return false;
+            }
+            if (std::string(mode) == "off") {
+                options.steer = SteerMode::Off;
+            } else if (std::string(mode) == "listener") {
+                options.steer = SteerMode::Listener;
+            } else if (std::string(mode) == "handoff") {
+                options.steer = SteerMode::Handoff;
+            } else {
+                std::cerr << "Unknown steering mode: " << mode << std::endl;
+                return false;
+            }
+        } else if (arg == "--locality") {
+            options.locality = true;
+        } else if (arg == "--trace") {
+            const char* path = optionValue(argc, argv, i);
+            if (path == nullptr) {
+                return false;
+            }
+            options.traceFile = path;
+        } else if (arg == "--relay") {
+            const char* target = optionValue(argc, argv, i);
+            if (target == nullptr) {
+                return false;
+            }
+            options.relay = target;
+        } else if (arg == "--relay-mode") {
+            const char* mode = optionValue(argc, argv, i);
+            if (mode == nullptr) {
+                return false;
+            }
+            if (std::string(mode) == "splice") {
+                options.relayMode = RelayMode::Splice;
+            } else if (std::string(mode) == "copy") {
+                options.relayMode = RelayMode::Copy;
+            } else {
+                std::cerr << "Unknown relay mode: " << mode << std::endl;
+                return false;
+            }
+        } else if (arg == "--trace-records") {
+            if (!parseIntOption("--trace-records", optionValue(argc, argv, i), static_cast<long>(MIN_TRACE_RECORDS),
+                                static_cast<long>(MAX_TRACE_RECORDS), options.traceRecords)) {
+                return false;
+            }
+        } else if (arg == "--max-events") {
+            if (!parseIntOption("--max-events", optionValue(argc, argv, i), 1, 65536, value)) {
+                return false;
+            }
+            options.maxEvents = static_cast<int>(value);
+        } else if (arg == "--max-connections") {
+            if (!parseIntOption("--max-connections", optionValue(argc, argv, i), 1,
+                                static_cast<long>(ConnectionTable<ClientData>::MAX_SLOTS_LIMIT),
+                                options.maxConnections)) {
+                return false;
+            }
+        } else if (arg == "--perf-counters") {
+            options.perfCounters = true;
+        } else if (arg == "--softirq-cpus") {
+            const char* list = optionValue(argc, argv, i);
+            if (list == nullptr || !parseCpuList(list, options.softirqCpus)) {
+                std::cerr << "Invalid CPU list for --softirq-cpus" << std::endl;
+                return false;
+            }
+        } else if (arg == "--help" || arg == "-h") {
+            printUsage(argv[0]);
+            std::exit(0);
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            printUsage(argv[0]);
+            return false;
+        }
     }
-    
-    // Create listening socket
+    if (options.transport == Transport::Udp && options.maxFrame > MAX_DATAGRAM_SIZE) {
+        // A frame has to fit in one datagram
+        options.maxFrame = MAX_DATAGRAM_SIZE;
+    }
+    return true;
+}
+
+// Create a bound, listening, non-blocking socket. With reusePort every reactor
+// gets its own listener on the same port and the kernel spreads connections.
+int createListenSocket(const ServerOptions& options, bool reusePort) {
     int serverSocket = socket(AF_INET, SOCK_STREAM, 0);
     if (serverSocket == -1) {
         std::cerr << "Failed to create socket: " << strerror(errno) << std::endl;
-        return 1;
+        return -1;
     }
     
     // Set socket option to reuse address
@@ -91,79 +335,780 @@ int main() {
     if (setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) == -1) {
         std::cerr << "Failed to set SO_REUSEADDR: " << strerror(errno) << std::endl;
         close(serverSocket);
-        return 1;
+        return -1;
     }
     
-    // Set listening socket to non-blocking mode
-    if (!setNonBlocking(serverSocket)) {
+    if (reusePort && setsockopt(serverSocket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) == -1) {
+        std::cerr << "Failed to set SO_REUSEPORT: " << strerror(errno) << std::endl;
         close(serverSocket);
-        return 1;
+        return -1;
+    }
+    
+    // Set listening socket to non-blocking mode; accepted sockets inherit
+    // TCP_NODELAY from it, which saves a setsockopt per connection
+    if (!setNonBlocking(serverSocket) || !setTcpNoDelay(serverSocket)) {
+        close(serverSocket);
+        return -1;
     }
     
     // Prepare server address
     struct sockaddr_in serverAddr;
+    memset(&serverAddr, 0, sizeof(serverAddr));
     serverAddr.sin_family = AF_INET;
-    serverAddr.sin_port = htons(SERVER_PORT);
+    serverAddr.sin_port = htons(options.port);
     
-    if (inet_pton(AF_INET, SERVER_IP, &serverAddr.sin_addr) <= 0) {
+    if (inet_pton(AF_INET, options.host.c_str(), &serverAddr.sin_addr) <= 0) {
         std::cerr << "Invalid address / Address not supported: " << strerror(errno) << std::endl;
         close(serverSocket);
-        return 1;
+        return -1;
     }
     
     // Bind socket to address
     if (bind(serverSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) == -1) {
         std::cerr << "Failed to bind socket: " << strerror(errno) << std::endl;
         close(serverSocket);
-        return 1;
+        return -1;
     }
     
     // Listen for incoming connections
     if (listen(serverSocket, SOMAXCONN) == -1) {
         std::cerr << "Failed to listen on socket: " << strerror(errno) << std::endl;
         close(serverSocket);
-        return 1;
+        return -1;
     }
     
-    std::cout << "Server listening on " << SERVER_IP << ":" << SERVER_PORT << std::endl;
+    return serverSocket;
+}
+
+// Create the reactor's epoll instance and connection table and register the listener
+bool setupEpoll(Reactor& reactor) {
+    if (!reactor.clients.init(2 * reactor.bufferCapacity)) {
+        std::cerr << "Failed to reserve connection table: " << strerror(errno) << std::endl;
+        return false;
+    }
     
     // Create epoll instance
-    int epollFd = epoll_create1(0);
-    if (epollFd == -1) {
+    reactor.epollFd = epoll_create1(0);
+    if (reactor.epollFd == -1) {
         std::cerr << "Failed to create epoll instance: " << strerror(errno) << std::endl;
-        close(serverSocket);
-        return 1;
+        return false;
     }
     
     // Add listening socket to epoll
     struct epoll_event ev;
     ev.events = EPOLLIN;
-    ev.data.fd = serverSocket;
+    ev.data.fd = reactor.listenSocket;
     
-    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, serverSocket, &ev) == -1) {
+    if (epoll_ctl(reactor.epollFd, EPOLL_CTL_ADD, reactor.listenSocket, &ev) == -1) {
         std::cerr << "Failed to add listening socket to epoll: " << strerror(errno) << std::endl;
-        close(serverSocket);
-        close(epollFd);
-        return 1;
+        return false;
+    }
+    
+    // Handoff steering: other reactors queue sockets and signal the eventfd
+    if (reactor.steer == SteerMode::Handoff) {
+        reactor.inbox.eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (reactor.inbox.eventFd == -1) {
+            std::cerr << "Failed to create handoff eventfd: " << strerror(errno) << std::endl;
+            return false;
+        }
+        ev.events = EPOLLIN;
+        ev.data.fd = reactor.inbox.eventFd;
+        if (epoll_ctl(reactor.epollFd, EPOLL_CTL_ADD, reactor.inbox.eventFd, &ev) == -1) {
+            std::cerr << "Failed to add handoff eventfd to epoll: " << strerror(errno) << std::endl;
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+// Create the reactor's listener and, for the epoll engine, its epoll instance
+// and connection table
+bool setupReactor(Reactor& reactor, bool reusePort, const ServerOptions& options) {
+    if (options.transport == Transport::Udp) {
+        return setupUdpReactor(reactor, reusePort, options);
+    }
+    reactor.listenSocket = createListenSocket(options, reusePort);
+    if (reactor.listenSocket == -1) {
+        return false;
+    }
+    // The SO_REUSEPORT group prefers the listener whose SO_INCOMING_CPU is
+    // the CPU processing the SYN (Linux 6.1); older kernels ignore it
+    if (reactor.steer != SteerMode::Off && !setIncomingCpu(reactor.listenSocket, reactor.cpu)) {
+        std::cerr << "Warning: SO_INCOMING_CPU on listener failed: " << strerror(errno) << std::endl;
+    }
+    return options.engine != Engine::Epoll || setupEpoll(reactor);
+}
+
+// Busy-poll mode: socket options on the listener, which accepted sockets
+// inherit, and epoll busy-poll params where the kernel has them. Either one
+// failing only costs the kernel-side polling, so it is not fatal.
+void enableBusyPoll(Reactor& reactor, const PollOptions& poll, bool report) {
+    if (!enableSocketBusyPoll(reactor.listenSocket, poll) && report) {
+        std::cerr << "Warning: SO_BUSY_POLL/SO_PREFER_BUSY_POLL failed (" << strerror(errno)
+                  << "), the budget and prefer options need CAP_NET_ADMIN" << std::endl;
+    }
+    if (reactor.epollFd != -1 && !enableEpollBusyPoll(reactor.epollFd, poll) && report) {
+        std::cerr << "Warning: epoll busy-poll params unavailable (" << strerror(errno)
+                  << "), needs Linux 6.9; relying on SO_BUSY_POLL" << std::endl;
+    }
+}
+
+// The reply buffer in the fd's table slot, used whenever a connection does
+// not send from the zero-copy pool
+unsigned char* slotReply(Reactor& reactor, int clientSocket) {
+    return reactor.clients.buffer(clientSocket) + reactor.bufferCapacity;
+}
+
+// Remove a socket from epoll and the connection table and close it
+void releaseSocket(Reactor& reactor, int socket) {
+    epoll_ctl(reactor.epollFd, EPOLL_CTL_DEL, socket, nullptr);
+    countStat(reactor.stats.epollCtlCalls);
+    ClientData* client = reactor.clients.find(socket);
+    if (client != nullptr) {
+        reactor.zeroCopy.release(client->zeroCopy, socket);
+        closeSharedConnection(client->shared);
+        if (client->pipeRead != -1) {
+            close(client->pipeRead);
+            close(client->pipeWrite);
+        }
+    }
+    reactor.trace.record(TraceEvent::Close, socket, 0);
+    close(socket);
+    reactor.clients.release(socket);
+}
+
+// Remove a client from epoll and the connection table
+void closeClient(Reactor& reactor, int clientSocket) {
+    releaseSocket(reactor, clientSocket);
+    countStat(reactor.stats.activeConnections, -1);
+}
+
+void printTableFootprint(const char* engine, size_t bytesPerConnection, size_t stateBytes,
+                         size_t bufferBytes, size_t capacity) {
+    std::cout << "Connection table (" << engine << "): " << bytesPerConnection << " bytes per connection ("
+              << stateBytes << " state + " << bufferBytes << " buffers), up to " << capacity
+              << " connections per reactor" << std::endl;
+}
+
+void transformPayload(Keystream& keystream, unsigned char* data, size_t size) {
+    // XOR the payload with the reactor's keystream
+    keystreamXor(keystream, data, size);
+}
+
+// Echo fast path for the common sizes when the reply matches the request
+template <size_t N>
+struct EchoFixed {
+    static void run(Keystream* keystream, const unsigned char* request, unsigned char* reply) {
+        if (reply != request) {
+            memcpy(reply, request, N);
+        }
+        transformPayload(*keystream, reply + FRAME_HEADER_SIZE, N - FRAME_HEADER_SIZE);
+    }
+};
+
+// --verify: check the request CRC, transform with the keystream derived from
+// the shared seed and the sequence number, and sign the reply with its CRC
+size_t buildVerifiedReply(Reactor& reactor, const unsigned char* request, const FrameHeader& header,
+                          unsigned char* reply) {
+    VerifyBlock block = readVerifyBlock(request);
+    size_t requestData = header.length - MIN_VERIFIED_FRAME;
+    size_t replyData = header.replyLength - MIN_VERIFIED_FRAME;
+    if (crc32c(request + MIN_VERIFIED_FRAME, requestData) != block.crc) {
+        countStat(reactor.stats.corruptFrames);
+    }
+    size_t common = std::min(requestData, replyData);
+    memmove(reply + MIN_VERIFIED_FRAME, request + MIN_VERIFIED_FRAME, common);
+    memset(reply + MIN_VERIFIED_FRAME + common, 0, replyData - common);
+    Keystream keystream = seededKeystream(verifySeed(reactor.verifySeed, block.sequence));
+    keystreamXor(keystream, reply + MIN_VERIFIED_FRAME, replyData);
+    writeFrameHeader(reply, header.replyLength, header.length);
+    writeVerifyBlock(reply, block.sequence, crc32c(reply + MIN_VERIFIED_FRAME, replyData));
+    return header.replyLength;
+}
+
+size_t buildReply(Reactor& reactor, const unsigned char* request, const FrameHeader& header, unsigned char* reply) {
+    if (reactor.verify && header.length >= MIN_VERIFIED_FRAME && header.replyLength >= MIN_VERIFIED_FRAME) {
+        return buildVerifiedReply(reactor, request, header, reply);
+    }
+    if (header.length == header.replyLength
+        && withFixedFrameSize<EchoFixed>(header.length, &reactor.keystream, request, reply)) {
+        return header.length;
+    }
+    size_t payload = std::min(header.length, header.replyLength) - FRAME_HEADER_SIZE;
+    memmove(reply + FRAME_HEADER_SIZE, request + FRAME_HEADER_SIZE, payload);
+    memset(reply + FRAME_HEADER_SIZE + payload, 0, header.replyLength - FRAME_HEADER_SIZE - payload);
+    writeFrameHeader(reply, header.replyLength, header.length);
+    transformPayload(reactor.keystream, reply + FRAME_HEADER_SIZE, header.replyLength - FRAME_HEADER_SIZE);
+    return header.replyLength;
+}
+
+// Relay mode: point a table slot at its peer and, for splicing, give it the
+// pipe its bytes pass through on the way to the peer
+bool openRelaySlot(Reactor& reactor, int socket, int peer, bool upstream, ClientData*& slot) {
+    slot = reactor.clients.open(socket);
+    if (slot == nullptr) {
+        std::cerr << "Connection table full (fd: " << socket << ")" << std::endl;
+        return false;
+    }
+    slot->buffer = reactor.clients.buffer(socket);
+    slot->peer = peer;
+    slot->upstream = upstream;
+    if (reactor.relay->mode == RelayMode::Splice) {
+        int fds[2];
+        if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) == -1) {
+            std::cerr << "Failed to create relay pipe: " << strerror(errno) << std::endl;
+            return false;
+        }
+        slot->pipeRead = fds[0];
+        slot->pipeWrite = fds[1];
+    }
+    return true;
+}
+
+// Relay mode: open the upstream connection of an accepted client and watch
+// both sockets in both directions. The connect completes in the background;
+// until then sends to upstream hit EAGAIN and resume on its EPOLLOUT edge.
+void setupRelay(Reactor& reactor, int clientSocket) {
+    int upstream = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (upstream == -1) {
+        std::cerr << "Failed to create upstream socket: " << strerror(errno) << std::endl;
+        close(clientSocket);
+        return;
+    }
+    int flag = 1;
+    setsockopt(upstream, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    if (connect(upstream, reinterpret_cast<const sockaddr*>(&reactor.relay->address),
+                sizeof(reactor.relay->address)) == -1 && errno != EINPROGRESS) {
+        std::cerr << "Failed to connect upstream: " << strerror(errno) << std::endl;
+        close(upstream);
+        close(clientSocket);
+        return;
     }
     
-    // Buffer for epoll events
-    struct epoll_event events[MAX_EVENTS];
+    ClientData* client = nullptr;
+    ClientData* upstreamSlot = nullptr;
+    bool ok = openRelaySlot(reactor, clientSocket, upstream, false, client)
+           && openRelaySlot(reactor, upstream, clientSocket, true, upstreamSlot);
+    for (int socket : {clientSocket, upstream}) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+        ev.data.fd = socket;
+        countStat(reactor.stats.epollCtlCalls);
+        if (!ok || epoll_ctl(reactor.epollFd, EPOLL_CTL_ADD, socket, &ev) == -1) {
+            if (ok) {
+                std::cerr << "Failed to add relay socket to epoll: " << strerror(errno) << std::endl;
+            }
+            ok = false;
+            break;
+        }
+    }
+    if (!ok) {
+        // releaseSocket copes with sockets that have no slot or registration
+        releaseSocket(reactor, clientSocket);
+        releaseSocket(reactor, upstream);
+        return;
+    }
+    client->shared = reactor.shared->connection(clientSocket);
+    openSharedConnection(client->shared, reactor.id, clientSocket);
+    reactor.trace.record(TraceEvent::Accept, clientSocket, 0);
     
-    // Map to track client data
-    std::map<int, ClientData> clients;
+    countStat(reactor.stats.totalConnections);
+    countStat(reactor.stats.activeConnections);
+}
+
+// Register a freshly accepted, already non-blocking socket
+void setupClient(Reactor& reactor, int clientSocket) {
+    if (reactor.relay != nullptr) {
+        setupRelay(reactor, clientSocket);
+        return;
+    }
+    // Initialize client data in the fd's table slot
+    ClientData* client = reactor.clients.open(clientSocket);
+    if (client == nullptr) {
+        std::cerr << "Connection table full (fd: " << clientSocket << ")" << std::endl;
+        close(clientSocket);
+        return;
+    }
+    client->buffer = reactor.clients.buffer(clientSocket);
+    client->reply = slotReply(reactor, clientSocket);
+    if (reactor.zeroCopy.enabled()) {
+        client->zeroCopy.copying = !enableZeroCopy(clientSocket);
+        client->reply = reactor.zeroCopy.start(client->zeroCopy, client->reply);
+    }
     
-    // Statistics
-    int totalConnections = 0;
-    int activeConnections = 0;
-    long totalBytesProcessed = 0;
+    // Add client socket to epoll. Batched mode registers both directions once;
+    // the EPOLLOUT edge only fires after a send hit EAGAIN.
+    struct epoll_event clientEv;
+    clientEv.events = reactor.batch ? EPOLLIN | EPOLLOUT | EPOLLET : EPOLLIN | EPOLLET; // Edge-triggered mode
+    clientEv.data.fd = clientSocket;
     
-    // Main server loop
-    std::cout << "Server started. Press Ctrl+C to stop." << std::endl;
+    countStat(reactor.stats.epollCtlCalls);
+    if (epoll_ctl(reactor.epollFd, EPOLL_CTL_ADD, clientSocket, &clientEv) == -1) {
+        std::cerr << "Failed to add client socket to epoll: " << strerror(errno) << std::endl;
+        reactor.clients.release(clientSocket);
+        close(clientSocket);
+        return;
+    }
+    client->shared = reactor.shared->connection(clientSocket);
+    openSharedConnection(client->shared, reactor.id, clientSocket);
+    reactor.trace.record(TraceEvent::Accept, clientSocket, 0);
+    
+    countStat(reactor.stats.totalConnections);
+    countStat(reactor.stats.activeConnections);
+}
+
+// Handoff steering: queue a socket whose softirq runs on another reactor's
+// CPU with that reactor. Returns false if no reactor is pinned there.
+bool handOff(Reactor& reactor, int cpu, int clientSocket) {
+    if (cpu < 0 || static_cast<size_t>(cpu) >= reactor.cpuReactors->size()) {
+        return false;
+    }
+    Reactor* target = (*reactor.cpuReactors)[cpu];
+    if (target == nullptr || target == &reactor) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(target->inbox.mutex);
+        target->inbox.sockets.push_back(clientSocket);
+    }
+    uint64_t one = 1;
+    if (write(target->inbox.eventFd, &one, sizeof(one)) == -1) {
+        std::cerr << "Failed to signal handoff eventfd: " << strerror(errno) << std::endl;
+    }
+    countStat(reactor.stats.handedOff);
+    return true;
+}
+
+// Drain the listen backlog on one readiness event. accept4 hands out the
+// socket non-blocking and the listener's options (TCP_NODELAY, busy poll)
+// are inherited, so a connection costs accept4 and one epoll_ctl.
+void acceptClients(Reactor& reactor) {
+    countStat(reactor.stats.acceptWakeups);
+    while (true) {
+        int clientSocket = accept4(reactor.listenSocket, nullptr, nullptr, SOCK_NONBLOCK);
+        countStat(reactor.stats.acceptCalls);
+        if (clientSocket == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                std::cerr << "Failed to accept connection: " << strerror(errno) << std::endl;
+            }
+            return;
+        }
+        if (reactor.steer != SteerMode::Off) {
+            int cpu = incomingCpu(clientSocket);
+            if (cpu == reactor.cpu) {
+                countStat(reactor.stats.localAccepts);
+            } else if (reactor.steer == SteerMode::Handoff && handOff(reactor, cpu, clientSocket)) {
+                continue;
+            }
+        }
+        setupClient(reactor, clientSocket);
+    }
+}
+
+// Register the sockets other reactors handed to this one
+void acceptHandoffs(Reactor& reactor) {
+    uint64_t count;
+    if (read(reactor.inbox.eventFd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+        std::cerr << "Failed to read handoff eventfd: " << strerror(errno) << std::endl;
+    }
+    std::vector<int> sockets;
+    {
+        std::lock_guard<std::mutex> lock(reactor.inbox.mutex);
+        sockets.swap(reactor.inbox.sockets);
+    }
+    for (int clientSocket : sockets) {
+        setupClient(reactor, clientSocket);
+    }
+}
+
+void handleClient(Reactor& reactor, int clientSocket) {
+    // Check if the socket exists in our table
+    ClientData* slot = reactor.clients.find(clientSocket);
+    if (slot == nullptr) {
+        // Unexpected socket, remove from epoll and close
+        epoll_ctl(reactor.epollFd, EPOLL_CTL_DEL, clientSocket, nullptr);
+        close(clientSocket);
+        return;
+    }
+    
+    ClientData& client = *slot;
+    
+    // If we're in receiving mode
+    if (client.receivingData) {
+        // Read the header, then exactly the rest of the frame it announces
+        FrameHeader header;
+        FrameStatus status;
+        while ((status = parseFrame(client.buffer, client.bytesReceived, reactor.maxFrame, header))
+               == FrameStatus::Incomplete) {
+            size_t wanted = client.bytesReceived < FRAME_HEADER_SIZE ? FRAME_HEADER_SIZE : header.length;
+            ssize_t bytesRead = recv(clientSocket, 
+                                    client.buffer + client.bytesReceived, 
+                                    wanted - client.bytesReceived, 
+                                    0);
+            countStat(reactor.stats.ioSyscalls);
+            
+            if (bytesRead > 0) {
+                reactor.trace.record(TraceEvent::Recv, clientSocket, bytesRead);
+                client.bytesReceived += bytesRead;
+            } else if (bytesRead == 0) {
+                // Client disconnected
+                countStat(reactor.stats.totalBytesProcessed, client.bytesReceived);
+                closeClient(reactor, clientSocket);
+                return;
+            } else if (bytesRead == -1) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    // Rest of the frame not here yet; keep what arrived and
+                    // wait for the next EPOLLIN edge instead of spinning on
+                    // one connection, which would stall the others and
+                    // shutdown until this peer sends
+                    reactor.trace.record(TraceEvent::Again, clientSocket, 0);
+                    return;
+                } else {
+                    // Error occurred
+                    std::cerr << "Error reading from client (fd: " << clientSocket 
+                              << "): " << strerror(errno) << std::endl;
+                    closeClient(reactor, clientSocket);
+                    return;
+                }
+            }
+        }
+        
+        if (status == FrameStatus::Invalid) {
+            std::cerr << "Protocol error: invalid frame header (fd: " << clientSocket << ")" << std::endl;
+            closeClient(reactor, clientSocket);
+            return;
+        }
+        
+        // We received a whole frame, build the reply and switch to sending mode
+        client.replyBytes = buildReply(reactor, client.buffer, header, client.reply);
+        reactor.locality.message(clientSocket);
+        
+        // Switch to sending mode
+        client.receivingData = false;
+        client.bytesSent = 0;
+        reactor.trace.record(TraceEvent::State, clientSocket, 1);
+        
+        // Modify the event to monitor for write readiness
+        struct epoll_event clientEv;
+        clientEv.events = EPOLLOUT | EPOLLET;
+        clientEv.data.fd = clientSocket;
+        
+        countStat(reactor.stats.epollCtlCalls);
+        if (epoll_ctl(reactor.epollFd, EPOLL_CTL_MOD, clientSocket, &clientEv) == -1) {
+            std::cerr << "Failed to modify client socket event: " << strerror(errno) << std::endl;
+            closeClient(reactor, clientSocket);
+        }
+    }
+    // If we're in sending mode
+    else {
+        while (client.bytesSent < client.replyBytes) {
+            ssize_t bytesSent = reactor.zeroCopy.send(client.zeroCopy, clientSocket,
+                                                      client.reply + client.bytesSent,
+                                                      client.replyBytes - client.bytesSent,
+                                                      0);
+            countStat(reactor.stats.ioSyscalls);
+            
+            if (bytesSent > 0) {
+                reactor.trace.record(TraceEvent::Send, clientSocket, bytesSent);
+                client.bytesSent += bytesSent;
+            } else if (bytesSent == -1) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    // Send buffer full; resume from bytesSent on the next
+                    // EPOLLOUT edge, so a peer that stops reading only
+                    // stalls itself
+                    reactor.trace.record(TraceEvent::Again, clientSocket, 1);
+                    return;
+                } else {
+                    // Error occurred
+                    std::cerr << "Error sending to client (fd: " << clientSocket 
+                              << "): " << strerror(errno) << std::endl;
+                    closeClient(reactor, clientSocket);
+                    return;
+                }
+            }
+        }
+        
+        // If we sent all data, switch back to receiving mode
+        if (client.bytesSent == client.replyBytes) {
+            // Update statistics
+            countStat(reactor.stats.totalBytesProcessed, client.replyBytes);
+            countStat(reactor.stats.messagesProcessed);
+            countSharedMessages(client.shared, 1, client.replyBytes);
+            
+            // Reset for next reception; a zero-copy reply buffer stays
+            // untouched until the kernel completes its sends
+            client.receivingData = true;
+            reactor.trace.record(TraceEvent::State, clientSocket, 0);
+            client.bytesReceived = 0;
+            client.reply = reactor.zeroCopy.advance(client.zeroCopy, client.reply, client.replyBytes,
+                                                    client.replyBytes, slotReply(reactor, clientSocket));
+            
+            // Modify the event to monitor for read readiness. EPOLL_CTL_MOD
+            // re-checks readiness, so pipelined frames already queued on the
+            // socket raise a new edge and are not stranded.
+            struct epoll_event clientEv;
+            clientEv.events = EPOLLIN | EPOLLET;
+            clientEv.data.fd = clientSocket;
+            
+            countStat(reactor.stats.epollCtlCalls);
+            if (epoll_ctl(reactor.epollFd, EPOLL_CTL_MOD, clientSocket, &clientEv) == -1) {
+                std::cerr << "Failed to modify client socket event: " << strerror(errno) << std::endl;
+                closeClient(reactor, clientSocket);
+            }
+        }
+    }
+}
+
+// Send as much of the reply backlog as the socket takes. Returns false on error.
+bool flushPending(Reactor& reactor, int clientSocket, ClientData& client) {
+    unsigned char* backlog = client.reply;
+    size_t offset = 0;
+    while (offset < client.pendingBytes) {
+        ssize_t sent = reactor.zeroCopy.send(client.zeroCopy, clientSocket, backlog + offset,
+                                             client.pendingBytes - offset, MSG_NOSIGNAL);
+        countStat(reactor.stats.ioSyscalls);
+        if (sent > 0) {
+            reactor.trace.record(TraceEvent::Send, clientSocket, sent);
+            offset += sent;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            reactor.trace.record(TraceEvent::Again, clientSocket, 1);
+            break;
+        } else {
+            std::cerr << "Error sending to client (fd: " << clientSocket 
+                      << "): " << strerror(errno) << std::endl;
+            return false;
+        }
+    }
+    countStat(reactor.stats.totalBytesProcessed, offset);
+    countSharedMessages(client.shared, 0, offset);
+    client.reply = reactor.zeroCopy.advance(client.zeroCopy, backlog, offset, client.pendingBytes,
+                                            slotReply(reactor, clientSocket));
+    client.pendingBytes -= offset;
+    return true;
+}
+
+// Batched mode: build replies for every complete frame in the input buffer
+// into the backlog and send them with one call, repeating while frames had to
+// wait for backlog space. Returns false if the connection must be closed.
+bool answerFrames(Reactor& reactor, int clientSocket, ClientData& client) {
+    while (true) {
+        size_t consumed = 0;
+        uint64_t answered = 0;
+        FrameHeader header;
+        FrameStatus status;
+        while ((status = parseFrame(client.buffer + consumed, client.bytesReceived - consumed,
+                                    reactor.maxFrame, header)) == FrameStatus::Complete
+               && client.pendingBytes + header.replyLength <= reactor.bufferCapacity) {
+            client.pendingBytes += buildReply(reactor, client.buffer + consumed, header, client.reply + client.pendingBytes);
+            consumed += header.length;
+            countStat(reactor.stats.messagesProcessed);
+            reactor.locality.message(clientSocket);
+            answered++;
+        }
+        if (status == FrameStatus::Invalid) {
+            std::cerr << "Protocol error: invalid frame header (fd: " << clientSocket << ")" << std::endl;
+            return false;
+        }
+        
+        countSharedMessages(client.shared, answered, 0);
+        
+        // Keep the partial frame at the start of the input buffer
+        client.bytesReceived -= consumed;
+        if (client.bytesReceived > 0 && consumed > 0) {
+            memmove(client.buffer, client.buffer + consumed, client.bytesReceived);
+        }
+        
+        if (!flushPending(reactor, clientSocket, client)) {
+            return false;
+        }
+        if (consumed == 0 || client.pendingBytes > 0) {
+            return true;
+        }
+    }
+}
+
+// Batched mode: drain the socket with large reads, answer every complete
+// frame right away and only leave replies in the backlog (for the already
+// registered EPOLLOUT edge) when a send would block. No epoll_ctl is needed
+// after the initial registration.
+void handleClientBatched(Reactor& reactor, int clientSocket) {
+    ClientData* slot = reactor.clients.find(clientSocket);
+    if (slot == nullptr) {
+        epoll_ctl(reactor.epollFd, EPOLL_CTL_DEL, clientSocket, nullptr);
+        countStat(reactor.stats.epollCtlCalls);
+        close(clientSocket);
+        return;
+    }
+    
+    ClientData& client = *slot;
+    
+    // Finish replies left over from a previous EAGAIN, and the frames that
+    // waited for backlog space, before reading more
+    if (client.pendingBytes > 0) {
+        if (!answerFrames(reactor, clientSocket, client)) {
+            closeClient(reactor, clientSocket);
+            return;
+        }
+        if (client.pendingBytes > 0) {
+            return;
+        }
+    }
+    
+    while (true) {
+        size_t space = reactor.bufferCapacity - client.bytesReceived;
+        ssize_t bytesRead = recv(clientSocket, client.buffer + client.bytesReceived, space, 0);
+        countStat(reactor.stats.ioSyscalls);
+        
+        if (bytesRead == 0) {
+            // Client disconnected
+            countStat(reactor.stats.totalBytesProcessed, client.bytesReceived);
+            closeClient(reactor, clientSocket);
+            return;
+        } else if (bytesRead == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                reactor.trace.record(TraceEvent::Again, clientSocket, 0);
+                return;
+            }
+            std::cerr << "Error reading from client (fd: " << clientSocket 
+                      << "): " << strerror(errno) << std::endl;
+            closeClient(reactor, clientSocket);
+            return;
+        }
+        reactor.trace.record(TraceEvent::Recv, clientSocket, bytesRead);
+        client.bytesReceived += bytesRead;
+        
+        if (!answerFrames(reactor, clientSocket, client)) {
+            closeClient(reactor, clientSocket);
+            return;
+        }
+        
+        // Stop reading until EPOLLOUT drains the backlog. A short read means
+        // the socket is empty; the next arrival raises a new EPOLLIN edge.
+        if (client.pendingBytes > 0 || static_cast<size_t>(bytesRead) < space) {
+            return;
+        }
+    }
+}
+
+// Relay mode: count bytes that left for the peer socket
+void countRelayed(Reactor& reactor, int peer, ClientData& source, size_t bytes) {
+    countStat(reactor.stats.totalBytesProcessed, bytes);
+    if (source.upstream) {
+        countStat(reactor.stats.relayedDown, bytes);
+        ClientData* client = reactor.clients.find(peer);
+        countSharedMessages(client != nullptr ? client->shared : nullptr, 0, bytes);
+    } else {
+        countStat(reactor.stats.relayedUp, bytes);
+        countSharedMessages(source.shared, 0, bytes);
+    }
+    reactor.trace.record(TraceEvent::Send, peer, bytes);
+}
+
+// Copy relay: forward what is buffered, then read more, until either socket
+// would block. Returns false when the pair must be closed.
+bool pumpCopy(Reactor& reactor, int socket, ClientData& source) {
+    while (true) {
+        if (source.bytesSent < source.bytesReceived) {
+            ssize_t sent = send(source.peer, source.buffer + source.bytesSent,
+                                source.bytesReceived - source.bytesSent, MSG_NOSIGNAL);
+            countStat(reactor.stats.ioSyscalls);
+            if (sent == -1) {
+                // The peer's EPOLLOUT edge resumes the transfer
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            source.bytesSent += sent;
+            countRelayed(reactor, source.peer, source, sent);
+            if (source.bytesSent < source.bytesReceived) {
+                continue;
+            }
+            source.bytesReceived = 0;
+            source.bytesSent = 0;
+        }
+        ssize_t received = recv(socket, source.buffer, reactor.bufferCapacity, 0);
+        countStat(reactor.stats.ioSyscalls);
+        if (received > 0) {
+            reactor.trace.record(TraceEvent::Recv, socket, received);
+            source.bytesReceived = received;
+        } else if (received == 0) {
+            return false;
+        } else {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+    }
+}
+
+// Splice relay: the same loop with the pipe in place of the buffer, so the
+// payload pages move from one socket to the other without a user-space copy
+bool pumpSplice(Reactor& reactor, int socket, ClientData& source) {
+    while (true) {
+        if (source.pendingBytes > 0) {
+            ssize_t moved = splice(source.pipeRead, nullptr, source.peer, nullptr, source.pendingBytes,
+                                   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            countStat(reactor.stats.ioSyscalls);
+            if (moved == -1) {
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            source.pendingBytes -= moved;
+            countRelayed(reactor, source.peer, source, moved);
+            continue;
+        }
+        ssize_t received = splice(socket, nullptr, source.pipeWrite, nullptr, reactor.bufferCapacity,
+                                  SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        countStat(reactor.stats.ioSyscalls);
+        if (received > 0) {
+            reactor.trace.record(TraceEvent::Recv, socket, received);
+            source.pendingBytes = received;
+        } else if (received == 0) {
+            return false;
+        } else {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+    }
+}
+
+bool pumpRelay(Reactor& reactor, int socket, ClientData& source) {
+    return reactor.relay->mode == RelayMode::Splice ? pumpSplice(reactor, socket, source)
+                                                    : pumpCopy(reactor, socket, source);
+}
+
+// Relay mode: readable means bytes to forward to the peer, writable means
+// the peer's stalled bytes can go on to this socket
+void handleRelay(Reactor& reactor, int socket, uint32_t events) {
+    ClientData* source = reactor.clients.find(socket);
+    if (source == nullptr) {
+        // Closed with its peer earlier in this batch of events
+        return;
+    }
+    int peer = source->peer;
+    bool ok = true;
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        ok = pumpRelay(reactor, socket, *source);
+    }
+    ClientData* stalled = reactor.clients.find(peer);
+    if (ok && (events & EPOLLOUT) && stalled != nullptr) {
+        ok = pumpRelay(reactor, peer, *stalled);
+    }
+    if (!ok) {
+        releaseSocket(reactor, socket);
+        releaseSocket(reactor, peer);
+        countStat(reactor.stats.activeConnections, -1);
+    }
+}
+
+// Poll the reactor's epoll instance until shutdown
+void runEpollReactor(Reactor& reactor) {
+    // Buffer for epoll events, --max-events long
+    std::vector<struct epoll_event> eventBuffer(reactor.maxEvents);
+    struct epoll_event* events = eventBuffer.data();
     
     while (g_running) {
-        // Wait for events with busy polling (zero timeout)
-        int numEvents = epoll_wait(epollFd, events, MAX_EVENTS, EPOLL_TIMEOUT_MS);
+        // Spin with a zero timeout or block, depending on --poll
+        int numEvents = reactor.poller.wait(reactor.epollFd, events, reactor.maxEvents, BLOCK_TIMEOUT_NS);
+        countStat(reactor.stats.epollWaitCalls);
         
         if (numEvents == -1) {
             if (errno == EINTR) {
@@ -173,197 +1118,610 @@ int main() {
             std::cerr << "epoll_wait failed: " << strerror(errno) << std::endl;
             break;
         }
+        if (numEvents > 0) {
+            reactor.trace.record(TraceEvent::Wakeup, -1, numEvents);
+            countStat(reactor.stats.eventWakeups);
+            countStat(reactor.stats.fullWakeups, numEvents == reactor.maxEvents ? 1 : 0);
+            countStat(reactor.stats.eventsHandled, numEvents);
+        }
+        // Per-event cost as the connection count grows; only wakeups with
+        // events are clocked, so spinning adds no clock reads
+        std::chrono::steady_clock::time_point handleStart;
+        if (reactor.timeEvents && numEvents > 0) {
+            handleStart = std::chrono::steady_clock::now();
+        }
         
         // Process events
         for (int i = 0; i < numEvents; ++i) {
-            // If event on the listening socket, accept new connection
-            if (events[i].data.fd == serverSocket) {
-                struct sockaddr_in clientAddr;
-                socklen_t clientLen = sizeof(clientAddr);
-                
-                int clientSocket = accept(serverSocket, (struct sockaddr*)&clientAddr, &clientLen);
-                if (clientSocket == -1) {
-                    if (errno != EAGAIN && errno != EWOULDBLOCK) {
-                        std::cerr << "Failed to accept connection: " << strerror(errno) << std::endl;
-                    }
+            // Zero-copy completions raise EPOLLERR; an event that only
+            // brought completions needs no further handling
+            if ((events[i].events & EPOLLERR) && reactor.zeroCopy.enabled()) {
+                ClientData* client = reactor.clients.find(events[i].data.fd);
+                if (client != nullptr && reactor.zeroCopy.readCompletions(client->zeroCopy, events[i].data.fd) > 0
+                    && !(events[i].events & (EPOLLIN | EPOLLOUT | EPOLLHUP))) {
                     continue;
                 }
-                
-                // Set new client socket to non-blocking mode
-                if (!setNonBlocking(clientSocket) || !setTcpNoDelay(clientSocket)) {
-                    close(clientSocket);
-                    continue;
-                }
-                
-                // Add client socket to epoll
-                struct epoll_event clientEv;
-                clientEv.events = EPOLLIN | EPOLLET; // Edge-triggered mode
-                clientEv.data.fd = clientSocket;
-                
-                if (epoll_ctl(epollFd, EPOLL_CTL_ADD, clientSocket, &clientEv) == -1) {
-                    std::cerr << "Failed to add client socket to epoll: " << strerror(errno) << std::endl;
-                    close(clientSocket);
-                    continue;
-                }
-                
-                // Initialize client data
-                clients[clientSocket] = ClientData();
-                
-                // Display client connection info
-                char clientIP[INET_ADDRSTRLEN];
-                inet_ntop(AF_INET, &clientAddr.sin_addr, clientIP, sizeof(clientIP));
-                
-                totalConnections++;
-                activeConnections++;
-                std::cout << "New connection from " << clientIP << ":" << ntohs(clientAddr.sin_port) 
-                          << " (fd: " << clientSocket << ", total: " << activeConnections << ")" << std::endl;
+            }
+            
+            // If event on the listening socket, accept every new connection
+            if (events[i].data.fd == reactor.listenSocket) {
+                acceptClients(reactor);
+            }
+            else if (events[i].data.fd == reactor.inbox.eventFd) {
+                acceptHandoffs(reactor);
+            }
+            else if (reactor.relay != nullptr) {
+                handleRelay(reactor, events[i].data.fd, events[i].events);
             }
             // If event on client socket, process data
+            else if (reactor.batch) {
+                handleClientBatched(reactor, events[i].data.fd);
+            }
             else {
-                int clientSocket = events[i].data.fd;
-                
-                // Check if the socket exists in our map
-                if (clients.find(clientSocket) == clients.end()) {
-                    // Unexpected socket, remove from epoll and close
-                    epoll_ctl(epollFd, EPOLL_CTL_DEL, clientSocket, nullptr);
-                    close(clientSocket);
-                    continue;
-                }
-                
-                ClientData& client = clients[clientSocket];
-                
-                // If we're in receiving mode
-                if (client.receivingData) {
-                    while (client.bytesReceived < BUFFER_SIZE) {
-                        ssize_t bytesRead = recv(clientSocket, 
-                                                client.buffer.data() + client.bytesReceived, 
-                                                BUFFER_SIZE - client.bytesReceived, 
-                                                0);
-                        
-                        if (bytesRead > 0) {
-                            client.bytesReceived += bytesRead;
-                        } else if (bytesRead == 0) {
-                            // Client disconnected
-                            epoll_ctl(epollFd, EPOLL_CTL_DEL, clientSocket, nullptr);
-                            close(clientSocket);
-                            totalBytesProcessed += client.bytesReceived;
-                            clients.erase(clientSocket);
-                            activeConnections--;
-                            std::cout << "Client disconnected (fd: " << clientSocket 
-                                      << ", remaining: " << activeConnections << ")" << std::endl;
-                            break;
-                        } else if (bytesRead == -1) {
-                            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                                // No more data available right now, continue busy polling
-                                continue;
-                            } else {
-                                // Error occurred
-                                std::cerr << "Error reading from client (fd: " << clientSocket 
-                                          << "): " << strerror(errno) << std::endl;
-                                epoll_ctl(epollFd, EPOLL_CTL_DEL, clientSocket, nullptr);
-                                close(clientSocket);
-                                clients.erase(clientSocket);
-                                activeConnections--;
-                                break;
-                            }
-                        }
-                    }
-                    
-                                            // If we received all data, process it and switch to sending mode
-                    if (client.bytesReceived == BUFFER_SIZE) {
-                        // XOR each byte in the buffer with a new random byte
-                        for (size_t j = 0; j < BUFFER_SIZE; ++j) {
-                            unsigned char randomByte = static_cast<unsigned char>(std::rand() % 256);
-                            client.buffer[j] ^= randomByte;
-                        }
-                        
-                        // Switch to sending mode
-                        client.receivingData = false;
-                        client.bytesSent = 0;
-                        
-                        // Modify the event to monitor for write readiness
-                        struct epoll_event clientEv;
-                        clientEv.events = EPOLLOUT | EPOLLET;
-                        clientEv.data.fd = clientSocket;
-                        
-                        if (epoll_ctl(epollFd, EPOLL_CTL_MOD, clientSocket, &clientEv) == -1) {
-                            std::cerr << "Failed to modify client socket event: " << strerror(errno) << std::endl;
-                            close(clientSocket);
-                            clients.erase(clientSocket);
-                            activeConnections--;
-                        }
-                    }
-                }
-                // If we're in sending mode
-                else {
-                    while (client.bytesSent < BUFFER_SIZE) {
-                        ssize_t bytesSent = send(clientSocket, 
-                                               client.buffer.data() + client.bytesSent, 
-                                               BUFFER_SIZE - client.bytesSent, 
-                                               0);
-                        
-                        if (bytesSent > 0) {
-                            client.bytesSent += bytesSent;
-                        } else if (bytesSent == -1) {
-                            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                                // Socket is not ready for writing, continue busy polling
-                                continue;
-                            } else {
-                                // Error occurred
-                                std::cerr << "Error sending to client (fd: " << clientSocket 
-                                          << "): " << strerror(errno) << std::endl;
-                                epoll_ctl(epollFd, EPOLL_CTL_DEL, clientSocket, nullptr);
-                                close(clientSocket);
-                                clients.erase(clientSocket);
-                                activeConnections--;
-                                break;
-                            }
-                        }
-                    }
-                    
-                    // If we sent all data, switch back to receiving mode
-                    if (client.bytesSent == BUFFER_SIZE) {
-                        // Update statistics
-                        totalBytesProcessed += BUFFER_SIZE;
-                        
-                        // Reset for next reception
-                        client.receivingData = true;
-                        client.bytesReceived = 0;
-                        
-                        // Modify the event to monitor for read readiness
-                        struct epoll_event clientEv;
-                        clientEv.events = EPOLLIN | EPOLLET;
-                        clientEv.data.fd = clientSocket;
-                        
-                        if (epoll_ctl(epollFd, EPOLL_CTL_MOD, clientSocket, &clientEv) == -1) {
-                            std::cerr << "Failed to modify client socket event: " << strerror(errno) << std::endl;
-                            close(clientSocket);
-                            clients.erase(clientSocket);
-                            activeConnections--;
-                        }
-                    }
-                }
+                handleClient(reactor, events[i].data.fd);
             }
         }
-        
-        // Optional small delay to prevent 100% CPU usage
-        // usleep(1); // Uncomment this line if you want to control CPU usage
+        if (reactor.timeEvents && numEvents > 0) {
+            countStat(reactor.stats.eventNs, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - handleStart).count());
+        }
     }
     
-    // Clean up
-    std::cout << "Shutting down server..." << std::endl;
-    std::cout << "Total connections: " << totalConnections << std::endl;
-    std::cout << "Total bytes processed: " << totalBytesProcessed << " (" 
-              << (totalBytesProcessed / 1024) << " KB)" << std::endl;
-    
     // Close all client connections
-    for (const auto& client : clients) {
-        close(client.first);
+    reactor.clients.forEach([](int clientSocket, ClientData& client) {
+        close(clientSocket);
+        if (client.pipeRead != -1) {
+            close(client.pipeRead);
+            close(client.pipeWrite);
+        }
+    });
+}
+
+// Reactor thread body
+void runReactor(Reactor& reactor, const ServerOptions& options) {
+    if (reactor.cpu >= 0 && !pinCurrentThread(reactor.cpu)) {
+        std::cerr << "[reactor " << reactor.id << "] Failed to pin to CPU " << reactor.cpu << std::endl;
     }
+    reactor.trace.bindThread();
     
-    // Close server socket and epoll
-    close(serverSocket);
-    close(epollFd);
+    if (options.transport == Transport::Udp) {
+        runUdpReactor(reactor, options);
+        return;
+    }
+    if (options.engine == Engine::Uring) {
+        if (runUringReactor(reactor, options)) {
+            return;
+        }
+        std::cerr << "[reactor " << reactor.id << "] io_uring setup failed, falling back to epoll" << std::endl;
+        if (!setupEpoll(reactor)) {
+            return;
+        }
+    }
+    runEpollReactor(reactor);
+}
+
+void printStats(const std::string& label, const ReactorStats& stats) {
+    std::cout << label << "total connections: " << stats.totalConnections
+              << ", bytes processed: " << stats.totalBytesProcessed
+              << " (" << (stats.totalBytesProcessed / 1024) << " KB)" << std::endl;
+}
+
+// Counters of a running reactor, read from another thread. The reactor
+// updates them with countStat's relaxed atomic stores, so relaxed loads
+// are race-free and see each value whole.
+ReactorStats loadReactorStats(const ReactorStats& stats) {
+    ReactorStats copy;
+    copy.totalConnections = __atomic_load_n(&stats.totalConnections, __ATOMIC_RELAXED);
+    copy.activeConnections = __atomic_load_n(&stats.activeConnections, __ATOMIC_RELAXED);
+    copy.totalBytesProcessed = __atomic_load_n(&stats.totalBytesProcessed, __ATOMIC_RELAXED);
+    copy.messagesProcessed = __atomic_load_n(&stats.messagesProcessed, __ATOMIC_RELAXED);
+    copy.epollWaitCalls = __atomic_load_n(&stats.epollWaitCalls, __ATOMIC_RELAXED);
+    copy.epollCtlCalls = __atomic_load_n(&stats.epollCtlCalls, __ATOMIC_RELAXED);
+    copy.ioSyscalls = __atomic_load_n(&stats.ioSyscalls, __ATOMIC_RELAXED);
+    copy.corruptFrames = __atomic_load_n(&stats.corruptFrames, __ATOMIC_RELAXED);
+    copy.droppedDatagrams = __atomic_load_n(&stats.droppedDatagrams, __ATOMIC_RELAXED);
+    copy.acceptWakeups = __atomic_load_n(&stats.acceptWakeups, __ATOMIC_RELAXED);
+    copy.acceptCalls = __atomic_load_n(&stats.acceptCalls, __ATOMIC_RELAXED);
+    copy.localAccepts = __atomic_load_n(&stats.localAccepts, __ATOMIC_RELAXED);
+    copy.handedOff = __atomic_load_n(&stats.handedOff, __ATOMIC_RELAXED);
+    copy.relayedUp = __atomic_load_n(&stats.relayedUp, __ATOMIC_RELAXED);
+    copy.relayedDown = __atomic_load_n(&stats.relayedDown, __ATOMIC_RELAXED);
+    copy.eventWakeups = __atomic_load_n(&stats.eventWakeups, __ATOMIC_RELAXED);
+    copy.fullWakeups = __atomic_load_n(&stats.fullWakeups, __ATOMIC_RELAXED);
+    copy.eventsHandled = __atomic_load_n(&stats.eventsHandled, __ATOMIC_RELAXED);
+    copy.eventNs = __atomic_load_n(&stats.eventNs, __ATOMIC_RELAXED);
+    return copy;
+}
+
+void publishReactorStats(SharedReactorStats& shared, const ReactorStats& stats) {
+    sharedStore(shared.totalConnections, static_cast<uint64_t>(stats.totalConnections));
+    sharedStore(shared.activeConnections, static_cast<uint64_t>(std::max(stats.activeConnections, 0L)));
+    sharedStore(shared.messages, static_cast<uint64_t>(stats.messagesProcessed));
+    sharedStore(shared.bytes, static_cast<uint64_t>(stats.totalBytesProcessed));
+    sharedStore(shared.waitCalls, static_cast<uint64_t>(stats.epollWaitCalls));
+    sharedStore(shared.ioSyscalls, static_cast<uint64_t>(stats.ioSyscalls));
+    sharedStore(shared.corruptFrames, static_cast<uint64_t>(stats.corruptFrames));
+    sharedStore(shared.droppedDatagrams, static_cast<uint64_t>(stats.droppedDatagrams));
+}
+
+// Process and kernel memory at the most connections held at once
+struct Footprint {
+    long startRss = 0; // before the first connection
+    long connections = 0;
+    long rss = 0;
+    SocketMemory sockets;
+};
+
+// Print the memory figures of an interval line or the exit summary
+void printMemory(const SocketMemory& sockets, long rss) {
+    std::cout << "RSS " << rss / (1024 * 1024) << " MB";
+    if (sockets.valid) {
+        std::cout << ", TCP buffers " << sockets.tcpMemBytes / 1024 << " KB in " << sockets.tcpInUse
+                  << " sockets (machine-wide)";
+    }
+}
+
+// Main thread while the reactors run: copy their counters into the stats
+// segment every PUBLISH_PERIOD_MS and print rates every interval seconds.
+// Both only read the reactors' counters, so the event loops pay nothing.
+// Memory is sampled as well, to keep the footprint at the peak connection
+// count.
+void watchReactors(std::vector<Reactor>& reactors, int interval, StatsSegment& segment,
+                   const std::atomic<int>& runningReactors, Footprint& footprint) {
+    auto startTime = std::chrono::steady_clock::now();
+    auto nextReport = startTime + std::chrono::seconds(interval);
+    ReactorStats last;
+    footprint.startRss = processRssBytes();
+    footprint.rss = footprint.startRss;
+    while (g_running && runningReactors > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(PUBLISH_PERIOD_MS));
+        ReactorStats total;
+        for (size_t i = 0; i < reactors.size(); ++i) {
+            ReactorStats stats = loadReactorStats(reactors[i].stats);
+            total += stats;
+            if (segment.mapped()) {
+                publishReactorStats(*segment.reactor(static_cast<int>(i)), stats);
+            }
+        }
+        if (segment.mapped()) {
+            sharedStore(segment.header()->updateNs, statsClockNs());
+        }
+        long rss = processRssBytes();
+        SocketMemory sockets = readSocketMemory();
+        if (total.activeConnections >= footprint.connections) {
+            footprint.connections = total.activeConnections;
+            footprint.rss = rss;
+            footprint.sockets = sockets;
+        }
+        if (interval > 0 && std::chrono::steady_clock::now() >= nextReport) {
+            long seconds = std::chrono::duration_cast<std::chrono::seconds>(nextReport - startTime).count();
+            long closed = (total.totalConnections - total.activeConnections)
+                        - (last.totalConnections - last.activeConnections);
+            std::cout << "[" << seconds << "s] "
+                      << (total.messagesProcessed - last.messagesProcessed) / interval << " msgs/s, "
+                      << (total.totalBytesProcessed - last.totalBytesProcessed) / 1024 / interval << " KB/s, "
+                      << total.activeConnections << " active connections, "
+                      << static_cast<double>(total.totalConnections - last.totalConnections) / interval
+                      << " accepts/s, " << static_cast<double>(closed) / interval << " closes/s" << std::endl;
+            // Event loop cost per ready socket, to compare across connection counts
+            long events = total.eventsHandled - last.eventsHandled;
+            long wakeups = total.eventWakeups - last.eventWakeups;
+            std::cout << "     ";
+            printMemory(sockets, rss);
+            if (wakeups > 0) {
+                std::cout << ", " << static_cast<double>(events) / wakeups << " events/wakeup ("
+                          << 100.0 * (total.fullWakeups - last.fullWakeups) / wakeups << "% full), "
+                          << (total.eventNs - last.eventNs) / events << " ns/event";
+            }
+            std::cout << std::endl;
+            last = total;
+            nextReport += std::chrono::seconds(interval);
+        }
+    }
+}
+
+// Parse the IPv4 HOST:PORT of --relay
+bool parseRelayTarget(const std::string& target, sockaddr_in& address) {
+    size_t colon = target.rfind(':');
+    if (colon == std::string::npos) {
+        return false;
+    }
+    long port = 0;
+    if (!parseIntOption("--relay", target.substr(colon + 1).c_str(), 1, 65535, port)) {
+        return false;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    return inet_pton(AF_INET, target.substr(0, colon).c_str(), &address.sin_addr) == 1;
+}
+
+int main(int argc, char* argv[]) {
+    ServerOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        return 1;
+    }
+    
+    // Set up signal handling for SIGINT
+    struct sigaction sa;
+    sa.sa_handler = signalHandler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    
+    if (sigaction(SIGINT, &sa, nullptr) == -1) {
+        std::cerr << "Failed to set up signal handler: " << strerror(errno) << std::endl;
+        return 1;
+    }
+    
+    // Fall back to epoll when the kernel lacks the io_uring features we need
+    if (options.transport == Transport::Tcp && options.engine == Engine::Uring) {
+        std::string reason;
+        if (!uringSupported(reason)) {
+            std::cerr << "io_uring engine unavailable (" << reason << "), falling back to epoll" << std::endl;
+            options.engine = Engine::Epoll;
+        }
+    }
+    
+    // Counters inherit into the reactor threads started below
+    PerfCounters perf;
+    PerfPhase perfSetup, perfSteady, perfShutdown;
+    PerfReading perfMark;
+    if (options.perfCounters) {
+        std::string note;
+        if (!perf.open(note)) {
+            std::cerr << "Warning: perf counters unavailable: " << note << std::endl;
+            options.perfCounters = false;
+        } else if (!note.empty()) {
+            std::cerr << "Warning: perf counters: " << note << std::endl;
+        }
+        perfMark = perf.read();
+    }
+    
+    // Zero copy is implemented for the epoll engine's TCP sends
+    bool zerocopy = options.zerocopy;
+    if (zerocopy && (options.transport == Transport::Udp || options.engine != Engine::Epoll)) {
+        std::cerr << "--zerocopy applies to the TCP epoll engine only, sending with copies" << std::endl;
+        zerocopy = false;
+    }
+    
+    // The io_uring engine keeps its own submit-and-reap loop
+    if (options.poll.mode != PollMode::Spin && options.transport == Transport::Tcp
+        && options.engine == Engine::Uring) {
+        std::cerr << "--poll applies to the epoll engine and UDP only, io_uring keeps polling its rings" << std::endl;
+    }
+    
+    // Steering matches softirq CPUs to pinned reactors, and handing a socket
+    // over needs the target's epoll loop
+    if (options.steer != SteerMode::Off) {
+        if (options.cpus.empty()) {
+            std::cerr << "--steer needs --cpus to know which reactor runs on which CPU" << std::endl;
+            return 1;
+        }
+        if (options.transport == Transport::Udp) {
+            std::cerr << "--steer applies to TCP connections only, ignoring it" << std::endl;
+            options.steer = SteerMode::Off;
+        } else if (options.steer == SteerMode::Handoff && options.engine == Engine::Uring) {
+            std::cerr << "--steer handoff needs the epoll engine, steering with listeners only" << std::endl;
+            options.steer = SteerMode::Listener;
+        }
+    }
+    
+    // Relay mode forwards with the epoll engine's non-blocking sockets
+    RelayTarget relay;
+    if (!options.relay.empty()) {
+        if (options.transport == Transport::Udp || options.engine != Engine::Epoll || zerocopy) {
+            std::cerr << "--relay needs the TCP epoll engine without --zerocopy" << std::endl;
+            return 1;
+        }
+        if (!parseRelayTarget(options.relay, relay.address)) {
+            std::cerr << "Invalid --relay target, expected IPv4 HOST:PORT: " << options.relay << std::endl;
+            return 1;
+        }
+        relay.mode = options.relayMode;
+    }
+    
+    // The connection tables reserve one slot per possible fd, so the limit
+    // has to be raised before the reactors are set up. Relayed connections
+    // take an upstream socket and, with splice, a pipe per direction.
+    if (options.maxConnections > 0) {
+        long perConnection = options.relay.empty() ? 1 : (relay.mode == RelayMode::Splice ? 6 : 2);
+        long wanted = options.maxConnections * perConnection + 3L * options.threads + 64;
+        long limit = raiseFileLimit(wanted);
+        if (limit != -1 && limit < wanted) {
+            std::cerr << "Warning: open file limit is " << limit << ", below the " << wanted
+                      << " descriptors --max-connections needs (raise the hard limit with ulimit -Hn)" << std::endl;
+        }
+    }
+    
+    // Each reactor binds its own listener; SO_REUSEPORT lets them share the port
+    std::vector<Reactor> reactors(options.threads);
+    std::vector<Reactor*> cpuReactors;
+    std::random_device seeder;
+    bool reusePort = options.threads > 1;
+    bool ok = true;
+    for (int i = 0; i < options.threads && ok; ++i) {
+        reactors[i].id = i;
+        reactors[i].batch = options.batch;
+        reactors[i].maxFrame = options.maxFrame;
+        reactors[i].bufferCapacity = options.batch ? std::max(BATCH_BUFFER_SIZE, options.maxFrame) : options.maxFrame;
+        reactors[i].verify = options.verify;
+        reactors[i].verifySeed = options.verifySeed;
+        reactors[i].keystream = seededKeystream((static_cast<uint64_t>(seeder()) << 32) ^ seeder());
+        if (!options.cpus.empty()) {
+            reactors[i].cpu = options.cpus[i % options.cpus.size()];
+        }
+        reactors[i].steer = options.steer;
+        if (options.steer == SteerMode::Handoff) {
+            // The first reactor pinned to a CPU receives its connections
+            if (cpuReactors.size() <= static_cast<size_t>(reactors[i].cpu)) {
+                cpuReactors.resize(reactors[i].cpu + 1, nullptr);
+            }
+            if (cpuReactors[reactors[i].cpu] == nullptr) {
+                cpuReactors[reactors[i].cpu] = &reactors[i];
+            }
+            reactors[i].cpuReactors = &cpuReactors;
+        }
+        reactors[i].locality.enabled = options.locality;
+        reactors[i].maxEvents = options.maxEvents;
+        reactors[i].timeEvents = options.interval > 0;
+        if (!options.relay.empty()) {
+            reactors[i].relay = &relay;
+        }
+        reactors[i].poller.init(options.poll);
+        ok = setupReactor(reactors[i], reusePort, options);
+        if (ok && options.poll.mode == PollMode::BusyPoll) {
+            enableBusyPoll(reactors[i], options.poll, i == 0);
+        }
+        if (ok && zerocopy) {
+            bool locked = false;
+            if (!reactors[i].zeroCopy.init(reactors[i].bufferCapacity, options.zerocopyBuffers, locked)) {
+                std::cerr << "Failed to allocate zero-copy buffers: " << strerror(errno) << std::endl;
+                ok = false;
+            } else if (!locked && i == 0) {
+                std::cerr << "Warning: could not lock zero-copy buffers (RLIMIT_MEMLOCK), continuing unlocked" << std::endl;
+            }
+        }
+    }
+    if (!ok) {
+        for (const Reactor& reactor : reactors) {
+            if (reactor.listenSocket != -1) close(reactor.listenSocket);
+            if (reactor.epollFd != -1) close(reactor.epollFd);
+            if (reactor.inbox.eventFd != -1) close(reactor.inbox.eventFd);
+        }
+        return 1;
+    }
+    
+    if (options.transport == Transport::Tcp && options.engine == Engine::Epoll) {
+        const ConnectionTable<ClientData>& table = reactors[0].clients;
+        printTableFootprint("epoll", table.bytesPerConnection(), table.stateBytes(),
+                            table.bufferBytes(), table.capacity());
+    }
+    std::cout << "Payload transform: " << keystreamKernelName(activeKeystreamKernel()) << " keystream"
+              << (options.verify ? ", verifying CRC32C" : "") << std::endl;
+    if (zerocopy) {
+        std::cout << "Zero-copy sends: " << options.zerocopyBuffers << " buffers of " << reactors[0].bufferCapacity
+                  << " bytes per reactor" << std::endl;
+    }
+    std::cout << "Server listening on " << options.host << ":" << options.port
+              << " with " << options.threads << " reactor thread(s), ";
+    if (options.transport == Transport::Udp) {
+        std::cout << "UDP, " << options.mmsgBatch << " datagrams per recvmmsg/sendmmsg"
+                  << (options.gso ? ", GSO" : "") << (options.gro ? ", GRO" : "") << std::endl;
+    } else {
+        std::cout << (options.engine == Engine::Uring ? (options.sqpoll ? "io_uring (SQPOLL)" : "io_uring") : "epoll")
+                  << " engine" << std::endl;
+    }
+    if (!options.relay.empty()) {
+        std::cout << "Relaying to " << options.relay << " with "
+                  << (relay.mode == RelayMode::Splice ? "splice() through a pipe per direction" : "recv/send copies")
+                  << std::endl;
+    }
+    std::cout << "Polling: " << pollModeName(options.poll.mode);
+    if (options.poll.mode == PollMode::BusyPoll) {
+        std::cout << " (" << options.poll.busyPollUs << " us, budget " << options.poll.busyPollBudget << ")";
+    } else if (options.poll.mode == PollMode::Hybrid) {
+        std::cout << " (spin " << options.poll.spinUs << " us)";
+    }
+    std::cout << std::endl;
+    if (options.steer != SteerMode::Off) {
+        std::cout << "Steering: " << (options.steer == SteerMode::Handoff ? "listener SO_INCOMING_CPU and handoff"
+                                                                          : "listener SO_INCOMING_CPU") << std::endl;
+    }
+    
+    // Live counters for server_stats, created once the reactor count is known
+    StatsSegment segment;
+    if (!options.statsShm.empty()) {
+        if (!segment.create(options.statsShm, options.threads, DEFAULT_STATS_CONNECTION_SLOTS)) {
+            std::cerr << "Warning: cannot create stats segment " << options.statsShm << ": " << strerror(errno)
+                      << std::endl;
+        } else {
+            std::cout << "Stats segment: " << options.statsShm << " (" << DEFAULT_STATS_CONNECTION_SLOTS
+                      << " connection slots)" << std::endl;
+        }
+    }
+    for (Reactor& reactor : reactors) {
+        reactor.shared = &segment;
+    }
+    
+    // One trace ring per reactor; the other engines record nothing
+    TraceFile trace;
+    if (!options.traceFile.empty()) {
+        if (options.transport == Transport::Udp || options.engine != Engine::Epoll) {
+            std::cerr << "--trace applies to the TCP epoll engine only, not tracing" << std::endl;
+        } else if (!trace.create(options.traceFile, "server", options.threads, options.traceRecords)) {
+            std::cerr << "Warning: cannot create trace file " << options.traceFile << ": " << strerror(errno)
+                      << std::endl;
+        } else {
+            for (Reactor& reactor : reactors) {
+                reactor.trace = trace.ring(reactor.id, "reactor " + std::to_string(reactor.id));
+            }
+            std::cout << "Tracing to " << options.traceFile << std::endl;
+        }
+    }
+    
+    // Main server loop
+    std::cout << "Server started. Press Ctrl+C to stop." << std::endl;
+    
+    // The reactors store their counters atomically; the sampler only reads them
+    SoftirqSampler sampler;
+    bool sampling = sampler.start(options.interval, options.softirqCpus, [&reactors](long& messages, long& bytes) {
+        for (Reactor& reactor : reactors) {
+            messages += __atomic_load_n(&reactor.stats.messagesProcessed, __ATOMIC_RELAXED);
+            bytes += __atomic_load_n(&reactor.stats.totalBytesProcessed, __ATOMIC_RELAXED);
+        }
+    });
+    if (!sampling) {
+        std::cerr << "Warning: cannot read /proc/stat, /proc/softirqs or /proc/self/stat, no softirq figures" << std::endl;
+    }
+    CpuTime cpuStart = processCpuTime();
+    auto serveStart = std::chrono::steady_clock::now();
+    if (options.perfCounters) {
+        PerfReading now = perf.read();
+        perfSetup.delta = now - perfMark;
+        perfMark = now;
+    }
+    std::atomic<int> runningReactors(options.threads);
+    std::vector<std::thread> threads;
+    for (Reactor& reactor : reactors) {
+        threads.push_back(std::thread([&reactor, &options, &runningReactors] {
+            runReactor(reactor, options);
+            runningReactors--;
+        }));
+    }
+    Footprint footprint;
+    watchReactors(reactors, options.interval, segment, runningReactors, footprint);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    if (options.perfCounters) {
+        PerfReading now = perf.read();
+        perfSteady.delta = now - perfMark;
+        perfMark = now;
+    }
+    
+    // Clean up
+    std::cout << "Shutting down server..." << std::endl;
+    CpuTime cpu = processCpuTime() - cpuStart;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - serveStart).count();
+    sampler.stop();
+    ReactorStats total;
+    ZeroCopyStats zeroCopy;
+    PollStats poll;
+    LocalityStats locality;
+    for (Reactor& reactor : reactors) {
+        if (options.threads > 1) {
+            std::string label = "Reactor " + std::to_string(reactor.id) + " (cpu ";
+            label += reactor.cpu >= 0 ? std::to_string(reactor.cpu) : std::string("any");
+            printStats(label + "): ", reactor.stats);
+        }
+        total += reactor.stats;
+        zeroCopy += reactor.zeroCopy.stats;
+        poll += reactor.poller.stats;
+        locality += reactor.locality.stats;
+        
+        // Close server socket and epoll, and sockets handed over too late
+        close(reactor.listenSocket);
+        if (reactor.epollFd != -1) close(reactor.epollFd);
+        if (reactor.inbox.eventFd != -1) close(reactor.inbox.eventFd);
+        for (int clientSocket : reactor.inbox.sockets) {
+            close(clientSocket);
+        }
+    }
+    if (options.perfCounters) {
+        perfShutdown.delta = perf.read() - perfMark;
+    }
+    std::cout << "Total connections: " << total.totalConnections << std::endl;
+    if (total.acceptWakeups > 0) {
+        std::cout << "Accepted with " << total.acceptCalls << " accept4 calls in " << total.acceptWakeups
+                  << " listener wakeups" << std::endl;
+    }
+    if (options.steer != SteerMode::Off) {
+        std::cout << "Steering: " << total.localAccepts << " of " << total.totalConnections
+                  << " connections accepted on the reactor of their softirq CPU, " << total.handedOff
+                  << " handed off to it" << std::endl;
+    }
+    std::cout << "Total bytes processed: " << total.totalBytesProcessed << " (" 
+              << (total.totalBytesProcessed / 1024) << " KB)" << std::endl;
+    if (options.verify) {
+        std::cout << "Corrupt requests (CRC mismatch): " << total.corruptFrames << std::endl;
+    }
+    if (!options.relay.empty()) {
+        // Throughput over the whole serving time; the CPU figures include the
+        // softirq work of both sockets of every pair
+        double kb = total.totalBytesProcessed / 1024.0;
+        std::cout << "Relay (" << (relay.mode == RelayMode::Splice ? "splice" : "copy") << "): "
+                  << total.relayedUp / 1024 << " KB to upstream, " << total.relayedDown / 1024 << " KB to clients, "
+                  << static_cast<long>(kb / seconds) << " KB/s";
+        if (kb > 0) {
+            std::cout << ", " << static_cast<long>(cpuNsPerKb(cpu, total.totalBytesProcessed)) << " ns CPU and "
+                      << static_cast<long>(cpu.softirq * 1e9 / kb) << " ns softirq per KB relayed, "
+                      << total.ioSyscalls / kb << (relay.mode == RelayMode::Splice ? " splice" : " recv/send")
+                      << " calls per KB";
+        }
+        std::cout << std::endl;
+    }
+    std::cout << "CPU: " << cpu.user << " s user, " << cpu.system << " s sys, "
+              << cpu.softirq << " s softirq (all CPUs), "
+              << static_cast<long>(cpuNsPerKb(cpu, total.totalBytesProcessed)) << " ns per KB sent" << std::endl;
+    if (options.transport == Transport::Udp || options.engine == Engine::Epoll) {
+        printPollStats(std::cout, poll);
+    }
+    if (total.eventWakeups > 0) {
+        std::cout << "Event loop: " << total.eventsHandled << " events in " << total.eventWakeups << " wakeups ("
+                  << static_cast<double>(total.eventsHandled) / total.eventWakeups << " per wakeup, "
+                  << 100.0 * total.fullWakeups / total.eventWakeups << "% filled all " << options.maxEvents
+                  << " --max-events slots)";
+        if (total.eventNs > 0) {
+            std::cout << ", " << total.eventNs / total.eventsHandled << " ns per event handled";
+        }
+        std::cout << std::endl;
+    }
+    if (footprint.connections > 0) {
+        std::cout << "Footprint at " << footprint.connections << " connections: ";
+        printMemory(footprint.sockets, footprint.rss);
+        std::cout << ", " << (footprint.rss - footprint.startRss) / footprint.connections
+                  << " bytes RSS per connection over the " << footprint.startRss / (1024 * 1024)
+                  << " MB before the first one" << std::endl;
+    }
+    if (sampling) {
+        sampler.printSummary(std::cout);
+    }
+    if (zerocopy) {
+        printZeroCopyStats(std::cout, zeroCopy);
+    }
+    if (options.locality) {
+        printLocality(std::cout, locality);
+    }
+    if (trace.mapped()) {
+        uint64_t recorded, overwritten;
+        trace.counts(recorded, overwritten);
+        trace.close();
+        std::cout << "Trace: " << recorded << " events, " << overwritten << " overwritten, in "
+                  << options.traceFile << std::endl;
+    }
+    if (options.transport == Transport::Udp) {
+        double datagrams = static_cast<double>(std::max(total.messagesProcessed, 1L));
+        std::cout << "Datagrams answered: " << total.messagesProcessed
+                  << ", dropped: " << total.droppedDatagrams
+                  << ", recvmmsg/sendmmsg per datagram: " << total.ioSyscalls / datagrams << std::endl;
+    } else if (options.engine == Engine::Epoll && total.messagesProcessed > 0) {
+        double messages = static_cast<double>(total.messagesProcessed);
+        std::cout << "Messages: " << total.messagesProcessed
+                  << ", per message: " << total.epollCtlCalls / messages << " epoll_ctl, "
+                  << total.ioSyscalls / messages << " recv/send, "
+                  << total.epollWaitCalls / messages << " epoll_wait" << std::endl;
+    }
+    if (options.perfCounters) {
+        perfSetup.name = "setup";
+        perfSteady.name = "serving";
+        perfSteady.messages = total.messagesProcessed;
+        perfShutdown.name = "shutdown";
+        std::vector<PerfPhase> phases;
+        phases.push_back(perfSetup);
+        phases.push_back(perfSteady);
+        phases.push_back(perfShutdown);
+        printPerfPhases(std::cout, perf, phases);
+    }
     
     return 0;
 }
@@ -0,0 +1,240 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <netinet/in.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "conn_table.h"
+#include "keystream.h"
+#include "locality.h"
+#include "polling.h"
+#include "protocol.h"
+#include "statsshm.h"
+#include "trace.h"
+#include "zerocopy.h"
+
+// Global flag for termination, shared by all reactor threads
+extern std::atomic<bool> g_running;
+
+// Minimum receive and reply backlog size per connection in batched mode
+constexpr size_t BATCH_BUFFER_SIZE = 4096;
+
+// Structure to maintain client data, stored inline in the connection table
+struct ClientData {
+    // Both buffers live in the table slot and hold Reactor::bufferCapacity
+    // bytes: the input frames, then the reply (the reply backlog in batched
+    // mode). With --zerocopy, reply points into the reactor's send pool.
+    unsigned char* buffer = nullptr;
+    unsigned char* reply = nullptr;
+    size_t bytesReceived = 0;
+    size_t bytesSent = 0;
+    size_t replyBytes = 0;   // ping-pong mode: size of the reply being sent
+    bool receivingData = true;
+    size_t pendingBytes = 0; // batched mode: replies waiting for EPOLLOUT
+    ZeroCopySocket zeroCopy;
+    SharedConnectionStats* shared = nullptr; // --stats-shm: this fd's slot, if it has one
+    // Relay mode: the other socket of the pair. This slot holds the bytes
+    // on their way from this socket to the peer: bytesReceived/bytesSent of
+    // buffer when copying, pendingBytes in the pipe when splicing.
+    int peer = -1;
+    bool upstream = false; // relay: this is the connection to the upstream server
+    int pipeRead = -1;
+    int pipeWrite = -1;
+};
+
+// Per-reactor statistics, combined by main at exit
+struct ReactorStats {
+    long totalConnections = 0;
+    long activeConnections = 0;
+    long totalBytesProcessed = 0;
+    long messagesProcessed = 0;
+    long epollWaitCalls = 0;
+    long epollCtlCalls = 0;
+    long ioSyscalls = 0;     // recv/send/writev
+    long corruptFrames = 0;  // --verify: requests whose CRC did not match
+    long droppedDatagrams = 0; // UDP: malformed requests and replies the socket refused
+    long acceptWakeups = 0;  // epoll: listener readiness events
+    long acceptCalls = 0;    // epoll: accept4 calls, including the one that drained the backlog
+    long localAccepts = 0;   // --steer: accepted on the CPU that ran the connection's softirq
+    long handedOff = 0;      // --steer handoff: accepted here, passed to the reactor on the softirq CPU
+    long relayedUp = 0;      // relay: bytes forwarded from clients to the upstream server
+    long relayedDown = 0;    // relay: bytes forwarded from the upstream server to clients
+    long eventWakeups = 0;   // epoll: waits that returned events
+    long fullWakeups = 0;    // epoll: waits that returned maxEvents events
+    long eventsHandled = 0;  // epoll: events returned by the waits
+    long eventNs = 0;        // --interval: time spent handling them
+
+    ReactorStats& operator+=(const ReactorStats& other) {
+        totalConnections += other.totalConnections;
+        activeConnections += other.activeConnections;
+        totalBytesProcessed += other.totalBytesProcessed;
+        messagesProcessed += other.messagesProcessed;
+        epollWaitCalls += other.epollWaitCalls;
+        epollCtlCalls += other.epollCtlCalls;
+        ioSyscalls += other.ioSyscalls;
+        corruptFrames += other.corruptFrames;
+        droppedDatagrams += other.droppedDatagrams;
+        acceptWakeups += other.acceptWakeups;
+        acceptCalls += other.acceptCalls;
+        localAccepts += other.localAccepts;
+        handedOff += other.handedOff;
+        relayedUp += other.relayedUp;
+        relayedDown += other.relayedDown;
+        eventWakeups += other.eventWakeups;
+        fullWakeups += other.fullWakeups;
+        eventsHandled += other.eventsHandled;
+        eventNs += other.eventNs;
+        return *this;
+    }
+};
+
+// Add to a ReactorStats counter. Only the owning reactor writes its
+// counters while the main thread reads them for the interval lines and the
+// stats segment; a relaxed atomic store of the new value makes that
+// race-free and still compiles to a plain add and store.
+inline void countStat(long& counter, long amount = 1) {
+    __atomic_store_n(&counter, counter + amount, __ATOMIC_RELAXED);
+}
+
+// How connections find the reactor pinned to the CPU that runs their softirq:
+// Off leaves it to the SO_REUSEPORT hash, Listener sets SO_INCOMING_CPU on
+// each listener so the kernel picks the one of the receiving CPU, and Handoff
+// additionally moves an accepted socket that still landed on the wrong
+// reactor to the right one
+enum class SteerMode {
+    Off,
+    Listener,
+    Handoff
+};
+
+enum class RelayMode {
+    Splice, // socket -> pipe -> socket with splice(), the payload stays in the kernel
+    Copy    // recv into the connection's buffer, then send
+};
+
+// --relay: forward every accepted connection to an upstream server instead
+// of answering it
+struct RelayTarget {
+    sockaddr_in address;
+    RelayMode mode = RelayMode::Splice;
+};
+
+// Sockets handed to a reactor by the others; eventFd wakes its epoll loop
+struct HandoffInbox {
+    std::mutex mutex;
+    std::vector<int> sockets;
+    int eventFd = -1;
+};
+
+// One event loop: its own listening socket (the bound datagram socket in UDP
+// mode), epoll instance and connection table
+struct Reactor {
+    int id = 0;
+    int cpu = -1; // -1 = not pinned
+    int listenSocket = -1;
+    int epollFd = -1;
+    bool batch = false; // send right after processing instead of toggling EPOLLOUT
+    size_t maxFrame = DEFAULT_MAX_FRAME_SIZE;
+    size_t bufferCapacity = 0; // per direction, at least maxFrame
+    bool verify = false;       // payloads carry a VerifyBlock
+    uint64_t verifySeed = 0;
+    Keystream keystream;       // payload transform
+    ConnectionTable<ClientData> clients;
+    ZeroCopyPool zeroCopy;     // --zerocopy: reply buffers, epoll engine only
+    Poller poller;             // --poll: how the epoll and UDP loops wait
+    StatsSegment* shared = nullptr; // --stats-shm: per-connection slots; unmapped without the option
+    SteerMode steer = SteerMode::Off;
+    const std::vector<Reactor*>* cpuReactors = nullptr; // --steer handoff: reactor pinned to each CPU, or nullptr
+    HandoffInbox inbox;        // --steer handoff: connections accepted by other reactors
+    LocalitySampler locality;  // --locality: softirq CPU versus reactor CPU
+    TraceRing trace;           // --trace: this reactor's event ring, epoll engine only
+    const RelayTarget* relay = nullptr; // --relay: forward connections, epoll engine only
+    int maxEvents = DEFAULT_MAX_EVENTS; // epoll events per wait
+    bool timeEvents = false;   // --interval: clock the handling of each wakeup's events
+    ReactorStats stats;
+};
+
+// Event loop implementation used by the reactors
+enum class Engine {
+    Epoll,
+    Uring
+};
+
+enum class Transport {
+    Tcp,
+    Udp
+};
+
+// Server command line options
+struct ServerOptions {
+    int threads = 1;
+    std::vector<int> cpus;
+    Transport transport = Transport::Tcp;
+    Engine engine = Engine::Epoll;
+    bool sqpoll = false;
+    bool batch = false;
+    std::string host = DEFAULT_SERVER_IP;
+    int port = DEFAULT_SERVER_PORT;
+    size_t maxFrame = DEFAULT_MAX_FRAME_SIZE;
+    bool verify = false;
+    uint64_t verifySeed = 0;
+    int mmsgBatch = DEFAULT_MMSG_BATCH; // UDP: datagrams per recvmmsg/sendmmsg
+    bool gso = false;                   // UDP: coalesce replies with UDP_SEGMENT
+    bool gro = false;                   // UDP: accept UDP_GRO super-packets
+    bool zerocopy = false;              // send replies with MSG_ZEROCOPY
+    int zerocopyBuffers = DEFAULT_ZEROCOPY_BUFFERS;
+    PollOptions poll;
+    int interval = 0;                   // seconds between throughput and softirq lines, 0 = summary only
+    std::string statsShm;               // shared memory segment for live counters, empty = none
+    SteerMode steer = SteerMode::Off;   // --steer: connection placement by softirq CPU
+    bool locality = false;              // sample the softirq CPU of processed messages
+    std::string traceFile;              // per-reactor event trace, empty = off
+    long traceRecords = DEFAULT_TRACE_RECORDS;
+    std::string relay;                  // upstream HOST:PORT to forward connections to, empty = echo
+    RelayMode relayMode = RelayMode::Splice;
+    int maxEvents = DEFAULT_MAX_EVENTS; // epoll events per wait
+    long maxConnections = 0;            // raise RLIMIT_NOFILE to hold this many, 0 = keep the limit
+    std::vector<int> softirqCpus;       // CPUs the softirq figures cover, empty = all
+    bool perfCounters = false;          // perf_event_open counters per run phase
+};
+
+// Longest a blocking wait may sleep, so reactors notice shutdown
+constexpr uint64_t BLOCK_TIMEOUT_NS = 100000000;
+
+bool setNonBlocking(int socket);
+bool setTcpNoDelay(int socket);
+
+// Mutate a received message in place before echoing it back
+void transformPayload(Keystream& keystream, unsigned char* data, size_t size);
+
+// Write the reply to a complete request frame: a frame of header.replyLength
+// bytes carrying the transformed request payload, truncated or zero-padded.
+// reply may equal request. Returns the reply size.
+size_t buildReply(Reactor& reactor, const unsigned char* request, const FrameHeader& header, unsigned char* reply);
+
+// Print the per-connection memory footprint of an engine's connection table
+void printTableFootprint(const char* engine, size_t bytesPerConnection, size_t stateBytes,
+                         size_t bufferBytes, size_t capacity);
+
+// io_uring engine (server_uring.cpp)
+
+// Check that the kernel supports everything the io_uring engine needs
+// (multishot accept/recv and provided buffer rings); fills reason if not
+bool uringSupported(std::string& reason);
+
+// Run the reactor on io_uring until shutdown; returns false if the ring
+// could not be set up, in which case the caller falls back to epoll
+bool runUringReactor(Reactor& reactor, const ServerOptions& options);
+
+// UDP transport (server_udp.cpp)
+
+// Create the reactor's bound datagram socket
+bool setupUdpReactor(Reactor& reactor, bool reusePort, const ServerOptions& options);
+
+// Answer datagrams with recvmmsg/sendmmsg until shutdown
+void runUdpReactor(Reactor& reactor, const ServerOptions& options);
+
+#endif // SERVER_H
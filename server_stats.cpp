@@ -0,0 +1,209 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstdlib>
+#include <thread>
+#include <chrono>
+#include <unistd.h>
+#include "cli.h"
+#include "statsshm.h"
+
+// Attaches to the stats segment of a server started with --stats-shm and
+// prints its rates every interval. The segment is only read, so watching a
+// server does not slow it down.
+
+struct StatsOptions {
+    std::string name;
+    int interval = 1;
+    long count = 0; // reports before exiting, 0 = until the server exits
+    int top = 0;    // busiest connections listed per report
+};
+
+void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " NAME [--interval S] [--count N] [--top N]\n"
+              << "  NAME           stats segment given to the server with --stats-shm, e.g. /softirq-server\n"
+              << "  --interval S   seconds between reports (default: 1)\n"
+              << "  --count N      exit after N reports, 0 = run until the server exits (default: 0)\n"
+              << "  --top N        also list the N busiest connections of each interval (default: 0)\n";
+}
+
+bool parseOptions(int argc, char* argv[], StatsOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        long value = 0;
+        if (arg == "--interval") {
+            if (!parseIntOption("--interval", optionValue(argc, argv, i), 1, 3600, value)) {
+                return false;
+            }
+            options.interval = static_cast<int>(value);
+        } else if (arg == "--count") {
+            if (!parseIntOption("--count", optionValue(argc, argv, i), 0, LONG_MAX, options.count)) {
+                return false;
+            }
+        } else if (arg == "--top") {
+            if (!parseIntOption("--top", optionValue(argc, argv, i), 0, 1000000, value)) {
+                return false;
+            }
+            options.top = static_cast<int>(value);
+        } else if (arg == "--help" || arg == "-h") {
+            printUsage(argv[0]);
+            std::exit(0);
+        } else if (arg[0] != '-' && options.name.empty()) {
+            options.name = arg;
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            printUsage(argv[0]);
+            return false;
+        }
+    }
+    if (options.name.empty()) {
+        printUsage(argv[0]);
+        return false;
+    }
+    return true;
+}
+
+struct ReactorSnapshot {
+    uint64_t totalConnections = 0;
+    uint64_t activeConnections = 0;
+    uint64_t messages = 0;
+    uint64_t bytes = 0;
+    uint64_t waitCalls = 0;
+};
+
+ReactorSnapshot readReactor(const SharedReactorStats& shared) {
+    ReactorSnapshot snapshot;
+    snapshot.totalConnections = sharedLoad(shared.totalConnections);
+    snapshot.activeConnections = sharedLoad(shared.activeConnections);
+    snapshot.messages = sharedLoad(shared.messages);
+    snapshot.bytes = sharedLoad(shared.bytes);
+    snapshot.waitCalls = sharedLoad(shared.waitCalls);
+    return snapshot;
+}
+
+// Last seen counters of one connection slot; openedNs tells a reused fd apart
+struct ConnectionSnapshot {
+    uint64_t openedNs = 0;
+    uint64_t messages = 0;
+    uint64_t bytes = 0;
+};
+
+struct ConnectionRate {
+    int fd;
+    uint32_t reactor;
+    double messages;
+    double bytes;
+    double ageSeconds;
+};
+
+void printRates(const std::string& label, const ReactorSnapshot& now, const ReactorSnapshot& last, double seconds) {
+    double messages = static_cast<double>(now.messages - last.messages);
+    std::cout << label << static_cast<long>(messages / seconds) << " msgs/s, "
+              << static_cast<long>((now.bytes - last.bytes) / 1024.0 / seconds) << " KB/s, "
+              << now.activeConnections << " active connections, "
+              << (now.totalConnections - last.totalConnections) / seconds << " accepts/s";
+    if (messages > 0 && now.waitCalls > last.waitCalls) { // io_uring reactors count no waits
+        std::cout << ", " << std::setprecision(2) << (now.waitCalls - last.waitCalls) / messages
+                  << " waits/msg" << std::setprecision(1);
+    }
+    std::cout << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    StatsOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        return 1;
+    }
+    StatsSegment segment;
+    std::string error;
+    if (!segment.attach(options.name, error)) {
+        std::cerr << "Cannot attach to stats segment " << options.name << ": " << error << std::endl;
+        return 1;
+    }
+    const StatsSegmentHeader& header = *segment.header();
+    int reactors = static_cast<int>(header.reactors);
+    int slots = static_cast<int>(header.connectionSlots);
+    std::cout << "Server pid " << header.pid << ", " << reactors << " reactor(s), " << slots
+              << " connection slots" << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+
+    std::vector<ReactorSnapshot> last(reactors);
+    for (int i = 0; i < reactors; ++i) {
+        last[i] = readReactor(*segment.reactor(i));
+    }
+    std::vector<ConnectionSnapshot> lastConnections(slots);
+    for (long report = 1; options.count == 0 || report <= options.count; ++report) {
+        std::this_thread::sleep_for(std::chrono::seconds(options.interval));
+        if (kill(header.pid, 0) == -1 && errno == ESRCH) {
+            std::cout << "Server exited" << std::endl;
+            return 0;
+        }
+        double seconds = options.interval;
+
+        ReactorSnapshot total;
+        ReactorSnapshot totalLast;
+        std::vector<ReactorSnapshot> now(reactors);
+        for (int i = 0; i < reactors; ++i) {
+            now[i] = readReactor(*segment.reactor(i));
+            total.totalConnections += now[i].totalConnections;
+            total.activeConnections += now[i].activeConnections;
+            total.messages += now[i].messages;
+            total.bytes += now[i].bytes;
+            total.waitCalls += now[i].waitCalls;
+            totalLast.totalConnections += last[i].totalConnections;
+            totalLast.messages += last[i].messages;
+            totalLast.bytes += last[i].bytes;
+            totalLast.waitCalls += last[i].waitCalls;
+        }
+        printRates("[" + std::to_string(report * options.interval) + "s] ", total, totalLast, seconds);
+        if (reactors > 1) {
+            for (int i = 0; i < reactors; ++i) {
+                printRates("  reactor " + std::to_string(i) + ": ", now[i], last[i], seconds);
+            }
+        }
+        last = now;
+
+        // Rates of the connections open now; a slot reopened by a new
+        // connection starts from zero
+        std::vector<ConnectionRate> rates;
+        uint64_t clockNs = statsClockNs();
+        for (int fd = 0; fd < slots; ++fd) {
+            const SharedConnectionStats& slot = *segment.connection(fd);
+            uint32_t reactor = __atomic_load_n(&slot.reactor, __ATOMIC_ACQUIRE);
+            if (reactor == 0) {
+                continue;
+            }
+            ConnectionSnapshot current;
+            current.openedNs = sharedLoad(slot.openedNs);
+            current.messages = sharedLoad(slot.messages);
+            current.bytes = sharedLoad(slot.bytes);
+            ConnectionSnapshot previous = lastConnections[fd];
+            if (previous.openedNs != current.openedNs) {
+                previous = ConnectionSnapshot();
+            }
+            lastConnections[fd] = current;
+            ConnectionRate rate;
+            rate.fd = fd;
+            rate.reactor = reactor - 1;
+            rate.messages = (current.messages - previous.messages) / seconds;
+            rate.bytes = (current.bytes - previous.bytes) / seconds;
+            rate.ageSeconds = (clockNs - current.openedNs) / 1e9;
+            rates.push_back(rate);
+        }
+        size_t shown = std::min(rates.size(), static_cast<size_t>(options.top));
+        std::partial_sort(rates.begin(), rates.begin() + shown, rates.end(),
+                          [](const ConnectionRate& a, const ConnectionRate& b) { return a.messages > b.messages; });
+        for (size_t i = 0; i < shown; ++i) {
+            std::cout << "  fd " << rates[i].fd << " (reactor " << rates[i].reactor << "): "
+                      << static_cast<long>(rates[i].messages) << " msgs/s, "
+                      << static_cast<long>(rates[i].bytes / 1024) << " KB/s, open " << rates[i].ageSeconds << " s"
+                      << std::endl;
+        }
+    }
+    return 0;
+}
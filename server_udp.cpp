@@ -0,0 +1,264 @@
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <vector>
+#include "server.h"
+#include "udp.h"
+
+// UDP transport: every datagram is one request frame and its reply goes back
+// to the sender. Each reactor owns one bound socket (SO_REUSEPORT spreads
+// flows across reactors), pulls up to mmsgBatch datagrams per recvmmsg and
+// answers the whole batch with sendmmsg. With GSO, consecutive equal-size
+// replies to the same peer share one UDP_SEGMENT message; with GRO, the
+// kernel may hand over a super-packet that is split back into its segments.
+
+constexpr size_t REPLY_ARENA_SIZE = 1024 * 1024;
+constexpr size_t MAX_REPLY_MESSAGES = 1024; // sendmmsg limit (UIO_MAXIOV)
+constexpr int UDP_SOCKET_BUFFER = 4 * 1024 * 1024;
+
+// Datagrams of one recvmmsg call
+struct RecvBatch {
+    std::vector<mmsghdr> msgs;
+    std::vector<iovec> iovs;
+    std::vector<sockaddr_in> peers;
+    std::vector<unsigned char> controls;
+    std::vector<unsigned char> buffers;
+    size_t slotSize = 0;
+    size_t controlSize = 0;
+};
+
+// Replies waiting for the next sendmmsg; message i covers segments[i]
+// consecutive arena replies of segmentSize[i] bytes each
+struct ReplyBatch {
+    std::vector<mmsghdr> msgs;
+    std::vector<iovec> iovs;
+    std::vector<sockaddr_in> peers;
+    std::vector<unsigned char> controls;
+    std::vector<size_t> segments;
+    std::vector<size_t> segmentSize;
+    std::vector<unsigned char> arena;
+    size_t count = 0;
+    size_t used = 0;
+};
+
+bool setupUdpReactor(Reactor& reactor, bool reusePort, const ServerOptions& options) {
+    int udpSocket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (udpSocket == -1) {
+        std::cerr << "Failed to create UDP socket: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    int opt = 1;
+    if (reusePort && setsockopt(udpSocket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) == -1) {
+        std::cerr << "Failed to set SO_REUSEPORT: " << strerror(errno) << std::endl;
+        close(udpSocket);
+        return false;
+    }
+
+    if (!setNonBlocking(udpSocket)) {
+        close(udpSocket);
+        return false;
+    }
+    growSocketBuffers(udpSocket, UDP_SOCKET_BUFFER);
+
+    if (options.gro && !enableGro(udpSocket)) {
+        std::cerr << "Failed to enable UDP_GRO: " << strerror(errno) << std::endl;
+        close(udpSocket);
+        return false;
+    }
+
+    struct sockaddr_in serverAddr;
+    memset(&serverAddr, 0, sizeof(serverAddr));
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_port = htons(options.port);
+    if (inet_pton(AF_INET, options.host.c_str(), &serverAddr.sin_addr) <= 0) {
+        std::cerr << "Invalid address / Address not supported: " << strerror(errno) << std::endl;
+        close(udpSocket);
+        return false;
+    }
+
+    if (bind(udpSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) == -1) {
+        std::cerr << "Failed to bind UDP socket: " << strerror(errno) << std::endl;
+        close(udpSocket);
+        return false;
+    }
+
+    reactor.listenSocket = udpSocket;
+    return true;
+}
+
+static void initRecvBatch(RecvBatch& batch, size_t count, size_t slotSize, bool gro) {
+    batch.slotSize = slotSize;
+    batch.controlSize = gro ? CMSG_SPACE(sizeof(int)) : 0;
+    batch.msgs.assign(count, mmsghdr());
+    batch.iovs.resize(count);
+    batch.peers.resize(count);
+    batch.controls.assign(count * batch.controlSize, 0);
+    batch.buffers.resize(count * slotSize);
+    for (size_t i = 0; i < count; ++i) {
+        batch.iovs[i].iov_base = batch.buffers.data() + i * slotSize;
+        batch.iovs[i].iov_len = slotSize;
+        batch.msgs[i].msg_hdr.msg_iov = &batch.iovs[i];
+        batch.msgs[i].msg_hdr.msg_iovlen = 1;
+        batch.msgs[i].msg_hdr.msg_name = &batch.peers[i];
+    }
+}
+
+// The kernel overwrites the name and control lengths on every receive
+static void resetRecvBatch(RecvBatch& batch, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        msghdr& hdr = batch.msgs[i].msg_hdr;
+        hdr.msg_namelen = sizeof(sockaddr_in);
+        hdr.msg_control = batch.controlSize > 0 ? batch.controls.data() + i * batch.controlSize : nullptr;
+        hdr.msg_controllen = batch.controlSize;
+        hdr.msg_flags = 0;
+    }
+}
+
+static void initReplyBatch(ReplyBatch& batch) {
+    batch.msgs.assign(MAX_REPLY_MESSAGES, mmsghdr());
+    batch.iovs.resize(MAX_REPLY_MESSAGES);
+    batch.peers.resize(MAX_REPLY_MESSAGES);
+    batch.controls.assign(MAX_REPLY_MESSAGES * GSO_CONTROL_SIZE, 0);
+    batch.segments.assign(MAX_REPLY_MESSAGES, 0);
+    batch.segmentSize.assign(MAX_REPLY_MESSAGES, 0);
+    batch.arena.resize(REPLY_ARENA_SIZE);
+}
+
+static inline bool samePeer(const sockaddr_in& a, const sockaddr_in& b) {
+    return a.sin_addr.s_addr == b.sin_addr.s_addr && a.sin_port == b.sin_port;
+}
+
+// Queue the reply just written at arena + used, extending the previous GSO
+// message when it goes to the same peer with the same size
+static void queueReply(ReplyBatch& batch, const sockaddr_in& peer, size_t size, bool gso) {
+    if (gso && batch.count > 0) {
+        size_t last = batch.count - 1;
+        if (samePeer(batch.peers[last], peer) && batch.segmentSize[last] == size
+            && batch.segments[last] < gsoSegmentsFor(size)) {
+            batch.iovs[last].iov_len += size;
+            batch.segments[last]++;
+            batch.used += size;
+            return;
+        }
+    }
+    size_t index = batch.count++;
+    batch.iovs[index].iov_base = batch.arena.data() + batch.used;
+    batch.iovs[index].iov_len = size;
+    batch.peers[index] = peer;
+    batch.segments[index] = 1;
+    batch.segmentSize[index] = size;
+    batch.used += size;
+}
+
+// Send every queued reply; whatever the socket refuses is dropped, as a
+// real datagram service would
+static void flushReplies(Reactor& reactor, ReplyBatch& batch) {
+    for (size_t i = 0; i < batch.count; ++i) {
+        msghdr& hdr = batch.msgs[i].msg_hdr;
+        hdr.msg_name = &batch.peers[i];
+        hdr.msg_namelen = sizeof(sockaddr_in);
+        hdr.msg_iov = &batch.iovs[i];
+        hdr.msg_iovlen = 1;
+        if (batch.segments[i] > 1) {
+            setGsoSegment(hdr, batch.controls.data() + i * GSO_CONTROL_SIZE,
+                          static_cast<uint16_t>(batch.segmentSize[i]));
+        } else {
+            hdr.msg_control = nullptr;
+            hdr.msg_controllen = 0;
+        }
+    }
+
+    size_t sent = 0;
+    while (sent < batch.count) {
+        int n = sendmmsg(reactor.listenSocket, &batch.msgs[sent], batch.count - sent, MSG_DONTWAIT);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS && errno != ECONNREFUSED) {
+                std::cerr << "[reactor " << reactor.id << "] sendmmsg failed: " << strerror(errno) << std::endl;
+            }
+            break;
+        }
+        countStat(reactor.stats.ioSyscalls);
+        for (int i = 0; i < n; ++i) {
+            countStat(reactor.stats.totalBytesProcessed, batch.iovs[sent + i].iov_len);
+        }
+        sent += n;
+    }
+    for (size_t i = sent; i < batch.count; ++i) {
+        countStat(reactor.stats.droppedDatagrams, batch.segments[i]);
+    }
+    batch.count = 0;
+    batch.used = 0;
+}
+
+// Answer one request frame of exactly size bytes
+static void answerDatagram(Reactor& reactor, ReplyBatch& batch, const unsigned char* data, size_t size,
+                           const sockaddr_in& peer, bool gso) {
+    FrameHeader header;
+    if (parseFrame(data, size, reactor.maxFrame, header) != FrameStatus::Complete || header.length != size
+        || header.length < MIN_DATAGRAM_FRAME || header.replyLength < MIN_DATAGRAM_FRAME) {
+        countStat(reactor.stats.droppedDatagrams);
+        return;
+    }
+    if (batch.count == MAX_REPLY_MESSAGES || batch.arena.size() - batch.used < header.replyLength) {
+        flushReplies(reactor, batch);
+    }
+    unsigned char* reply = batch.arena.data() + batch.used;
+    size_t replySize = buildReply(reactor, data, header, reply);
+    // The sequence number goes back untouched; verified replies keep it anyway
+    writeDatagramSequence(reply, readDatagramSequence(data));
+    queueReply(batch, peer, replySize, gso);
+    countStat(reactor.stats.messagesProcessed);
+    reactor.locality.message(reactor.listenSocket);
+}
+
+void runUdpReactor(Reactor& reactor, const ServerOptions& options) {
+    size_t count = static_cast<size_t>(options.mmsgBatch);
+    RecvBatch recvBatch;
+    initRecvBatch(recvBatch, count, options.gro ? GRO_BUFFER_SIZE : reactor.maxFrame, options.gro);
+    ReplyBatch replyBatch;
+    initReplyBatch(replyBatch);
+
+    // Spin on non-blocking reads or sleep in poll() first, depending on --poll
+    while (g_running) {
+        if (reactor.poller.waitReadable(reactor.listenSocket, BLOCK_TIMEOUT_NS) <= 0) {
+            continue;
+        }
+        resetRecvBatch(recvBatch, count);
+        int received = recvmmsg(reactor.listenSocket, recvBatch.msgs.data(), count, MSG_DONTWAIT, nullptr);
+        reactor.poller.readDone(received > 0);
+        if (received <= 0) {
+            if (received == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                std::cerr << "[reactor " << reactor.id << "] recvmmsg failed: " << strerror(errno) << std::endl;
+                break;
+            }
+            continue;
+        }
+        countStat(reactor.stats.ioSyscalls);
+
+        for (int i = 0; i < received; ++i) {
+            msghdr& hdr = recvBatch.msgs[i].msg_hdr;
+            size_t length = recvBatch.msgs[i].msg_len;
+            if (length == 0 || (hdr.msg_flags & MSG_TRUNC)) {
+                countStat(reactor.stats.droppedDatagrams);
+                continue;
+            }
+            const unsigned char* data = recvBatch.buffers.data() + i * recvBatch.slotSize;
+            const sockaddr_in& peer = recvBatch.peers[i];
+            size_t segment = options.gro ? groSegmentSize(hdr, length) : length;
+            for (size_t offset = 0; offset < length; offset += segment) {
+                answerDatagram(reactor, replyBatch, data + offset, std::min(segment, length - offset), peer,
+                               options.gso);
+            }
+        }
+        flushReplies(reactor, replyBatch);
+    }
+}
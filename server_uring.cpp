@@ -0,0 +1,591 @@
+#include <iostream>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "server.h"
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#endif
+
+#if defined(HAVE_LINUX_IO_URING_H) && defined(IORING_RECV_MULTISHOT) && defined(__NR_io_uring_setup)
+
+// The io_uring engine talks to the kernel through raw syscalls so that it
+// has no dependency on liburing. It uses one multishot accept on the
+// listener, one multishot recv per connection that picks its buffers from a
+// provided buffer ring, and sends replies as a chain of linked SQEs.
+
+constexpr unsigned RING_ENTRIES = 4096;
+constexpr unsigned BUF_RING_ENTRIES = 4096; // must be a power of two
+constexpr unsigned RECV_BUFFER_SIZE = 2048;
+constexpr unsigned short BUFFER_GROUP = 0;
+constexpr size_t SEND_CHUNK = 65536;        // replies larger than this go out as linked sends
+constexpr size_t MIN_REPLY_CAPACITY = 256 * 1024; // per-connection reply backlog, room for deep pipelines
+constexpr unsigned SQPOLL_IDLE_MS = 1000;
+
+// Operation encoded in the upper half of the SQE user_data, fd in the lower
+enum UringOp : uint64_t {
+    OP_ACCEPT = 1,
+    OP_RECV = 2,
+    OP_SEND = 3
+};
+
+static inline uint64_t makeUserData(UringOp op, int fd) {
+    return (static_cast<uint64_t>(op) << 32) | static_cast<uint32_t>(fd);
+}
+
+// Mapped submission/completion rings plus the provided buffer ring
+struct Uring {
+    int fd = -1;
+    bool sqpoll = false;
+
+    void* sqRing = nullptr;
+    size_t sqRingSize = 0;
+    void* cqRing = nullptr;
+    size_t cqRingSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqesSize = 0;
+
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqFlags = nullptr;
+    unsigned sqMask = 0;
+    unsigned sqEntries = 0;
+    unsigned sqLocalTail = 0;    // SQEs prepared but not yet published
+    unsigned sqSubmitted = 0;    // SQEs published to the kernel
+
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    io_uring_buf_ring* bufRing = nullptr;
+    size_t bufRingSize = 0;
+    unsigned char* buffers = nullptr;
+    size_t buffersSize = 0;
+    unsigned bufEntries = 0;
+};
+
+// Connection state owned by the io_uring reactor. The three buffers live in
+// the connection's table slot: message (maxFrame bytes), then pending and
+// inflight (the reply capacity each).
+struct UringConnection {
+    unsigned char* message = nullptr;  // partially received request frame
+    unsigned char* pending = nullptr;  // replies waiting for the current sends to finish
+    unsigned char* inflight = nullptr; // replies owned by the kernel until their sends complete
+    size_t messageBytes = 0;
+    size_t frameLength = 0;            // once the header is in: size of the frame being received
+    size_t pendingBytes = 0;
+    size_t inflightBytes = 0;
+    int sendsOutstanding = 0;
+    bool recvArmed = false;
+    bool closing = false;
+    bool queued = false;                 // already on the flush list
+    SharedConnectionStats* shared = nullptr; // --stats-shm: this fd's slot, if it has one
+};
+
+static int uringSetupSyscall(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int uringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+static int uringRegister(int fd, unsigned opcode, void* arg, unsigned nrArgs) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs));
+}
+
+static void uringTeardown(Uring& ring) {
+    if (ring.fd != -1) close(ring.fd);
+    if (ring.buffers != nullptr) munmap(ring.buffers, ring.buffersSize);
+    if (ring.bufRing != nullptr) munmap(ring.bufRing, ring.bufRingSize);
+    if (ring.sqes != nullptr) munmap(ring.sqes, ring.sqesSize);
+    if (ring.cqRing != nullptr && ring.cqRing != ring.sqRing) munmap(ring.cqRing, ring.cqRingSize);
+    if (ring.sqRing != nullptr) munmap(ring.sqRing, ring.sqRingSize);
+    ring = Uring();
+}
+
+// Create the ring and map the SQ/CQ rings and the SQE array
+static bool uringSetup(Uring& ring, unsigned entries, bool sqpoll, std::string& error) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    if (sqpoll) {
+        params.flags |= IORING_SETUP_SQPOLL;
+        params.sq_thread_idle = SQPOLL_IDLE_MS;
+    }
+
+    ring.fd = uringSetupSyscall(entries, &params);
+    if (ring.fd < 0) {
+        error = std::string("io_uring_setup: ") + strerror(errno);
+        return false;
+    }
+    ring.sqpoll = sqpoll;
+
+    ring.sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring.cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMmap && ring.cqRingSize > ring.sqRingSize) {
+        ring.sqRingSize = ring.cqRingSize;
+    }
+
+    ring.sqRing = mmap(nullptr, ring.sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring.fd, IORING_OFF_SQ_RING);
+    if (ring.sqRing == MAP_FAILED) {
+        ring.sqRing = nullptr;
+        error = std::string("mmap SQ ring: ") + strerror(errno);
+        uringTeardown(ring);
+        return false;
+    }
+
+    if (singleMmap) {
+        ring.cqRing = ring.sqRing;
+    } else {
+        ring.cqRing = mmap(nullptr, ring.cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           ring.fd, IORING_OFF_CQ_RING);
+        if (ring.cqRing == MAP_FAILED) {
+            ring.cqRing = nullptr;
+            error = std::string("mmap CQ ring: ") + strerror(errno);
+            uringTeardown(ring);
+            return false;
+        }
+    }
+
+    ring.sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, ring.sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring.fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        error = std::string("mmap SQEs: ") + strerror(errno);
+        uringTeardown(ring);
+        return false;
+    }
+    ring.sqes = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(ring.sqRing);
+    ring.sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    ring.sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    ring.sqFlags = reinterpret_cast<unsigned*>(sq + params.sq_off.flags);
+    ring.sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    ring.sqEntries = params.sq_entries;
+    ring.sqLocalTail = ring.sqSubmitted = *ring.sqTail;
+
+    // SQE slots map one-to-one onto the index array
+    unsigned* array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    for (unsigned i = 0; i < params.sq_entries; ++i) {
+        array[i] = i;
+    }
+
+    char* cq = static_cast<char*>(ring.cqRing);
+    ring.cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    ring.cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    ring.cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    ring.cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    return true;
+}
+
+// Hand a provided buffer (back) to the kernel. The ring entries are indexed
+// from the ring base directly: in C++ the UAPI flexible-array wrapper puts
+// io_uring_buf_ring::bufs at the wrong offset.
+static inline void recycleBuffer(Uring& ring, unsigned short bid) {
+    unsigned short tail = ring.bufRing->tail;
+    io_uring_buf* buf = reinterpret_cast<io_uring_buf*>(ring.bufRing) + (tail & (ring.bufEntries - 1));
+    buf->addr = reinterpret_cast<uint64_t>(ring.buffers + static_cast<size_t>(bid) * RECV_BUFFER_SIZE);
+    buf->len = RECV_BUFFER_SIZE;
+    buf->bid = bid;
+    __atomic_store_n(&ring.bufRing->tail, static_cast<unsigned short>(tail + 1), __ATOMIC_RELEASE);
+}
+
+// Register a provided buffer ring that multishot recv picks buffers from
+static bool setupBufferRing(Uring& ring, unsigned entries, std::string& error) {
+    ring.bufEntries = entries;
+    ring.bufRingSize = entries * sizeof(io_uring_buf);
+    void* mem = mmap(nullptr, ring.bufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        error = std::string("mmap buffer ring: ") + strerror(errno);
+        return false;
+    }
+    ring.bufRing = static_cast<io_uring_buf_ring*>(mem);
+
+    ring.buffersSize = static_cast<size_t>(entries) * RECV_BUFFER_SIZE;
+    mem = mmap(nullptr, ring.buffersSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        error = std::string("mmap buffers: ") + strerror(errno);
+        return false;
+    }
+    ring.buffers = static_cast<unsigned char*>(mem);
+
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring.bufRing);
+    reg.ring_entries = entries;
+    reg.bgid = BUFFER_GROUP;
+    if (uringRegister(ring.fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        error = std::string("IORING_REGISTER_PBUF_RING: ") + strerror(errno);
+        return false;
+    }
+
+    for (unsigned i = 0; i < entries; ++i) {
+        recycleBuffer(ring, static_cast<unsigned short>(i));
+    }
+    return true;
+}
+
+// Publish prepared SQEs and let the kernel process them. Without SQPOLL this
+// is one io_uring_enter per loop iteration, the counterpart of the epoll
+// engine's zero-timeout epoll_wait.
+static bool uringSubmit(Uring& ring) {
+    __atomic_store_n(ring.sqTail, ring.sqLocalTail, __ATOMIC_RELEASE);
+    unsigned toSubmit = ring.sqLocalTail - ring.sqSubmitted;
+    ring.sqSubmitted = ring.sqLocalTail;
+
+    if (ring.sqpoll) {
+        if (__atomic_load_n(ring.sqFlags, __ATOMIC_ACQUIRE) & IORING_SQ_NEED_WAKEUP) {
+            return uringEnter(ring.fd, 0, 0, IORING_ENTER_SQ_WAKEUP) >= 0 || errno == EINTR;
+        }
+        return true;
+    }
+    return uringEnter(ring.fd, toSubmit, 0, IORING_ENTER_GETEVENTS) >= 0 || errno == EINTR || errno == EBUSY;
+}
+
+// Get a zeroed SQE, flushing the submission queue if it is full
+static io_uring_sqe* uringGetSqe(Uring& ring) {
+    while (ring.sqLocalTail - __atomic_load_n(ring.sqHead, __ATOMIC_ACQUIRE) >= ring.sqEntries) {
+        if (!uringSubmit(ring)) {
+            return nullptr;
+        }
+    }
+    io_uring_sqe* sqe = &ring.sqes[ring.sqLocalTail & ring.sqMask];
+    ring.sqLocalTail++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+static bool armAccept(Uring& ring, int listenSocket) {
+    io_uring_sqe* sqe = uringGetSqe(ring);
+    if (sqe == nullptr) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listenSocket;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = makeUserData(OP_ACCEPT, listenSocket);
+    return true;
+}
+
+static bool armRecv(Uring& ring, int clientSocket) {
+    io_uring_sqe* sqe = uringGetSqe(ring);
+    if (sqe == nullptr) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = clientSocket;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = makeUserData(OP_RECV, clientSocket);
+    return true;
+}
+
+// Send everything in conn.inflight. Large batches are split into chunks whose
+// SQEs are linked so the kernel runs them strictly in order.
+static bool submitSends(Uring& ring, int clientSocket, UringConnection& conn) {
+    size_t total = conn.inflightBytes;
+    for (size_t offset = 0; offset < total; offset += SEND_CHUNK) {
+        size_t len = total - offset < SEND_CHUNK ? total - offset : SEND_CHUNK;
+        io_uring_sqe* sqe = uringGetSqe(ring);
+        if (sqe == nullptr) {
+            return false;
+        }
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = clientSocket;
+        sqe->addr = reinterpret_cast<uint64_t>(conn.inflight + offset);
+        sqe->len = static_cast<unsigned>(len);
+        sqe->msg_flags = MSG_WAITALL;
+        if (offset + len < total) {
+            sqe->flags = IOSQE_IO_LINK;
+        }
+        sqe->user_data = makeUserData(OP_SEND, clientSocket);
+        conn.sendsOutstanding++;
+    }
+    return true;
+}
+
+bool uringSupported(std::string& reason) {
+    // Probe on a socketpair: old kernels reject multishot recv with -EINVAL
+    Uring ring;
+    if (!uringSetup(ring, 8, false, reason)) {
+        return false;
+    }
+    if (!setupBufferRing(ring, 2, reason)) {
+        uringTeardown(ring);
+        return false;
+    }
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+        reason = std::string("socketpair: ") + strerror(errno);
+        uringTeardown(ring);
+        return false;
+    }
+
+    bool supported = false;
+    if (armRecv(ring, sv[0]) && uringSubmit(ring) && write(sv[1], "x", 1) == 1
+        && uringEnter(ring.fd, 0, 1, IORING_ENTER_GETEVENTS) >= 0) {
+        unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+        if (*ring.cqHead != tail) {
+            const io_uring_cqe& cqe = ring.cqes[*ring.cqHead & ring.cqMask];
+            supported = cqe.res == 1 && (cqe.flags & IORING_CQE_F_MORE);
+            if (!supported) {
+                reason = cqe.res < 0 ? std::string("multishot recv: ") + strerror(-cqe.res)
+                                     : std::string("multishot recv not supported");
+            }
+        } else {
+            reason = "no completion from probe";
+        }
+    } else {
+        reason = std::string("probe submission failed: ") + strerror(errno);
+    }
+
+    close(sv[0]);
+    close(sv[1]);
+    uringTeardown(ring);
+    return supported;
+}
+
+bool runUringReactor(Reactor& reactor, const ServerOptions& options) {
+    Uring ring;
+    std::string error;
+    if (!uringSetup(ring, RING_ENTRIES, options.sqpoll, error) || !setupBufferRing(ring, BUF_RING_ENTRIES, error)) {
+        std::cerr << "[reactor " << reactor.id << "] " << error << std::endl;
+        uringTeardown(ring);
+        return false;
+    }
+
+    // The backlog holds at least two maximum-size replies
+    size_t replyCapacity = std::max(MIN_REPLY_CAPACITY, 2 * reactor.maxFrame);
+    ConnectionTable<UringConnection> connections;
+    if (!connections.init(reactor.maxFrame + 2 * replyCapacity)) {
+        std::cerr << "Failed to reserve connection table: " << strerror(errno) << std::endl;
+        uringTeardown(ring);
+        return false;
+    }
+    if (reactor.id == 0) {
+        printTableFootprint("io_uring", connections.bytesPerConnection(), connections.stateBytes(),
+                            connections.bufferBytes(), connections.capacity());
+    }
+    std::vector<int> flushList;
+
+    // Drop a connection once its recv has terminated and no send is in flight
+    auto maybeClose = [&](int clientSocket, UringConnection& conn) {
+        if (!conn.closing || conn.recvArmed || conn.sendsOutstanding > 0) {
+            return;
+        }
+        closeSharedConnection(conn.shared);
+        close(clientSocket);
+        connections.release(clientSocket);
+        countStat(reactor.stats.activeConnections, -1);
+    };
+
+    // Start closing: shutting the socket down terminates the multishot recv
+    auto startClose = [&](int clientSocket, UringConnection& conn) {
+        if (!conn.closing) {
+            conn.closing = true;
+            shutdown(clientSocket, SHUT_RDWR);
+        }
+    };
+
+    if (!armAccept(ring, reactor.listenSocket)) {
+        uringTeardown(ring);
+        return false;
+    }
+
+    while (g_running) {
+        if (!uringSubmit(ring)) {
+            std::cerr << "io_uring_enter failed: " << strerror(errno) << std::endl;
+            break;
+        }
+
+        unsigned head = *ring.cqHead;
+        unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = ring.cqes[head & ring.cqMask];
+            UringOp op = static_cast<UringOp>(cqe.user_data >> 32);
+            int fd = static_cast<int>(cqe.user_data & 0xffffffffu);
+            bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+
+            if (op == OP_ACCEPT) {
+                if (cqe.res >= 0) {
+                    int clientSocket = cqe.res;
+                    // TCP_NODELAY is inherited from the listener
+                    UringConnection* slot = connections.open(clientSocket);
+                    if (slot == nullptr) {
+                        close(clientSocket);
+                    } else {
+                        UringConnection& conn = *slot;
+                        conn.message = connections.buffer(clientSocket);
+                        conn.pending = conn.message + reactor.maxFrame;
+                        conn.inflight = conn.pending + replyCapacity;
+                        conn.recvArmed = armRecv(ring, clientSocket);
+                        conn.shared = reactor.shared->connection(clientSocket);
+                        openSharedConnection(conn.shared, reactor.id, clientSocket);
+                        countStat(reactor.stats.totalConnections);
+                        countStat(reactor.stats.activeConnections);
+                        if (reactor.steer != SteerMode::Off && incomingCpu(clientSocket) == reactor.cpu) {
+                            countStat(reactor.stats.localAccepts);
+                        }
+                        if (!conn.recvArmed) {
+                            startClose(clientSocket, conn);
+                            maybeClose(clientSocket, conn);
+                        }
+                    }
+                } else if (cqe.res != -EAGAIN && cqe.res != -EINTR) {
+                    std::cerr << "Failed to accept connection: " << strerror(-cqe.res) << std::endl;
+                }
+                if (!more) {
+                    armAccept(ring, reactor.listenSocket);
+                }
+                continue;
+            }
+
+            UringConnection* slot = connections.find(fd);
+            if (slot == nullptr) {
+                if ((cqe.flags & IORING_CQE_F_BUFFER) && cqe.res > 0) {
+                    recycleBuffer(ring, static_cast<unsigned short>(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+                }
+                continue;
+            }
+            UringConnection& conn = *slot;
+
+            if (op == OP_RECV) {
+                if (cqe.res > 0) {
+                    unsigned short bid = static_cast<unsigned short>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                    const unsigned char* data = ring.buffers + static_cast<size_t>(bid) * RECV_BUFFER_SIZE;
+                    size_t size = static_cast<size_t>(cqe.res);
+
+                    // Reassemble frames across recv boundaries and queue the replies:
+                    // first the header, then the rest of the frame it announces
+                    while (size > 0 && !conn.closing) {
+                        size_t wanted = conn.messageBytes < FRAME_HEADER_SIZE ? FRAME_HEADER_SIZE : conn.frameLength;
+                        size_t take = wanted - conn.messageBytes;
+                        if (take > size) take = size;
+                        memcpy(conn.message + conn.messageBytes, data, take);
+                        conn.messageBytes += take;
+                        data += take;
+                        size -= take;
+                        if (conn.messageBytes < wanted) {
+                            break;
+                        }
+                        FrameHeader header;
+                        FrameStatus status = parseFrame(conn.message, conn.messageBytes, reactor.maxFrame, header);
+                        if (status == FrameStatus::Invalid) {
+                            std::cerr << "Protocol error: invalid frame header (fd: " << fd << ")" << std::endl;
+                            startClose(fd, conn);
+                            break;
+                        }
+                        if (status == FrameStatus::Incomplete) {
+                            conn.frameLength = header.length;
+                            continue;
+                        }
+                        if (conn.pendingBytes + header.replyLength > replyCapacity) {
+                            std::cerr << "Reply backlog full (fd: " << fd << ")" << std::endl;
+                            startClose(fd, conn);
+                            break;
+                        }
+                        conn.pendingBytes += buildReply(reactor, conn.message, header, conn.pending + conn.pendingBytes);
+                        countStat(reactor.stats.messagesProcessed);
+                        reactor.locality.message(fd);
+                        countSharedMessages(conn.shared, 1, 0);
+                        conn.messageBytes = 0;
+                        conn.frameLength = 0;
+                    }
+                    recycleBuffer(ring, bid);
+
+                    if (conn.pendingBytes > 0 && !conn.queued) {
+                        conn.queued = true;
+                        flushList.push_back(fd);
+                    }
+                }
+                if (!more) {
+                    // Out of provided buffers: re-arm; EOF or error: close
+                    if (cqe.res == -ENOBUFS && !conn.closing) {
+                        conn.recvArmed = armRecv(ring, fd);
+                    } else if (cqe.res > 0 && !conn.closing) {
+                        conn.recvArmed = armRecv(ring, fd);
+                    } else {
+                        conn.recvArmed = false;
+                        if (cqe.res < 0 && cqe.res != -ECONNRESET) {
+                            std::cerr << "Error reading from client (fd: " << fd
+                                      << "): " << strerror(-cqe.res) << std::endl;
+                        }
+                        startClose(fd, conn);
+                    }
+                    maybeClose(fd, conn);
+                }
+            } else if (op == OP_SEND) {
+                conn.sendsOutstanding--;
+                if (cqe.res > 0) {
+                    countStat(reactor.stats.totalBytesProcessed, cqe.res);
+                    countSharedMessages(conn.shared, 0, static_cast<uint64_t>(cqe.res));
+                } else if (cqe.res < 0 && !conn.closing) {
+                    std::cerr << "Error sending to client (fd: " << fd
+                              << "): " << strerror(-cqe.res) << std::endl;
+                    startClose(fd, conn);
+                }
+                if (conn.sendsOutstanding == 0) {
+                    conn.inflightBytes = 0;
+                    if (conn.pendingBytes > 0 && !conn.queued && !conn.closing) {
+                        conn.queued = true;
+                        flushList.push_back(fd);
+                    }
+                }
+                maybeClose(fd, conn);
+            }
+        }
+        __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+
+        // Start sends for connections with queued replies and an idle send path
+        for (int clientSocket : flushList) {
+            UringConnection* slot = connections.find(clientSocket);
+            if (slot == nullptr) {
+                continue;
+            }
+            UringConnection& conn = *slot;
+            conn.queued = false;
+            if (conn.sendsOutstanding == 0 && conn.pendingBytes > 0 && !conn.closing) {
+                std::swap(conn.inflight, conn.pending);
+                std::swap(conn.inflightBytes, conn.pendingBytes);
+                if (!submitSends(ring, clientSocket, conn)) {
+                    startClose(clientSocket, conn);
+                }
+            }
+        }
+        flushList.clear();
+    }
+
+    // Closing the ring cancels every outstanding request
+    connections.forEach([](int clientSocket, UringConnection&) {
+        close(clientSocket);
+    });
+    uringTeardown(ring);
+    return true;
+}
+
+#else
+
+bool uringSupported(std::string& reason) {
+    reason = "built without io_uring support";
+    return false;
+}
+
+bool runUringReactor(Reactor&, const ServerOptions&) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,592 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <climits>
+#include <csignal>
+#include <thread>
+#include <chrono>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "config.h"
+#include "cli.h"
+#include "polling.h"
+#include "protocol.h"
+
+// Benchmark driver: starts server and client on loopback for every
+// combination of the swept parameters, runs a warmup and several measured
+// repetitions, and writes one record per configuration. With a baseline it
+// fails when throughput dropped by more than the tolerance.
+
+constexpr int SERVER_START_TIMEOUT_MS = 5000;
+constexpr int SERVER_STOP_TIMEOUT_MS = 5000;
+
+struct BenchOptions {
+    std::vector<int> sizes = std::vector<int>(1, static_cast<int>(DEFAULT_MESSAGE_SIZE));
+    std::vector<int> connections = std::vector<int>(1, 1);
+    std::vector<int> threads = std::vector<int>(1, 1);
+    std::vector<std::string> pollModes = std::vector<std::string>(1, "block");
+    std::string serverCpus;
+    std::string clientCpus;
+    int duration = 3;
+    int warmup = 1;
+    int repeat = 3;
+    int port = DEFAULT_SERVER_PORT + 100;
+    std::string binDir;
+    std::string jsonOut;
+    std::string csvOut;
+    std::string baseline;
+    double tolerance = 20; // percent
+};
+
+// One point of the sweep
+struct BenchConfig {
+    int size;
+    int connections;
+    int threads;
+    std::string poll;
+
+    std::string key() const {
+        return std::to_string(size) + "/" + std::to_string(connections) + "/" + std::to_string(threads) + "/" + poll;
+    }
+};
+
+// One measured client run, as written by client --result-out
+struct RunResult {
+    double rate = 0;
+    double p50 = 0;
+    double p99 = 0;
+    double p999 = 0;
+    double cpuUsPerMessage = 0;
+    double softirqNsPerMessage = 0;
+};
+
+struct BenchRecord {
+    BenchConfig config;
+    std::vector<RunResult> runs;
+    double meanRate = 0;
+    double minRate = 0;
+    double maxRate = 0;
+    double stddevRate = 0;
+    RunResult mean; // every field averaged over the runs
+    double baselineRate = -1; // -1 = no baseline for this configuration
+    bool regressed = false;
+};
+
+void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [--sizes LIST] [--connections LIST] [--threads LIST] [--poll LIST]\n"
+              << "       [--server-cpus LIST] [--client-cpus LIST] [--duration S] [--warmup S] [--repeat N]\n"
+              << "       [--port N] [--bin DIR] [--json FILE] [--csv FILE] [--baseline FILE] [--tolerance PCT]\n"
+              << "  --sizes LIST        request frame sizes in bytes (default: " << DEFAULT_MESSAGE_SIZE << ")\n"
+              << "  --connections LIST  client connection counts (default: 1)\n"
+              << "  --threads LIST      reactor and worker thread counts, used on both sides (default: 1)\n"
+              << "  --poll LIST         polling modes, e.g. block,hybrid,spin (default: block)\n"
+              << "  --server-cpus LIST  pin the server's reactors to these CPUs (default: no pinning)\n"
+              << "  --client-cpus LIST  pin the client's workers to these CPUs (default: no pinning)\n"
+              << "  --duration S        seconds per measured run (default: 3)\n"
+              << "  --warmup S          seconds of unrecorded traffic before the runs, 0 = none (default: 1)\n"
+              << "  --repeat N          measured runs per configuration (default: 3)\n"
+              << "  --port N            port for the benchmark server (default: " << DEFAULT_SERVER_PORT + 100 << ")\n"
+              << "  --bin DIR           directory holding the server and client binaries (default: this binary's)\n"
+              << "  --json FILE         write one JSON object per configuration, one per line\n"
+              << "  --csv FILE          write one CSV row per configuration; usable as a --baseline\n"
+              << "  --baseline FILE     CSV from an earlier run; fail if mean msgs/s fell by more than --tolerance\n"
+              << "  --tolerance PCT     allowed throughput drop against the baseline in percent (default: 20)\n";
+}
+
+bool parsePollList(const char* value, std::vector<std::string>& out) {
+    if (value == nullptr) {
+        return false;
+    }
+    out.clear();
+    std::istringstream list(value);
+    std::string mode;
+    while (std::getline(list, mode, ',')) {
+        PollMode parsed;
+        if (!parsePollMode(mode.c_str(), parsed)) {
+            std::cerr << "Unknown polling mode for --poll: " << mode << std::endl;
+            return false;
+        }
+        out.push_back(mode);
+    }
+    return !out.empty();
+}
+
+bool parseOptions(int argc, char* argv[], BenchOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        long value = 0;
+        if (arg == "--sizes") {
+            if (!parseIntListOption("--sizes", optionValue(argc, argv, i), FRAME_HEADER_SIZE, MAX_FRAME_LIMIT,
+                                    options.sizes)) {
+                return false;
+            }
+        } else if (arg == "--connections") {
+            if (!parseIntListOption("--connections", optionValue(argc, argv, i), 1, 100000, options.connections)) {
+                return false;
+            }
+        } else if (arg == "--threads") {
+            if (!parseIntListOption("--threads", optionValue(argc, argv, i), 1, 1024, options.threads)) {
+                return false;
+            }
+        } else if (arg == "--poll") {
+            if (!parsePollList(optionValue(argc, argv, i), options.pollModes)) {
+                return false;
+            }
+        } else if (arg == "--server-cpus" || arg == "--client-cpus") {
+            const char* list = optionValue(argc, argv, i);
+            if (list == nullptr) {
+                return false;
+            }
+            (arg == "--server-cpus" ? options.serverCpus : options.clientCpus) = list;
+        } else if (arg == "--duration") {
+            if (!parseIntOption("--duration", optionValue(argc, argv, i), 1, 86400, value)) {
+                return false;
+            }
+            options.duration = static_cast<int>(value);
+        } else if (arg == "--warmup") {
+            if (!parseIntOption("--warmup", optionValue(argc, argv, i), 0, 3600, value)) {
+                return false;
+            }
+            options.warmup = static_cast<int>(value);
+        } else if (arg == "--repeat") {
+            if (!parseIntOption("--repeat", optionValue(argc, argv, i), 1, 1000, value)) {
+                return false;
+            }
+            options.repeat = static_cast<int>(value);
+        } else if (arg == "--port") {
+            if (!parseIntOption("--port", optionValue(argc, argv, i), 1, 65535, value)) {
+                return false;
+            }
+            options.port = static_cast<int>(value);
+        } else if (arg == "--bin" || arg == "--json" || arg == "--csv" || arg == "--baseline") {
+            const char* path = optionValue(argc, argv, i);
+            if (path == nullptr) {
+                return false;
+            }
+            if (arg == "--bin") options.binDir = path;
+            else if (arg == "--json") options.jsonOut = path;
+            else if (arg == "--csv") options.csvOut = path;
+            else options.baseline = path;
+        } else if (arg == "--tolerance") {
+            if (!parseDoubleOption("--tolerance", optionValue(argc, argv, i), 0, 100, options.tolerance)) {
+                return false;
+            }
+        } else if (arg == "--help" || arg == "-h") {
+            printUsage(argv[0]);
+            std::exit(0);
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            printUsage(argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Directory of the running executable, where the build puts server and client
+std::string executableDir() {
+    char path[PATH_MAX];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (length <= 0) {
+        return ".";
+    }
+    path[length] = '\0';
+    std::string dir = path;
+    return dir.substr(0, dir.rfind('/'));
+}
+
+// Start a program with stdout discarded; stderr stays visible for errors
+pid_t spawn(const std::vector<std::string>& args) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        int devNull = open("/dev/null", O_WRONLY);
+        if (devNull != -1) {
+            dup2(devNull, STDOUT_FILENO);
+            close(devNull);
+        }
+        std::vector<char*> argv;
+        for (const std::string& arg : args) {
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        }
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        std::cerr << "Failed to run " << args[0] << ": " << strerror(errno) << std::endl;
+        _exit(127);
+    }
+    if (pid == -1) {
+        std::cerr << "Failed to fork: " << strerror(errno) << std::endl;
+    }
+    return pid;
+}
+
+// Wait for a child for up to timeoutMs; returns its exit status, or -1 if it
+// is still running or was killed by a signal
+int waitChild(pid_t pid, int timeoutMs) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (true) {
+        int status = 0;
+        pid_t done = waitpid(pid, &status, timeoutMs < 0 ? 0 : WNOHANG);
+        if (done == pid) {
+            return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+        }
+        if (done == -1 && errno != EINTR) {
+            return -1;
+        }
+        if (timeoutMs >= 0 && std::chrono::steady_clock::now() >= deadline) {
+            return -1;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+
+// The server is up once its port accepts connections
+bool waitForServer(pid_t server, int port) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, DEFAULT_SERVER_IP, &addr.sin_addr);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(SERVER_START_TIMEOUT_MS);
+    while (std::chrono::steady_clock::now() < deadline) {
+        int probe = socket(AF_INET, SOCK_STREAM, 0);
+        bool up = probe != -1 && connect(probe, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+        if (probe != -1) close(probe);
+        if (up) {
+            return true;
+        }
+        if (waitpid(server, nullptr, WNOHANG) == server) {
+            return false; // exited during startup
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    return false;
+}
+
+void stopServer(pid_t server) {
+    kill(server, SIGINT);
+    if (waitChild(server, SERVER_STOP_TIMEOUT_MS) == -1) {
+        kill(server, SIGKILL);
+        waitChild(server, -1);
+    }
+}
+
+// Read the first phase row of a client --result-out file
+bool readRunResult(const std::string& path, RunResult& result) {
+    std::ifstream file(path);
+    std::string header;
+    std::string row;
+    if (!std::getline(file, header) || !std::getline(file, row)) {
+        return false;
+    }
+    std::vector<double> fields;
+    std::istringstream cells(row);
+    std::string cell;
+    while (std::getline(cells, cell, ',')) {
+        fields.push_back(atof(cell.c_str()));
+    }
+    if (fields.size() < 8) {
+        return false;
+    }
+    result.rate = fields[2];
+    result.p50 = fields[3];
+    result.p99 = fields[4];
+    result.p999 = fields[5];
+    result.cpuUsPerMessage = fields[6];
+    result.softirqNsPerMessage = fields[7];
+    return true;
+}
+
+// Run the client once against the running server; duration 0 is not allowed
+// by the client, so warmups use their own length
+bool runClient(const BenchOptions& options, const BenchConfig& config, int duration, const std::string& resultPath,
+               RunResult* result) {
+    std::vector<std::string> args;
+    args.push_back(options.binDir + "/client");
+    const char* fixed[] = {"--interval", "0", "--host", DEFAULT_SERVER_IP};
+    args.insert(args.end(), fixed, fixed + 4);
+    args.push_back("--port");
+    args.push_back(std::to_string(options.port));
+    args.push_back("--duration");
+    args.push_back(std::to_string(duration));
+    args.push_back("--size");
+    args.push_back(std::to_string(config.size));
+    args.push_back("--connections");
+    args.push_back(std::to_string(config.connections));
+    args.push_back("--threads");
+    args.push_back(std::to_string(config.threads));
+    args.push_back("--poll");
+    args.push_back(config.poll);
+    if (!options.clientCpus.empty()) {
+        args.push_back("--cpus");
+        args.push_back(options.clientCpus);
+    }
+    if (result != nullptr) {
+        args.push_back("--result-out");
+        args.push_back(resultPath);
+    }
+    pid_t client = spawn(args);
+    if (client == -1) {
+        return false;
+    }
+    int status = waitChild(client, -1);
+    if (status != 0) {
+        std::cerr << "Client failed (exit status " << status << ") for " << config.key() << std::endl;
+        return false;
+    }
+    if (result != nullptr && !readRunResult(resultPath, *result)) {
+        std::cerr << "Failed to read client results from " << resultPath << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Start a server for the configuration, warm up, measure, stop the server
+bool runConfig(const BenchOptions& options, BenchRecord& record, const std::string& resultPath) {
+    const BenchConfig& config = record.config;
+    std::vector<std::string> args;
+    args.push_back(options.binDir + "/server");
+    args.push_back("--port");
+    args.push_back(std::to_string(options.port));
+    args.push_back("--threads");
+    args.push_back(std::to_string(config.threads));
+    args.push_back("--poll");
+    args.push_back(config.poll);
+    if (static_cast<size_t>(config.size) > DEFAULT_MAX_FRAME_SIZE) {
+        args.push_back("--max-frame");
+        args.push_back(std::to_string(config.size));
+    }
+    if (!options.serverCpus.empty()) {
+        args.push_back("--cpus");
+        args.push_back(options.serverCpus);
+    }
+    pid_t server = spawn(args);
+    if (server == -1) {
+        return false;
+    }
+    if (!waitForServer(server, options.port)) {
+        std::cerr << "Server did not start on port " << options.port << std::endl;
+        stopServer(server);
+        return false;
+    }
+
+    bool ok = options.warmup == 0 || runClient(options, config, options.warmup, resultPath, nullptr);
+    for (int i = 0; i < options.repeat && ok; ++i) {
+        RunResult run;
+        ok = runClient(options, config, options.duration, resultPath, &run);
+        if (ok) {
+            record.runs.push_back(run);
+        }
+    }
+    stopServer(server);
+    return ok;
+}
+
+void summarize(BenchRecord& record) {
+    size_t count = record.runs.size();
+    if (count == 0) {
+        return;
+    }
+    record.minRate = record.maxRate = record.runs[0].rate;
+    RunResult sum;
+    for (const RunResult& run : record.runs) {
+        sum.rate += run.rate;
+        sum.p50 += run.p50;
+        sum.p99 += run.p99;
+        sum.p999 += run.p999;
+        sum.cpuUsPerMessage += run.cpuUsPerMessage;
+        sum.softirqNsPerMessage += run.softirqNsPerMessage;
+        record.minRate = std::min(record.minRate, run.rate);
+        record.maxRate = std::max(record.maxRate, run.rate);
+    }
+    record.mean.rate = sum.rate / count;
+    record.mean.p50 = sum.p50 / count;
+    record.mean.p99 = sum.p99 / count;
+    record.mean.p999 = sum.p999 / count;
+    record.mean.cpuUsPerMessage = sum.cpuUsPerMessage / count;
+    record.mean.softirqNsPerMessage = sum.softirqNsPerMessage / count;
+    record.meanRate = record.mean.rate;
+    double variance = 0;
+    for (const RunResult& run : record.runs) {
+        variance += (run.rate - record.meanRate) * (run.rate - record.meanRate);
+    }
+    record.stddevRate = std::sqrt(variance / count);
+}
+
+const char* CSV_HEADER = "size,connections,threads,poll,repetitions,msgs_per_s,msgs_per_s_min,msgs_per_s_max,"
+                         "msgs_per_s_stddev,p50_us,p99_us,p999_us,cpu_us_per_msg,softirq_ns_per_msg";
+
+// Mean msgs/s per configuration from a CSV written with --csv
+bool loadBaseline(const std::string& path, std::map<std::string, double>& baseline) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Failed to open baseline " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    std::getline(file, line);
+    std::vector<std::string> columns;
+    std::istringstream header(line);
+    std::string column;
+    while (std::getline(header, column, ',')) {
+        columns.push_back(column);
+    }
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::map<std::string, std::string> row;
+        std::istringstream cells(line);
+        std::string cell;
+        for (size_t i = 0; i < columns.size() && std::getline(cells, cell, ','); ++i) {
+            row[columns[i]] = cell;
+        }
+        if (row.count("size") == 0 || row.count("connections") == 0 || row.count("threads") == 0
+            || row.count("poll") == 0 || row.count("msgs_per_s") == 0) {
+            std::cerr << "Baseline " << path << " lacks size, connections, threads, poll or msgs_per_s" << std::endl;
+            return false;
+        }
+        BenchConfig config;
+        config.size = atoi(row["size"].c_str());
+        config.connections = atoi(row["connections"].c_str());
+        config.threads = atoi(row["threads"].c_str());
+        config.poll = row["poll"];
+        baseline[config.key()] = atof(row["msgs_per_s"].c_str());
+    }
+    return true;
+}
+
+void writeCsv(std::ostream& out, const BenchRecord& record) {
+    const BenchConfig& config = record.config;
+    out << config.size << "," << config.connections << "," << config.threads << "," << config.poll << ","
+        << record.runs.size() << "," << record.meanRate << "," << record.minRate << "," << record.maxRate << ","
+        << record.stddevRate << "," << record.mean.p50 << "," << record.mean.p99 << "," << record.mean.p999 << ","
+        << record.mean.cpuUsPerMessage << "," << record.mean.softirqNsPerMessage << std::endl;
+}
+
+void writeJson(std::ostream& out, const BenchRecord& record) {
+    const BenchConfig& config = record.config;
+    out << "{\"size\":" << config.size << ",\"connections\":" << config.connections << ",\"threads\":" << config.threads
+        << ",\"poll\":\"" << config.poll << "\",\"repetitions\":" << record.runs.size()
+        << ",\"msgs_per_s\":{\"mean\":" << record.meanRate << ",\"min\":" << record.minRate
+        << ",\"max\":" << record.maxRate << ",\"stddev\":" << record.stddevRate << ",\"runs\":[";
+    for (size_t i = 0; i < record.runs.size(); ++i) {
+        out << (i > 0 ? "," : "") << record.runs[i].rate;
+    }
+    out << "]},\"p50_us\":" << record.mean.p50 << ",\"p99_us\":" << record.mean.p99
+        << ",\"p999_us\":" << record.mean.p999 << ",\"cpu_us_per_msg\":" << record.mean.cpuUsPerMessage
+        << ",\"softirq_ns_per_msg\":" << record.mean.softirqNsPerMessage;
+    if (record.baselineRate >= 0) {
+        out << ",\"baseline_msgs_per_s\":" << record.baselineRate << ",\"regressed\":"
+            << (record.regressed ? "true" : "false");
+    }
+    out << "}" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        return 1;
+    }
+    if (options.binDir.empty()) {
+        options.binDir = executableDir();
+    }
+    std::map<std::string, double> baseline;
+    if (!options.baseline.empty() && !loadBaseline(options.baseline, baseline)) {
+        return 1;
+    }
+
+    std::ofstream jsonFile;
+    std::ofstream csvFile;
+    if (!options.jsonOut.empty()) {
+        jsonFile.open(options.jsonOut);
+        if (!jsonFile) {
+            std::cerr << "Failed to open " << options.jsonOut << std::endl;
+            return 1;
+        }
+    }
+    if (!options.csvOut.empty()) {
+        csvFile.open(options.csvOut);
+        if (!csvFile) {
+            std::cerr << "Failed to open " << options.csvOut << std::endl;
+            return 1;
+        }
+        csvFile << CSV_HEADER << std::endl;
+    }
+
+    char resultTemplate[] = "/tmp/softirq_bench.XXXXXX";
+    int resultFd = mkstemp(resultTemplate);
+    if (resultFd == -1) {
+        std::cerr << "Failed to create a temporary file: " << strerror(errno) << std::endl;
+        return 1;
+    }
+    close(resultFd);
+    std::string resultPath = resultTemplate;
+
+    std::cout << std::setw(8) << "size" << std::setw(8) << "conns" << std::setw(8) << "threads"
+              << std::setw(11) << "poll" << std::setw(12) << "msgs/s" << std::setw(10) << "stddev"
+              << std::setw(10) << "p50 us" << std::setw(10) << "p99 us" << std::setw(12) << "cpu us/msg"
+              << std::setw(12) << "baseline" << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+
+    int failures = 0;
+    int regressions = 0;
+    for (int size : options.sizes) {
+        for (int connections : options.connections) {
+            for (int threads : options.threads) {
+                for (const std::string& poll : options.pollModes) {
+                    BenchRecord record;
+                    record.config.size = size;
+                    record.config.connections = connections;
+                    record.config.threads = threads;
+                    record.config.poll = poll;
+                    if (!runConfig(options, record, resultPath)) {
+                        failures++;
+                        continue;
+                    }
+                    summarize(record);
+                    std::map<std::string, double>::const_iterator known = baseline.find(record.config.key());
+                    if (known != baseline.end()) {
+                        record.baselineRate = known->second;
+                        record.regressed = record.meanRate < known->second * (1 - options.tolerance / 100);
+                        regressions += record.regressed ? 1 : 0;
+                    }
+
+                    std::cout << std::setw(8) << size << std::setw(8) << connections << std::setw(8) << threads
+                              << std::setw(11) << poll << std::setw(12) << static_cast<long>(record.meanRate)
+                              << std::setw(10) << static_cast<long>(record.stddevRate)
+                              << std::setw(10) << record.mean.p50 << std::setw(10) << record.mean.p99
+                              << std::setw(12) << std::setprecision(2) << record.mean.cpuUsPerMessage
+                              << std::setprecision(1);
+                    if (record.baselineRate >= 0) {
+                        std::cout << std::setw(12) << static_cast<long>(record.baselineRate)
+                                  << (record.regressed ? "  REGRESSED" : "");
+                    }
+                    std::cout << std::endl;
+                    if (jsonFile.is_open()) writeJson(jsonFile, record);
+                    if (csvFile.is_open()) writeCsv(csvFile, record);
+                }
+            }
+        }
+    }
+    unlink(resultPath.c_str());
+
+    if (failures > 0) {
+        std::cerr << failures << " configuration(s) failed to run" << std::endl;
+    }
+    if (regressions > 0) {
+        std::cerr << regressions << " configuration(s) fell more than " << options.tolerance
+                  << "% below the baseline" << std::endl;
+    }
+    return failures > 0 || regressions > 0 ? 1 : 0;
+}
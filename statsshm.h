@@ -0,0 +1,223 @@
+#ifndef STATSSHM_H
+#define STATSSHM_H
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// Live server counters in a POSIX shared memory segment, so a reader can
+// watch a running server without a syscall on the server's side. Every
+// field has exactly one writer and is stored and loaded with relaxed
+// atomics; readers work with deltas between two reads, so no lock or
+// sequence counter is needed. Each block fills whole cache lines, so
+// writers of different blocks never share one.
+//
+// Layout: StatsSegmentHeader, then one SharedReactorStats per reactor, then
+// connectionSlots SharedConnectionStats indexed by fd.
+
+constexpr uint32_t STATS_SEGMENT_MAGIC = 0x53495251; // "SIRQ"
+constexpr uint32_t STATS_SEGMENT_VERSION = 1;
+constexpr size_t STATS_CACHE_LINE = 64;
+
+struct alignas(STATS_CACHE_LINE) StatsSegmentHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t reactors;
+    uint32_t connectionSlots;
+    int32_t pid;
+    uint32_t reserved;
+    uint64_t startNs;  // CLOCK_MONOTONIC when the server started serving
+    uint64_t updateNs; // CLOCK_MONOTONIC of the last reactor publish
+};
+
+// Totals of one reactor, published by the server's main thread
+struct alignas(STATS_CACHE_LINE) SharedReactorStats {
+    uint64_t totalConnections;
+    uint64_t activeConnections;
+    uint64_t messages;
+    uint64_t bytes;
+    uint64_t waitCalls;
+    uint64_t ioSyscalls;
+    uint64_t corruptFrames;
+    uint64_t droppedDatagrams;
+};
+
+// One connection, written by the reactor that owns the fd
+struct alignas(STATS_CACHE_LINE) SharedConnectionStats {
+    uint32_t reactor;  // owning reactor + 1, 0 = slot unused
+    int32_t fd;
+    uint64_t messages;
+    uint64_t bytes;
+    uint64_t openedNs; // CLOCK_MONOTONIC at accept
+};
+
+template <typename T>
+inline void sharedStore(T& field, T value) {
+    __atomic_store_n(&field, value, __ATOMIC_RELAXED);
+}
+
+template <typename T>
+inline T sharedLoad(const T& field) {
+    return __atomic_load_n(&field, __ATOMIC_RELAXED);
+}
+
+inline uint64_t statsClockNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+// The counters are filled before the slot is marked used, so a reader that
+// sees the reactor also sees the reset counters
+inline void openSharedConnection(SharedConnectionStats* slot, int reactor, int fd) {
+    if (slot == nullptr) {
+        return;
+    }
+    sharedStore(slot->messages, uint64_t(0));
+    sharedStore(slot->bytes, uint64_t(0));
+    sharedStore(slot->fd, static_cast<int32_t>(fd));
+    sharedStore(slot->openedNs, statsClockNs());
+    __atomic_store_n(&slot->reactor, static_cast<uint32_t>(reactor + 1), __ATOMIC_RELEASE);
+}
+
+inline void closeSharedConnection(SharedConnectionStats* slot) {
+    if (slot != nullptr) {
+        __atomic_store_n(&slot->reactor, 0u, __ATOMIC_RELEASE);
+    }
+}
+
+// Plain loads are fine for the increments: the caller is the only writer
+inline void countSharedMessages(SharedConnectionStats* slot, uint64_t messages, uint64_t bytes) {
+    if (slot != nullptr) {
+        sharedStore(slot->messages, slot->messages + messages);
+        sharedStore(slot->bytes, slot->bytes + bytes);
+    }
+}
+
+class StatsSegment {
+public:
+    StatsSegment() = default;
+    StatsSegment(const StatsSegment&) = delete;
+    StatsSegment& operator=(const StatsSegment&) = delete;
+
+    ~StatsSegment() { remove(); }
+
+    // Server side: create the segment, replacing a stale one of the same
+    // name left by a crashed server
+    bool create(const std::string& name, int reactors, int connectionSlots) {
+        size_t size = segmentSize(reactors, connectionSlots);
+        int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+        if (fd == -1) {
+            return false;
+        }
+        if (ftruncate(fd, static_cast<off_t>(size)) == -1) {
+            int error = errno;
+            ::close(fd);
+            shm_unlink(name.c_str());
+            errno = error;
+            return false;
+        }
+        void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        int error = errno;
+        ::close(fd);
+        if (base == MAP_FAILED) {
+            shm_unlink(name.c_str());
+            errno = error;
+            return false;
+        }
+        base_ = static_cast<unsigned char*>(base);
+        size_ = size;
+        name_ = name;
+        owner_ = true;
+        // ftruncate zero-fills; the header goes last so readers never see a
+        // valid magic over a half-initialized segment
+        StatsSegmentHeader* head = header();
+        head->version = STATS_SEGMENT_VERSION;
+        head->reactors = static_cast<uint32_t>(reactors);
+        head->connectionSlots = static_cast<uint32_t>(connectionSlots);
+        head->pid = static_cast<int32_t>(getpid());
+        head->startNs = statsClockNs();
+        __atomic_store_n(&head->magic, STATS_SEGMENT_MAGIC, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    // Reader side: map an existing segment read-only
+    bool attach(const std::string& name, std::string& error) {
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd == -1) {
+            error = strerror(errno);
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == -1 || static_cast<size_t>(st.st_size) < sizeof(StatsSegmentHeader)) {
+            error = "segment too small";
+            ::close(fd);
+            return false;
+        }
+        void* base = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (base == MAP_FAILED) {
+            error = strerror(errno);
+            return false;
+        }
+        base_ = static_cast<unsigned char*>(base);
+        size_ = static_cast<size_t>(st.st_size);
+        const StatsSegmentHeader* head = header();
+        if (__atomic_load_n(&head->magic, __ATOMIC_ACQUIRE) != STATS_SEGMENT_MAGIC
+            || head->version != STATS_SEGMENT_VERSION
+            || size_ < segmentSize(head->reactors, head->connectionSlots)) {
+            error = "not a server stats segment of version " + std::to_string(STATS_SEGMENT_VERSION);
+            remove();
+            return false;
+        }
+        return true;
+    }
+
+    // Unmap, and unlink the name if this process created it
+    void remove() {
+        if (base_ != nullptr) {
+            munmap(base_, size_);
+            base_ = nullptr;
+        }
+        if (owner_) {
+            shm_unlink(name_.c_str());
+            owner_ = false;
+        }
+    }
+
+    bool mapped() const { return base_ != nullptr; }
+
+    StatsSegmentHeader* header() const { return reinterpret_cast<StatsSegmentHeader*>(base_); }
+
+    SharedReactorStats* reactor(int id) const {
+        return reinterpret_cast<SharedReactorStats*>(base_ + sizeof(StatsSegmentHeader)) + id;
+    }
+
+    // The fd's slot, or nullptr without a segment or for fds beyond the slots
+    SharedConnectionStats* connection(int fd) const {
+        if (base_ == nullptr || fd < 0 || static_cast<uint32_t>(fd) >= header()->connectionSlots) {
+            return nullptr;
+        }
+        return reinterpret_cast<SharedConnectionStats*>(reactor(header()->reactors)) + fd;
+    }
+
+private:
+    static size_t segmentSize(uint32_t reactors, uint32_t connectionSlots) {
+        return sizeof(StatsSegmentHeader) + reactors * sizeof(SharedReactorStats)
+            + connectionSlots * sizeof(SharedConnectionStats);
+    }
+
+    unsigned char* base_ = nullptr;
+    size_t size_ = 0;
+    std::string name_;
+    bool owner_ = false;
+};
+
+#endif // STATSSHM_H
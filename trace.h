@@ -0,0 +1,289 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <time.h>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TRACE_X86 1
+#endif
+
+// Per-thread event trace in a memory-mapped file. Every traced thread owns
+// one ring of fixed-size records and is its only writer, so recording an
+// event is a timestamp, a CPU number and a few stores, without locks or
+// syscalls. The rings keep the latest `capacity` events; the kernel writes
+// the pages back to the file, even if the process dies. trace_convert turns
+// the file into a Chrome trace or perf script style text.
+//
+// Layout: TraceFileHeader, `rings` TraceRingHeader, then the records of
+// ring 0, ring 1, ... of `capacity` records each.
+
+constexpr uint32_t TRACE_FILE_MAGIC = 0x54524951; // "QIRT"
+constexpr uint32_t TRACE_FILE_VERSION = 1;
+
+// Ring capacity bounds; capacities are rounded up to a power of two
+constexpr uint64_t MIN_TRACE_RECORDS = 1024;
+constexpr uint64_t MAX_TRACE_RECORDS = 1ULL << 26;
+
+enum class TraceEvent : uint16_t {
+    Wakeup = 1, // epoll_wait returned events; value = event count
+    Recv,       // value = bytes received
+    Send,       // value = bytes sent
+    Again,      // EAGAIN; value = 0 for a receive, 1 for a send
+    Accept,     // connection registered
+    Close,      // connection closed
+    State       // server ping-pong state; value = 0 receiving, 1 sending
+};
+
+enum class TraceClock : uint32_t {
+    Monotonic = 0, // CLOCK_MONOTONIC nanoseconds
+    Tsc = 1        // TSC ticks, mapped to CLOCK_MONOTONIC with the calibration points
+};
+
+struct alignas(64) TraceFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t rings;
+    uint32_t clock;    // TraceClock
+    uint64_t capacity; // records per ring
+    int32_t pid;
+    char program[12];
+    uint64_t tscStart;  // TSC and CLOCK_MONOTONIC read together at creation...
+    uint64_t monoStart;
+    uint64_t tscEnd;    // ...and at close; 0 if the process did not close the trace
+    uint64_t monoEnd;
+    uint64_t tscPerSecond; // estimate from creation, used without the end points
+};
+
+// Ring bookkeeping, one cache line each so writers never share one
+struct alignas(64) TraceRingHeader {
+    uint64_t head; // events recorded; the ring holds the last min(head, capacity)
+    int32_t tid;
+    int32_t id;
+    char name[24];
+};
+
+struct TraceRecord {
+    uint64_t time;  // in the file's TraceClock
+    uint16_t type;  // TraceEvent
+    uint16_t cpu;
+    int32_t fd;     // -1 when not about one socket
+    uint64_t value;
+};
+static_assert(sizeof(TraceRecord) == 24, "trace file format changed");
+
+inline const char* traceEventName(uint16_t type) {
+    switch (static_cast<TraceEvent>(type)) {
+    case TraceEvent::Wakeup: return "wakeup";
+    case TraceEvent::Recv: return "recv";
+    case TraceEvent::Send: return "send";
+    case TraceEvent::Again: return "eagain";
+    case TraceEvent::Accept: return "accept";
+    case TraceEvent::Close: return "close";
+    case TraceEvent::State: return "state";
+    }
+    return "unknown";
+}
+
+inline uint64_t traceMonotonicNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+// The TSC is only a usable clock when it ticks at a fixed rate through
+// frequency changes and idle states
+inline bool traceTscUsable() {
+#ifdef TRACE_X86
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        if (line.compare(0, 5, "flags") == 0) {
+            return line.find(" constant_tsc") != std::string::npos
+                && line.find(" nonstop_tsc") != std::string::npos;
+        }
+    }
+#endif
+    return false;
+}
+
+inline uint64_t traceTsc() {
+#ifdef TRACE_X86
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// One thread's writer. Default constructed it records nothing, so the hot
+// paths only pay a null check when tracing is off.
+class TraceRing {
+public:
+    bool enabled() const { return records_ != nullptr; }
+
+    // Call from the thread that records, before its first event
+    void bindThread() {
+        if (header_ != nullptr) {
+            header_->tid = static_cast<int32_t>(syscall(SYS_gettid));
+        }
+    }
+
+    void record(TraceEvent event, int fd, uint64_t value) {
+        if (records_ == nullptr) {
+            return;
+        }
+        TraceRecord& record = records_[head_ & mask_];
+        // RDTSC rather than the serializing RDTSCP; sched_getcpu is a load
+        // from the rseq area with glibc 2.35 and later
+        record.time = tsc_ ? traceTsc() : traceMonotonicNs();
+        record.type = static_cast<uint16_t>(event);
+        record.cpu = static_cast<uint16_t>(sched_getcpu());
+        record.fd = fd;
+        record.value = value;
+        head_++;
+        __atomic_store_n(&header_->head, head_, __ATOMIC_RELEASE);
+    }
+
+private:
+    friend class TraceFile;
+
+    TraceRingHeader* header_ = nullptr;
+    TraceRecord* records_ = nullptr;
+    uint64_t mask_ = 0;
+    uint64_t head_ = 0;
+    bool tsc_ = false;
+};
+
+class TraceFile {
+public:
+    TraceFile() = default;
+    TraceFile(const TraceFile&) = delete;
+    TraceFile& operator=(const TraceFile&) = delete;
+
+    ~TraceFile() { close(); }
+
+    // Create path with rings of at least capacity records each
+    bool create(const std::string& path, const char* program, int rings, uint64_t capacity) {
+        uint64_t rounded = MIN_TRACE_RECORDS;
+        while (rounded < capacity && rounded < MAX_TRACE_RECORDS) {
+            rounded <<= 1;
+        }
+        size_t size = fileSize(rings, rounded);
+        int fd = open(path.c_str(), O_CREAT | O_RDWR | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd == -1) {
+            return false;
+        }
+        // Sparse: pages are only allocated as the rings fill
+        if (ftruncate(fd, static_cast<off_t>(size)) == -1) {
+            int error = errno;
+            ::close(fd);
+            errno = error;
+            return false;
+        }
+        void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        int error = errno;
+        ::close(fd);
+        if (base == MAP_FAILED) {
+            errno = error;
+            return false;
+        }
+        base_ = static_cast<unsigned char*>(base);
+        size_ = size;
+
+        TraceFileHeader* head = header();
+        head->version = TRACE_FILE_VERSION;
+        head->rings = static_cast<uint32_t>(rings);
+        head->capacity = rounded;
+        head->pid = static_cast<int32_t>(getpid());
+        strncpy(head->program, program, sizeof(head->program) - 1);
+        tsc_ = traceTscUsable();
+        head->clock = static_cast<uint32_t>(tsc_ ? TraceClock::Tsc : TraceClock::Monotonic);
+        if (tsc_) {
+            // Rough rate for traces that are never closed
+            head->tscStart = traceTsc();
+            head->monoStart = traceMonotonicNs();
+            struct timespec pause = {0, 10000000};
+            nanosleep(&pause, nullptr);
+            head->tscPerSecond = (traceTsc() - head->tscStart) * 1000000000ULL
+                / (traceMonotonicNs() - head->monoStart);
+        }
+        head->magic = TRACE_FILE_MAGIC;
+        return true;
+    }
+
+    // The writer of ring id; name labels the thread in converted traces
+    TraceRing ring(int id, const std::string& name) const {
+        TraceRing ring;
+        if (base_ == nullptr) {
+            return ring;
+        }
+        ring.header_ = ringHeader(id);
+        ring.header_->id = id;
+        strncpy(ring.header_->name, name.c_str(), sizeof(ring.header_->name) - 1);
+        ring.records_ = records(id);
+        ring.mask_ = header()->capacity - 1;
+        ring.tsc_ = tsc_;
+        return ring;
+    }
+
+    bool mapped() const { return base_ != nullptr; }
+
+    // Events recorded over all rings, and how many of them were overwritten
+    void counts(uint64_t& recorded, uint64_t& overwritten) const {
+        recorded = 0;
+        overwritten = 0;
+        for (uint32_t i = 0; base_ != nullptr && i < header()->rings; ++i) {
+            uint64_t head = __atomic_load_n(&ringHeader(i)->head, __ATOMIC_ACQUIRE);
+            recorded += head;
+            overwritten += head > header()->capacity ? head - header()->capacity : 0;
+        }
+    }
+
+    // Store the end calibration point and unmap; call once the writers stopped
+    void close() {
+        if (base_ == nullptr) {
+            return;
+        }
+        if (tsc_) {
+            header()->tscEnd = traceTsc();
+            header()->monoEnd = traceMonotonicNs();
+        }
+        msync(base_, size_, MS_ASYNC);
+        munmap(base_, size_);
+        base_ = nullptr;
+    }
+
+    static size_t fileSize(uint32_t rings, uint64_t capacity) {
+        return sizeof(TraceFileHeader) + rings * sizeof(TraceRingHeader)
+            + rings * capacity * sizeof(TraceRecord);
+    }
+
+private:
+    TraceFileHeader* header() const { return reinterpret_cast<TraceFileHeader*>(base_); }
+
+    TraceRingHeader* ringHeader(int id) const {
+        return reinterpret_cast<TraceRingHeader*>(base_ + sizeof(TraceFileHeader)) + id;
+    }
+
+    TraceRecord* records(int id) const {
+        return reinterpret_cast<TraceRecord*>(ringHeader(header()->rings)) + id * header()->capacity;
+    }
+
+    unsigned char* base_ = nullptr;
+    size_t size_ = 0;
+    bool tsc_ = false;
+};
+
+#endif // TRACE_H
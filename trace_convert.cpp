@@ -0,0 +1,274 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include "cli.h"
+#include "trace.h"
+
+// Converts trace files written by server and client with --trace into a
+// Chrome trace (chrome://tracing, Perfetto) or perf script style text that
+// can be merged with `perf script` output. Timestamps are CLOCK_MONOTONIC in
+// both formats, so traces of server and client line up with each other and
+// with `perf record -k CLOCK_MONOTONIC`.
+
+enum class TraceFormat {
+    Chrome,
+    Perf
+};
+
+struct ConvertOptions {
+    std::vector<std::string> inputs;
+    std::string output; // empty = stdout
+    TraceFormat format = TraceFormat::Chrome;
+};
+
+// A traced thread of one input file
+struct TraceThread {
+    int pid;
+    int tid;
+    std::string program;
+    std::string name;
+};
+
+// One event with its time already converted to CLOCK_MONOTONIC nanoseconds
+struct ConvertedEvent {
+    uint64_t ns;
+    size_t thread; // index into the threads of all files
+    TraceRecord record;
+};
+
+void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " FILE... [--format chrome|perf] [--out FILE]\n"
+              << "  FILE             trace file written by server or client with --trace; several files are merged\n"
+              << "  --format FORMAT  chrome: JSON for chrome://tracing and Perfetto; perf: perf script style lines,\n"
+              << "                   one per event, sorted by time (default: chrome)\n"
+              << "  --out FILE       write to FILE instead of stdout\n";
+}
+
+bool parseOptions(int argc, char* argv[], ConvertOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--format") {
+            const char* format = optionValue(argc, argv, i);
+            if (format == nullptr) {
+                return false;
+            }
+            if (std::string(format) == "chrome") {
+                options.format = TraceFormat::Chrome;
+            } else if (std::string(format) == "perf") {
+                options.format = TraceFormat::Perf;
+            } else {
+                std::cerr << "Unknown format: " << format << std::endl;
+                return false;
+            }
+        } else if (arg == "--out") {
+            const char* path = optionValue(argc, argv, i);
+            if (path == nullptr) {
+                return false;
+            }
+            options.output = path;
+        } else if (arg == "--help" || arg == "-h") {
+            printUsage(argv[0]);
+            std::exit(0);
+        } else if (arg[0] != '-') {
+            options.inputs.push_back(arg);
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            printUsage(argv[0]);
+            return false;
+        }
+    }
+    if (options.inputs.empty()) {
+        printUsage(argv[0]);
+        return false;
+    }
+    return true;
+}
+
+// Map a record time to CLOCK_MONOTONIC nanoseconds. TSC files use the two
+// calibration points, or the rate estimate if the writer never closed them.
+uint64_t monotonicNs(const TraceFileHeader& header, uint64_t time) {
+    if (static_cast<TraceClock>(header.clock) != TraceClock::Tsc) {
+        return time;
+    }
+    double ticks = static_cast<double>(static_cast<int64_t>(time - header.tscStart));
+    double nsPerTick = 1e9 / header.tscPerSecond;
+    if (header.tscEnd > header.tscStart && header.monoEnd > header.monoStart) {
+        nsPerTick = static_cast<double>(header.monoEnd - header.monoStart) / (header.tscEnd - header.tscStart);
+    }
+    return header.monoStart + static_cast<int64_t>(ticks * nsPerTick);
+}
+
+// Append the events of every ring of one file, oldest first per ring
+bool readTraceFile(const std::string& path, std::vector<ConvertedEvent>& events, std::vector<TraceThread>& threads) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Cannot open " << path << std::endl;
+        return false;
+    }
+    TraceFileHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != TRACE_FILE_MAGIC
+        || header.version != TRACE_FILE_VERSION || header.capacity == 0
+        || (header.capacity & (header.capacity - 1)) != 0) {
+        std::cerr << path << " is not a trace file of version " << TRACE_FILE_VERSION << std::endl;
+        return false;
+    }
+    if (static_cast<TraceClock>(header.clock) == TraceClock::Tsc && header.tscPerSecond == 0) {
+        std::cerr << path << ": TSC trace without calibration" << std::endl;
+        return false;
+    }
+    std::vector<TraceRingHeader> rings(header.rings);
+    if (!file.read(reinterpret_cast<char*>(rings.data()), rings.size() * sizeof(TraceRingHeader))) {
+        std::cerr << path << ": truncated ring headers" << std::endl;
+        return false;
+    }
+    header.program[sizeof(header.program) - 1] = '\0';
+
+    std::vector<TraceRecord> records(header.capacity);
+    for (uint32_t i = 0; i < header.rings; ++i) {
+        const TraceRingHeader& ring = rings[i];
+        std::streamoff offset = sizeof(TraceFileHeader) + header.rings * sizeof(TraceRingHeader)
+                              + static_cast<std::streamoff>(i * header.capacity * sizeof(TraceRecord));
+        file.seekg(offset);
+        if (!file.read(reinterpret_cast<char*>(records.data()), records.size() * sizeof(TraceRecord))) {
+            std::cerr << path << ": truncated ring " << i << std::endl;
+            return false;
+        }
+        TraceThread thread;
+        thread.pid = header.pid;
+        thread.tid = ring.tid != 0 ? ring.tid : header.pid;
+        thread.program = header.program;
+        thread.name.assign(ring.name, strnlen(ring.name, sizeof(ring.name)));
+        threads.push_back(thread);
+
+        uint64_t count = std::min(ring.head, header.capacity);
+        for (uint64_t n = ring.head - count; n < ring.head; ++n) {
+            const TraceRecord& record = records[n & (header.capacity - 1)];
+            if (record.type == 0) {
+                continue;
+            }
+            ConvertedEvent event;
+            event.ns = monotonicNs(header, record.time);
+            event.thread = threads.size() - 1;
+            event.record = record;
+            events.push_back(event);
+        }
+    }
+    return true;
+}
+
+// The event's value under the name it has for its type
+void writeValue(std::ostream& out, const TraceRecord& record, bool json) {
+    const char* separator = json ? "\":" : "=";
+    const char* quote = json ? "\"" : "";
+    switch (static_cast<TraceEvent>(record.type)) {
+    case TraceEvent::Wakeup:
+        out << quote << "events" << separator << record.value;
+        break;
+    case TraceEvent::Recv:
+    case TraceEvent::Send:
+        out << quote << "bytes" << separator << record.value;
+        break;
+    case TraceEvent::Again:
+        out << quote << "direction" << separator << quote << (record.value ? "send" : "recv") << quote;
+        break;
+    case TraceEvent::State:
+        out << quote << "state" << separator << quote << (record.value ? "sending" : "receiving") << quote;
+        break;
+    default:
+        out << quote << "value" << separator << record.value;
+        break;
+    }
+}
+
+void writeChrome(std::ostream& out, const std::vector<ConvertedEvent>& events, const std::vector<TraceThread>& threads) {
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    bool first = true;
+    for (const TraceThread& thread : threads) {
+        out << (first ? "" : ",\n") << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << thread.pid
+            << ",\"args\":{\"name\":\"" << thread.program << "\"}},\n"
+            << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << thread.pid << ",\"tid\":" << thread.tid
+            << ",\"args\":{\"name\":\"" << thread.name << "\"}}";
+        first = false;
+    }
+    char ts[32];
+    for (const ConvertedEvent& event : events) {
+        const TraceThread& thread = threads[event.thread];
+        // Microseconds with nanosecond decimals
+        snprintf(ts, sizeof(ts), "%" PRIu64 ".%03" PRIu64, event.ns / 1000, event.ns % 1000);
+        out << (first ? "" : ",\n") << "{\"name\":\"" << traceEventName(event.record.type)
+            << "\",\"cat\":\"" << thread.program << "\",\"ph\":\"i\",\"s\":\"t\",\"ts\":" << ts
+            << ",\"pid\":" << thread.pid << ",\"tid\":" << thread.tid << ",\"args\":{\"cpu\":" << event.record.cpu;
+        if (event.record.fd >= 0) {
+            out << ",\"fd\":" << event.record.fd;
+        }
+        if (static_cast<TraceEvent>(event.record.type) != TraceEvent::Accept
+            && static_cast<TraceEvent>(event.record.type) != TraceEvent::Close) {
+            out << ",";
+            writeValue(out, event.record, true);
+        }
+        out << "}}";
+        first = false;
+    }
+    out << "\n]}" << std::endl;
+}
+
+// Lines shaped like `perf script --ns`: comm, tid, [cpu], seconds, event
+void writePerf(std::ostream& out, const std::vector<ConvertedEvent>& events, const std::vector<TraceThread>& threads) {
+    char prefix[96];
+    for (const ConvertedEvent& event : events) {
+        const TraceThread& thread = threads[event.thread];
+        snprintf(prefix, sizeof(prefix), "%16s %7d [%03u] %" PRIu64 ".%09" PRIu64 ": ", thread.program.c_str(),
+                 thread.tid, event.record.cpu, event.ns / 1000000000, event.ns % 1000000000);
+        out << prefix << thread.program << ":" << traceEventName(event.record.type) << ":";
+        if (event.record.fd >= 0) {
+            out << " fd=" << event.record.fd;
+        }
+        if (static_cast<TraceEvent>(event.record.type) != TraceEvent::Accept
+            && static_cast<TraceEvent>(event.record.type) != TraceEvent::Close) {
+            out << " ";
+            writeValue(out, event.record, false);
+        }
+        out << "\n";
+    }
+    out.flush();
+}
+
+int main(int argc, char* argv[]) {
+    ConvertOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        return 1;
+    }
+    std::vector<ConvertedEvent> events;
+    std::vector<TraceThread> threads;
+    bool ok = true;
+    for (const std::string& input : options.inputs) {
+        ok = ok && readTraceFile(input, events, threads);
+    }
+    if (ok) {
+        std::stable_sort(events.begin(), events.end(),
+                         [](const ConvertedEvent& a, const ConvertedEvent& b) { return a.ns < b.ns; });
+        std::ofstream file;
+        if (!options.output.empty()) {
+            file.open(options.output);
+            if (!file) {
+                std::cerr << "Cannot write " << options.output << std::endl;
+                ok = false;
+            }
+        }
+        std::ostream& out = options.output.empty() ? std::cout : file;
+        if (ok && options.format == TraceFormat::Chrome) {
+            writeChrome(out, events, threads);
+        } else if (ok) {
+            writePerf(out, events, threads);
+        }
+        if (ok) {
+            std::cerr << events.size() << " events from " << threads.size() << " thread(s)" << std::endl;
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,81 @@
+#ifndef UDP_H
+#define UDP_H
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// UDP segmentation offload socket options, missing from older libc headers
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+// Largest IPv4 UDP payload; every datagram carries exactly one frame
+constexpr size_t MAX_DATAGRAM_SIZE = 65507;
+
+// GSO limits: segments per send and bytes per super-packet
+constexpr size_t MAX_GSO_SEGMENTS = 64;
+constexpr size_t MAX_GSO_BYTES = 65000;
+
+// Buffer size that holds any GRO super-packet
+constexpr size_t GRO_BUFFER_SIZE = 65536;
+
+// Room for the UDP_SEGMENT control message of one sendmmsg entry
+constexpr size_t GSO_CONTROL_SIZE = CMSG_SPACE(sizeof(uint16_t));
+
+// Segments per GSO send for a given segment size
+inline size_t gsoSegmentsFor(size_t segmentSize) {
+    size_t segments = MAX_GSO_BYTES / segmentSize;
+    if (segments > MAX_GSO_SEGMENTS) segments = MAX_GSO_SEGMENTS;
+    return segments > 0 ? segments : 1;
+}
+
+// Attach a UDP_SEGMENT control message so the kernel splits msg's buffer
+// into segmentSize datagrams
+inline void setGsoSegment(msghdr& msg, unsigned char* control, uint16_t segmentSize) {
+    memset(control, 0, GSO_CONTROL_SIZE);
+    msg.msg_control = control;
+    msg.msg_controllen = GSO_CONTROL_SIZE;
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    memcpy(CMSG_DATA(cmsg), &segmentSize, sizeof(segmentSize));
+}
+
+// Segment size of a received GRO super-packet, or length if the kernel
+// delivered a single datagram
+inline size_t groSegmentSize(msghdr& msg, size_t length) {
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            int segmentSize = 0;
+            memcpy(&segmentSize, CMSG_DATA(cmsg), sizeof(segmentSize));
+            if (segmentSize > 0) {
+                return static_cast<size_t>(segmentSize);
+            }
+        }
+    }
+    return length;
+}
+
+inline bool enableGro(int socket) {
+    int on = 1;
+    return setsockopt(socket, SOL_UDP, UDP_GRO, &on, sizeof(on)) == 0;
+}
+
+// Larger socket buffers absorb bursts of batched datagrams; the kernel caps
+// them at net.core.{r,w}mem_max
+inline void growSocketBuffers(int socket, int bytes) {
+    setsockopt(socket, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes));
+    setsockopt(socket, SOL_SOCKET, SO_SNDBUF, &bytes, sizeof(bytes));
+}
+
+#endif // UDP_H
@@ -0,0 +1,131 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "protocol.h"
+
+// How request frame sizes are drawn
+enum class SizeDistribution {
+    Fixed,   // always `size`
+    Uniform, // uniform in [size, sizeMax]
+    Bimodal  // `sizeMax` with probability largeFraction, otherwise `size`
+};
+
+// Send times in open-loop mode
+enum class ArrivalProcess {
+    Poisson, // exponentially distributed gaps
+    Fixed    // evenly spaced sends
+};
+
+// Client workload: request size distribution, reply size and pacing.
+// All sizes are whole frames including the FrameHeader.
+struct WorkloadProfile {
+    SizeDistribution distribution = SizeDistribution::Fixed;
+    uint32_t size = DEFAULT_MESSAGE_SIZE;
+    uint32_t sizeMax = DEFAULT_MESSAGE_SIZE;
+    double largeFraction = 0;
+    double replyRatio = 1.0; // reply size = request size * replyRatio
+    uint32_t thinkUs = 0;    // pause between a reply and the next request
+    double rate = 0;         // open loop: target msgs/s over all connections, 0 = closed loop
+    ArrivalProcess arrivals = ArrivalProcess::Poisson;
+
+    uint32_t maxRequestSize() const {
+        return distribution == SizeDistribution::Fixed ? size : sizeMax;
+    }
+
+    uint32_t replySizeFor(uint32_t requestSize) const {
+        if (replyRatio == 1.0) {
+            return requestSize;
+        }
+        double reply = requestSize * replyRatio;
+        if (reply < FRAME_HEADER_SIZE) reply = FRAME_HEADER_SIZE;
+        if (reply > MAX_FRAME_LIMIT) reply = MAX_FRAME_LIMIT;
+        return static_cast<uint32_t>(reply);
+    }
+
+    uint32_t maxReplySize() const {
+        return replySizeFor(maxRequestSize());
+    }
+
+    template <typename Rng>
+    uint32_t sampleRequestSize(Rng& rng) const {
+        switch (distribution) {
+        case SizeDistribution::Uniform:
+            return std::uniform_int_distribution<uint32_t>(size, sizeMax)(rng);
+        case SizeDistribution::Bimodal:
+            return std::generate_canonical<double, 32>(rng) < largeFraction ? sizeMax : size;
+        default:
+            return size;
+        }
+    }
+
+    std::string describe() const {
+        std::ostringstream out;
+        switch (distribution) {
+        case SizeDistribution::Uniform:
+            out << "uniform " << size << ".." << sizeMax << " B";
+            break;
+        case SizeDistribution::Bimodal:
+            out << "bimodal " << size << "/" << sizeMax << " B (" << largeFraction * 100 << "% large)";
+            break;
+        default:
+            out << "fixed " << size << " B";
+            break;
+        }
+        out << ", reply ratio " << replyRatio;
+        if (thinkUs > 0) {
+            out << ", think " << thinkUs << " us";
+        }
+        if (rate > 0) {
+            out << ", open loop " << rate << " msgs/s ("
+                << (arrivals == ArrivalProcess::Poisson ? "Poisson" : "fixed") << " arrivals)";
+        }
+        return out.str();
+    }
+};
+
+inline bool parseFrameSize(const std::string& text, uint32_t& size) {
+    char* end = nullptr;
+    unsigned long value = std::strtoul(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || value < FRAME_HEADER_SIZE || value > MAX_FRAME_LIMIT) {
+        return false;
+    }
+    size = static_cast<uint32_t>(value);
+    return true;
+}
+
+// Parse a size distribution: fixed:N, uniform:MIN:MAX or bimodal:SMALL:LARGE:FRACTION
+inline bool parseSizeDistribution(const std::string& spec, WorkloadProfile& profile) {
+    std::vector<std::string> parts;
+    std::istringstream in(spec);
+    std::string part;
+    while (std::getline(in, part, ':')) {
+        parts.push_back(part);
+    }
+    if (parts.size() == 2 && parts[0] == "fixed") {
+        profile.distribution = SizeDistribution::Fixed;
+        return parseFrameSize(parts[1], profile.size);
+    }
+    if (parts.size() == 3 && parts[0] == "uniform") {
+        profile.distribution = SizeDistribution::Uniform;
+        return parseFrameSize(parts[1], profile.size) && parseFrameSize(parts[2], profile.sizeMax)
+            && profile.size <= profile.sizeMax;
+    }
+    if (parts.size() == 4 && parts[0] == "bimodal") {
+        profile.distribution = SizeDistribution::Bimodal;
+        char* end = nullptr;
+        profile.largeFraction = std::strtod(parts[3].c_str(), &end);
+        return parseFrameSize(parts[1], profile.size) && parseFrameSize(parts[2], profile.sizeMax)
+            && profile.size <= profile.sizeMax && *end == '\0'
+            && profile.largeFraction >= 0 && profile.largeFraction <= 1;
+    }
+    return false;
+}
+
+#endif // WORKLOAD_H
@@ -0,0 +1,411 @@
+#ifndef ZEROCOPY_H
+#define ZEROCOPY_H
+
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <linux/sockios.h>
+#include <time.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <vector>
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+
+// MSG_ZEROCOPY send buffers. The kernel reads a zero-copy send from user
+// memory after send() returns, so a buffer must not be rewritten until the
+// kernel has reported every send that read from it on the socket's error
+// queue. The kernel numbers a socket's zero-copy sends 0, 1, 2, ... and
+// reports completed ranges of those ids.
+//
+// Buffers come from a fixed pool locked into memory. Each socket sends from
+// one current buffer; once data went out from it, the owner moves on to a
+// fresh buffer (ZeroCopyPool::advance) and the old one waits on the
+// socket's in-flight list until its ids complete. When the pool is empty or
+// the kernel reported that it copied the data anyway (loopback always does),
+// the socket falls back to its own buffer and plain sends.
+//
+// A closed socket's completions can no longer be read, yet close() does not
+// stop the kernel from sending or retransmitting what is still queued from
+// the pool's pages. Such buffers are quarantined for ZEROCOPY_QUARANTINE_NS
+// and only reused once the free buffers ran out and the time passed. That
+// bounds rather than rules out reuse under a retransmitting dead peer; the
+// alternative, a blocking flush before every close, would stall the event
+// loop on one slow connection.
+
+// How long buffers of a socket closed with unsent or unacknowledged data
+// stay out of the pool
+constexpr uint64_t ZEROCOPY_QUARANTINE_NS = 5000000000ULL;
+
+// Per-socket state; trivially destructible so it can live in a connection
+// table slot
+struct ZeroCopySocket {
+    uint32_t nextId = 0;  // id the kernel gives the next zero-copy send
+    int current = -1;     // pool buffer being filled and sent from
+    int inflightHead = -1; // buffers with zero-copy sends, oldest first
+    int inflightTail = -1;
+    bool copying = false; // the kernel copied: plain sends from now on
+};
+
+struct ZeroCopyStats {
+    long zerocopySends = 0;       // send() calls with MSG_ZEROCOPY
+    long copySends = 0;           // send() calls without it while zero-copy was enabled
+    long zerocopyCompletions = 0; // sends the kernel completed without copying
+    long copiedCompletions = 0;   // sends the kernel completed by copying
+    long poolExhausted = 0;       // times no free buffer was left
+    long socketsCopying = 0;      // sockets that fell back to plain sends
+    long quarantined = 0;         // buffers of sockets closed with data still queued
+
+    ZeroCopyStats& operator+=(const ZeroCopyStats& other) {
+        zerocopySends += other.zerocopySends;
+        copySends += other.copySends;
+        zerocopyCompletions += other.zerocopyCompletions;
+        copiedCompletions += other.copiedCompletions;
+        poolExhausted += other.poolExhausted;
+        socketsCopying += other.socketsCopying;
+        quarantined += other.quarantined;
+        return *this;
+    }
+};
+
+class ZeroCopyPool {
+public:
+    ZeroCopyPool() = default;
+    ZeroCopyPool(const ZeroCopyPool&) = delete;
+    ZeroCopyPool& operator=(const ZeroCopyPool&) = delete;
+
+    ~ZeroCopyPool() {
+        if (arena_ != nullptr) {
+            munmap(arena_, arenaSize_);
+        }
+    }
+
+    // Map count buffers of bufferSize bytes. locked reports whether mlock
+    // succeeded; without it the pool still works, pages are pinned per send.
+    bool init(size_t bufferSize, size_t count, bool& locked) {
+        bufferSize_ = (bufferSize + 4095) / 4096 * 4096;
+        arenaSize_ = bufferSize_ * count;
+        void* arena = mmap(nullptr, arenaSize_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (arena == MAP_FAILED) {
+            arenaSize_ = 0;
+            return false;
+        }
+        arena_ = static_cast<unsigned char*>(arena);
+        locked = mlock(arena_, arenaSize_) == 0;
+        buffers_.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            buffers_[i].next = i + 1 < count ? static_cast<int>(i + 1) : -1;
+        }
+        freeHead_ = count > 0 ? 0 : -1;
+        return true;
+    }
+
+    bool enabled() const { return arena_ != nullptr; }
+
+    bool owns(const unsigned char* data) const {
+        return data >= arena_ && data < arena_ + arenaSize_;
+    }
+
+    unsigned char* data(int index) {
+        return arena_ + static_cast<size_t>(index) * bufferSize_;
+    }
+
+    // Buffer to build the socket's next data in: a fresh pool buffer, or
+    // fallback when zero copy is off for the socket or the pool is empty
+    unsigned char* start(ZeroCopySocket& zc, unsigned char* fallback) {
+        if (!enabled() || zc.copying) {
+            return fallback;
+        }
+        zc.current = acquire();
+        return zc.current >= 0 ? data(zc.current) : fallback;
+    }
+
+    // The first sent bytes of the used bytes in data went out; continue in
+    // a buffer that holds the unsent rest at its start. A pool buffer is
+    // never written again once sent from, so the rest moves to a new one.
+    unsigned char* advance(ZeroCopySocket& zc, unsigned char* data, size_t sent, size_t used,
+                           unsigned char* fallback) {
+        if (sent == 0) {
+            return data;
+        }
+        if (!owns(data) && (!enabled() || zc.copying)) {
+            memmove(data, data + sent, used - sent);
+            return data;
+        }
+        retireCurrent(zc);
+        unsigned char* next = start(zc, fallback);
+        memmove(next, data + sent, used - sent);
+        return next;
+    }
+
+    // send() that uses MSG_ZEROCOPY when data lies in the socket's current
+    // pool buffer and records the id the kernel gives it
+    ssize_t send(ZeroCopySocket& zc, int socket, const unsigned char* data, size_t size, int flags) {
+        if (!enabled()) {
+            return ::send(socket, data, size, flags);
+        }
+        if (zc.copying || zc.current < 0 || !owns(data)) {
+            stats.copySends++;
+            return ::send(socket, data, size, flags);
+        }
+        ssize_t sent = ::send(socket, data, size, flags | MSG_ZEROCOPY);
+        if (sent == -1 && errno == ENOBUFS) {
+            // Out of notification or locked memory budget: copy this one
+            stats.copySends++;
+            return ::send(socket, data, size, flags);
+        }
+        if (sent >= 0) {
+            Buffer& buffer = buffers_[zc.current];
+            if (buffer.firstId == buffer.endId) {
+                buffer.firstId = buffer.endId = zc.nextId;
+                link(zc, zc.current);
+            }
+            buffer.endId = ++zc.nextId;
+            stats.zerocopySends++;
+        }
+        return sent;
+    }
+
+    // Read every notification queued on the socket's error queue and free
+    // the buffers whose sends all completed. Returns how many were read.
+    int readCompletions(ZeroCopySocket& zc, int socket) {
+        int notifications = 0;
+        while (true) {
+            unsigned char control[CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in6))];
+            msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            if (recvmsg(socket, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+                return notifications;
+            }
+            for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                bool recvErr = (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR)
+                               || (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR);
+                if (!recvErr) {
+                    continue;
+                }
+                sock_extended_err err;
+                memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+                if (err.ee_errno == 0 && err.ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+                    complete(zc, err.ee_info, err.ee_data, (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0);
+                    notifications++;
+                }
+            }
+        }
+    }
+
+    // Socket about to be closed: collect the completions that arrived, then
+    // hand back the buffers still in flight. They are free right away if the
+    // send queue is empty (everything sent was acknowledged), otherwise they
+    // go to quarantine.
+    void release(ZeroCopySocket& zc, int socket) {
+        if (!enabled()) {
+            return;
+        }
+        readCompletions(zc, socket);
+        retireCurrent(zc);
+        int queued = 0;
+        bool drained = ioctl(socket, SIOCOUTQ, &queued) == 0 && queued == 0;
+        uint64_t reuseNs = drained ? 0 : monotonicNs() + ZEROCOPY_QUARANTINE_NS;
+        while (zc.inflightHead >= 0) {
+            int index = zc.inflightHead;
+            zc.inflightHead = buffers_[index].next;
+            if (drained) {
+                recycle(index);
+            } else {
+                quarantine(index, reuseNs);
+            }
+        }
+        zc.inflightTail = -1;
+    }
+
+    ZeroCopyStats stats;
+
+private:
+    struct Buffer {
+        uint32_t firstId = 0; // ids [firstId, endId) of zero-copy sends from this buffer
+        uint32_t endId = 0;
+        uint32_t completed = 0;
+        bool retired = false; // its owner moved on to another buffer
+        uint64_t reuseNs = 0; // quarantined: CLOCK_MONOTONIC time it may be reused
+        int next = -1;        // free list, quarantine or the socket's in-flight list
+    };
+
+    static uint64_t monotonicNs() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+    }
+
+    int acquire() {
+        if (freeHead_ < 0) {
+            releaseQuarantined();
+        }
+        if (freeHead_ < 0) {
+            stats.poolExhausted++;
+            return -1;
+        }
+        int index = freeHead_;
+        freeHead_ = buffers_[index].next;
+        Buffer& buffer = buffers_[index];
+        buffer.firstId = buffer.endId = buffer.completed = 0;
+        buffer.retired = false;
+        buffer.next = -1;
+        return index;
+    }
+
+    void recycle(int index) {
+        buffers_[index].next = freeHead_;
+        freeHead_ = index;
+    }
+
+    // Quarantine entries are appended with a constant delay, so the oldest
+    // one is always the first to expire
+    void quarantine(int index, uint64_t reuseNs) {
+        buffers_[index].reuseNs = reuseNs;
+        buffers_[index].next = -1;
+        if (quarantineTail_ >= 0) {
+            buffers_[quarantineTail_].next = index;
+        } else {
+            quarantineHead_ = index;
+        }
+        quarantineTail_ = index;
+        stats.quarantined++;
+    }
+
+    void releaseQuarantined() {
+        if (quarantineHead_ < 0) {
+            return;
+        }
+        uint64_t now = monotonicNs();
+        while (quarantineHead_ >= 0 && buffers_[quarantineHead_].reuseNs <= now) {
+            int index = quarantineHead_;
+            quarantineHead_ = buffers_[index].next;
+            recycle(index);
+        }
+        if (quarantineHead_ < 0) {
+            quarantineTail_ = -1;
+        }
+    }
+
+    void link(ZeroCopySocket& zc, int index) {
+        buffers_[index].next = -1;
+        if (zc.inflightTail >= 0) {
+            buffers_[zc.inflightTail].next = index;
+        } else {
+            zc.inflightHead = index;
+        }
+        zc.inflightTail = index;
+    }
+
+    // Stop filling the current buffer; it is freed right away if nothing
+    // was sent from it, otherwise once its sends complete
+    void retireCurrent(ZeroCopySocket& zc) {
+        if (zc.current < 0) {
+            return;
+        }
+        Buffer& buffer = buffers_[zc.current];
+        if (buffer.firstId == buffer.endId) {
+            recycle(zc.current);
+        } else {
+            buffer.retired = true;
+            unlinkCompleted(zc);
+        }
+        zc.current = -1;
+    }
+
+    // Ids first..last (inclusive) completed
+    void complete(ZeroCopySocket& zc, uint32_t first, uint32_t last, bool copied) {
+        uint32_t count = last - first + 1;
+        if (copied) {
+            stats.copiedCompletions += count;
+            if (!zc.copying) {
+                zc.copying = true;
+                stats.socketsCopying++;
+            }
+        } else {
+            stats.zerocopyCompletions += count;
+        }
+        for (int index = zc.inflightHead; index >= 0; index = buffers_[index].next) {
+            Buffer& buffer = buffers_[index];
+            uint32_t from = std::max(first, buffer.firstId);
+            uint32_t to = std::min(last + 1, buffer.endId);
+            if (from < to) {
+                buffer.completed += to - from;
+            }
+        }
+        unlinkCompleted(zc);
+    }
+
+    // Free retired buffers whose sends all completed
+    void unlinkCompleted(ZeroCopySocket& zc) {
+        int previous = -1;
+        int index = zc.inflightHead;
+        while (index >= 0) {
+            Buffer& buffer = buffers_[index];
+            int next = buffer.next;
+            if (buffer.retired && buffer.completed == buffer.endId - buffer.firstId) {
+                if (previous >= 0) {
+                    buffers_[previous].next = next;
+                } else {
+                    zc.inflightHead = next;
+                }
+                if (zc.inflightTail == index) {
+                    zc.inflightTail = previous;
+                }
+                recycle(index);
+            } else {
+                previous = index;
+            }
+            index = next;
+        }
+    }
+
+    unsigned char* arena_ = nullptr;
+    size_t arenaSize_ = 0;
+    size_t bufferSize_ = 0;
+    std::vector<Buffer> buffers_;
+    int freeHead_ = -1;
+    int quarantineHead_ = -1;
+    int quarantineTail_ = -1;
+};
+
+inline bool enableZeroCopy(int socket) {
+    int on = 1;
+    return setsockopt(socket, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) == 0;
+}
+
+// How many sends went out zero-copy and how the kernel completed them
+inline void printZeroCopyStats(std::ostream& out, const ZeroCopyStats& stats) {
+    long completions = stats.zerocopyCompletions + stats.copiedCompletions;
+    out << "Zero-copy: " << stats.zerocopySends << " MSG_ZEROCOPY sends, " << stats.copySends
+        << " copying sends; completions " << stats.zerocopyCompletions << " zero-copy / "
+        << stats.copiedCompletions << " copied ("
+        << (completions > 0 ? 100.0 * stats.zerocopyCompletions / completions : 0.0) << "% zero-copy); "
+        << stats.socketsCopying << " socket(s) fell back to copying, pool empty "
+        << stats.poolExhausted << " time(s)";
+    if (stats.quarantined > 0) {
+        out << ", " << stats.quarantined << " buffer(s) quarantined after close";
+    }
+    out << std::endl;
+}
+
+#endif // ZEROCOPY_H